@@ -0,0 +1,227 @@
+/**
+ * @file aircraft_model.hpp
+ *
+ * Nonlinear six degree of freedom aircraft model of chapters 3 and 4 of UAVbook, see http://uavbook.byu.edu/doku.php,
+ * with no wind. The equations of motion are templated on the scalar type so they can be evaluated with complex numbers
+ * to take complex-step derivatives for trim and linearization.
+ */
+
+#ifndef AIRCRAFT_MODEL_H
+#define AIRCRAFT_MODEL_H
+
+#include <cmath>
+#include <complex>
+
+#include <Eigen/Core>
+
+namespace rosplane
+{
+
+/**
+ * Physical and aerodynamic parameters of the aircraft. The defaults are the Aerosonde of UAVbook appendix E.
+ */
+struct AircraftParameters
+{
+  double mass = 13.5;      /**< mass (kg) */
+  double Jx = 0.8244;      /**< roll moment of inertia (kg m^2) */
+  double Jy = 1.135;       /**< pitch moment of inertia (kg m^2) */
+  double Jz = 1.759;       /**< yaw moment of inertia (kg m^2) */
+  double Jxz = 0.1204;     /**< roll-yaw product of inertia (kg m^2) */
+  double gravity = 9.8;    /**< gravitational acceleration (m/s^2) */
+  double rho = 1.2682;     /**< air density at sea level (kg/m^3) */
+  double S_wing = 0.55;    /**< wing area (m^2) */
+  double b = 2.8956;       /**< wing span (m) */
+  double c = 0.18994;      /**< mean chord (m) */
+  double e = 0.9;          /**< Oswald efficiency factor */
+  double S_prop = 0.2027;  /**< propeller disc area (m^2) */
+  double C_prop = 1.0;     /**< propeller thrust coefficient */
+  double k_motor = 80.0;   /**< motor constant, exit airspeed per unit throttle (m/s) */
+  double k_T_p = 0.0;      /**< propeller torque constant */
+  double k_Omega = 0.0;    /**< propeller speed per unit throttle */
+  double M = 50.0;         /**< stall blending rate */
+  double alpha0 = 0.4712;  /**< stall angle of attack (rad) */
+  double C_L_0 = 0.28;
+  double C_L_alpha = 3.45;
+  double C_L_q = 0.0;
+  double C_L_delta_e = -0.36;
+  double C_D_p = 0.0437;
+  double C_D_q = 0.0;
+  double C_D_delta_e = 0.0;
+  double C_m_0 = -0.02338;
+  double C_m_alpha = -0.38;
+  double C_m_q = -3.6;
+  double C_m_delta_e = -0.5;
+  double C_Y_0 = 0.0;
+  double C_Y_beta = -0.98;
+  double C_Y_p = 0.0;
+  double C_Y_r = 0.0;
+  double C_Y_delta_a = 0.0;
+  double C_Y_delta_r = -0.17;
+  double C_ell_0 = 0.0;
+  double C_ell_beta = -0.12;
+  double C_ell_p = -0.26;
+  double C_ell_r = 0.14;
+  double C_ell_delta_a = 0.08;
+  double C_ell_delta_r = 0.105;
+  double C_n_0 = 0.0;
+  double C_n_beta = 0.25;
+  double C_n_p = 0.022;
+  double C_n_r = -0.35;
+  double C_n_delta_a = 0.06;
+  double C_n_delta_r = -0.032;
+};
+
+/**
+ * Aircraft state, (pn, pe, pd, u, v, w, phi, theta, psi, p, q, r).
+ */
+template<typename T>
+using AircraftState = Eigen::Matrix<T, 12, 1>;
+
+/**
+ * Aircraft inputs, (delta_e, delta_a, delta_r, delta_t).
+ */
+template<typename T>
+using AircraftInput = Eigen::Matrix<T, 4, 1>;
+
+/**
+ * Air density at an altitude, from the International Standard Atmosphere troposphere model.
+ * @param rho0 The air density at sea level (kg/m^3).
+ * @param h The altitude (m).
+ * @return The air density (kg/m^3).
+ */
+inline double air_density(double rho0, double h) { return rho0 * std::pow(1.0 - 2.25577e-5 * h, 4.2559); }
+
+/**
+ * Evaluates the equations of motion. Only analytic operations are applied to the state and inputs, so complex-step
+ * derivatives are exact.
+ * @param params The aircraft parameters.
+ * @param rho The air density (kg/m^3).
+ * @param x The state.
+ * @param delta The inputs.
+ * @return The state derivative.
+ */
+template<typename T>
+AircraftState<T> aircraft_derivatives(const AircraftParameters & params, double rho,
+                                      const AircraftState<T> & x, const AircraftInput<T> & delta)
+{
+  using std::atan;
+  using std::asin;
+  using std::cos;
+  using std::exp;
+  using std::sin;
+  using std::sqrt;
+  using std::tan;
+
+  const T & u = x(3);
+  const T & v = x(4);
+  const T & w = x(5);
+  const T & phi = x(6);
+  const T & theta = x(7);
+  const T & psi = x(8);
+  const T & p = x(9);
+  const T & q = x(10);
+  const T & r = x(11);
+  const T & delta_e = delta(0);
+  const T & delta_a = delta(1);
+  const T & delta_r = delta(2);
+  const T & delta_t = delta(3);
+
+  // Airspeed, angle of attack and sideslip. The aircraft always flies forward, so u > 0.
+  T va = sqrt(u * u + v * v + w * w);
+  T alpha = atan(w / u);
+  T beta = asin(v / va);
+
+  // Lift and drag, blending the linear lift curve into a flat plate past stall.
+  double pi = M_PI;
+  double AR = params.b * params.b / params.S_wing;
+  T blend_minus = exp(-params.M * (alpha - params.alpha0));
+  T blend_plus = exp(params.M * (alpha + params.alpha0));
+  T sigma = (1.0 + blend_minus + blend_plus) / ((1.0 + blend_minus) * (1.0 + blend_plus));
+  double sign_alpha = std::real(alpha) >= 0.0 ? 1.0 : -1.0;
+  T C_L_linear = params.C_L_0 + params.C_L_alpha * alpha;
+  T C_L = (1.0 - sigma) * C_L_linear
+          + sigma * (2.0 * sign_alpha * sin(alpha) * sin(alpha) * cos(alpha));
+  T C_D = params.C_D_p + C_L_linear * C_L_linear / (pi * params.e * AR);
+
+  T q_bar = 0.5 * rho * va * va * params.S_wing;
+  T c_scale = params.c / (2.0 * va);
+  T b_scale = params.b / (2.0 * va);
+
+  T F_lift = q_bar * (C_L + params.C_L_q * c_scale * q + params.C_L_delta_e * delta_e);
+  T F_drag = q_bar * (C_D + params.C_D_q * c_scale * q + params.C_D_delta_e * delta_e);
+
+  // Forces in the body frame: gravity, aerodynamics and thrust.
+  T motor_speed = params.k_motor * delta_t;
+  T fx = -params.mass * params.gravity * sin(theta) - cos(alpha) * F_drag + sin(alpha) * F_lift
+         + 0.5 * rho * params.S_prop * params.C_prop * (motor_speed * motor_speed - va * va);
+  T fy = params.mass * params.gravity * cos(theta) * sin(phi)
+         + q_bar
+           * (params.C_Y_0 + params.C_Y_beta * beta + params.C_Y_p * b_scale * p
+              + params.C_Y_r * b_scale * r + params.C_Y_delta_a * delta_a
+              + params.C_Y_delta_r * delta_r);
+  T fz = params.mass * params.gravity * cos(theta) * cos(phi) - sin(alpha) * F_drag
+         - cos(alpha) * F_lift;
+
+  // Moments in the body frame.
+  T prop_speed = params.k_Omega * delta_t;
+  T ell = q_bar * params.b
+            * (params.C_ell_0 + params.C_ell_beta * beta + params.C_ell_p * b_scale * p
+               + params.C_ell_r * b_scale * r + params.C_ell_delta_a * delta_a
+               + params.C_ell_delta_r * delta_r)
+          - params.k_T_p * prop_speed * prop_speed;
+  T m = q_bar * params.c
+        * (params.C_m_0 + params.C_m_alpha * alpha + params.C_m_q * c_scale * q
+           + params.C_m_delta_e * delta_e);
+  T n = q_bar * params.b
+        * (params.C_n_0 + params.C_n_beta * beta + params.C_n_p * b_scale * p
+           + params.C_n_r * b_scale * r + params.C_n_delta_a * delta_a
+           + params.C_n_delta_r * delta_r);
+
+  // Inertia coefficients.
+  double Gamma = params.Jx * params.Jz - params.Jxz * params.Jxz;
+  double Gamma1 = params.Jxz * (params.Jx - params.Jy + params.Jz) / Gamma;
+  double Gamma2 = (params.Jz * (params.Jz - params.Jy) + params.Jxz * params.Jxz) / Gamma;
+  double Gamma3 = params.Jz / Gamma;
+  double Gamma4 = params.Jxz / Gamma;
+  double Gamma5 = (params.Jz - params.Jx) / params.Jy;
+  double Gamma6 = params.Jxz / params.Jy;
+  double Gamma7 = ((params.Jx - params.Jy) * params.Jx + params.Jxz * params.Jxz) / Gamma;
+  double Gamma8 = params.Jx / Gamma;
+
+  T s_phi = sin(phi);
+  T c_phi = cos(phi);
+  T s_theta = sin(theta);
+  T c_theta = cos(theta);
+  T s_psi = sin(psi);
+  T c_psi = cos(psi);
+
+  AircraftState<T> x_dot;
+
+  // Position kinematics.
+  x_dot(0) = c_theta * c_psi * u + (s_phi * s_theta * c_psi - c_phi * s_psi) * v
+             + (c_phi * s_theta * c_psi + s_phi * s_psi) * w;
+  x_dot(1) = c_theta * s_psi * u + (s_phi * s_theta * s_psi + c_phi * c_psi) * v
+             + (c_phi * s_theta * s_psi - s_phi * c_psi) * w;
+  x_dot(2) = -s_theta * u + s_phi * c_theta * v + c_phi * c_theta * w;
+
+  // Translational dynamics.
+  x_dot(3) = r * v - q * w + fx / params.mass;
+  x_dot(4) = p * w - r * u + fy / params.mass;
+  x_dot(5) = q * u - p * v + fz / params.mass;
+
+  // Rotational kinematics.
+  x_dot(6) = p + s_phi * tan(theta) * q + c_phi * tan(theta) * r;
+  x_dot(7) = c_phi * q - s_phi * r;
+  x_dot(8) = (s_phi * q + c_phi * r) / c_theta;
+
+  // Rotational dynamics.
+  x_dot(9) = Gamma1 * p * q - Gamma2 * q * r + Gamma3 * ell + Gamma4 * n;
+  x_dot(10) = Gamma5 * p * r - Gamma6 * (p * p - r * r) + m / params.Jy;
+  x_dot(11) = Gamma7 * p * q - Gamma1 * q * r + Gamma4 * ell + Gamma8 * n;
+
+  return x_dot;
+}
+
+} // namespace rosplane
+
+#endif // AIRCRAFT_MODEL_H
@@ -0,0 +1,32 @@
+/**
+ * @file allocation_tracker.hpp
+ *
+ * Per thread heap allocation counter, used to check that the control loop does not allocate once it has warmed up.
+ * The counting hook replaces malloc, calloc, realloc and the aligned allocators, and is only built into debug builds,
+ * see ROSPLANE_LQR_TRACK_ALLOCATIONS in CMakeLists.txt. Otherwise the counts are always zero.
+ */
+
+#ifndef ALLOCATION_TRACKER_H
+#define ALLOCATION_TRACKER_H
+
+#include <cstdint>
+
+namespace rosplane
+{
+
+/**
+ * Gets the number of heap allocations the calling thread has made. Lock and allocation free.
+ * @return The allocation count, zero if the hook is not built in.
+ */
+uint64_t thread_allocation_count();
+
+/**
+ * Checks that the hook is built in and sees the allocations of this process. The hook only replaces the allocator when
+ * the library is linked into the executable. It has no effect when the library is loaded into a component container.
+ * @return True if allocations are being counted.
+ */
+bool allocation_tracking_active();
+
+} // namespace rosplane
+
+#endif // ALLOCATION_TRACKER_H
@@ -0,0 +1,142 @@
+/**
+ * @file control_kernels.hpp
+ *
+ * Building blocks of the control laws: LQR feedback, integral augmentation, saturation and rate limiting. The state,
+ * input and integrator dimensions are template parameters, so every kernel works on fixed-size Eigen matrices that the
+ * compiler can unroll and vectorize, and none of them allocate.
+ */
+
+#ifndef CONTROL_KERNELS_H
+#define CONTROL_KERNELS_H
+
+#include <Eigen/Core>
+
+namespace rosplane
+{
+
+template<int N>
+using KernelVector = Eigen::Matrix<float, N, 1>;
+
+template<int ROWS, int COLS>
+using KernelMatrix = Eigen::Matrix<float, ROWS, COLS>;
+
+/**
+ * LQR state feedback about trim, u = u_trim - K x.
+ * @param K The NU x NX gain matrix.
+ * @param x The state error.
+ * @param u_trim The trim inputs.
+ * @return The control inputs.
+ */
+template<int NX, int NU>
+inline KernelVector<NU> lqr_feedback(const KernelMatrix<NU, NX> & K, const KernelVector<NX> & x,
+                                     const KernelVector<NU> & u_trim)
+{
+  return u_trim - K * x;
+}
+
+/**
+ * Clamps each input to its limits.
+ * @param u The inputs.
+ * @param lower The lower limits.
+ * @param upper The upper limits.
+ * @return The saturated inputs.
+ */
+template<int N>
+inline KernelVector<N> saturate(const KernelVector<N> & u, const KernelVector<N> & lower,
+                                const KernelVector<N> & upper)
+{
+  return u.cwiseMax(lower).cwiseMin(upper);
+}
+
+/**
+ * Integral augmentation of an LQR law. Integrates NI linear combinations of the NX state errors, z' = C x, and adds
+ * -Ki z to the inputs. Integration stops while the inputs are saturated so the integrator does not wind up.
+ */
+template<int NX, int NU, int NI>
+class IntegralAugmentation
+{
+public:
+  IntegralAugmentation() { z_.setZero(); }
+
+  /**
+   * @param Ki The NU x NI integral gain matrix.
+   * @return The integral feedback, -Ki z.
+   */
+  KernelVector<NU> feedback(const KernelMatrix<NU, NI> & Ki) const { return -Ki * z_; }
+
+  /**
+   * Advances the integrator one step.
+   * @param C The NI x NX matrix selecting the integrated errors.
+   * @param x The state error.
+   * @param Ts The sample time (s).
+   * @param saturated True if the inputs were saturated this step, which holds the integrator.
+   */
+  void update(const KernelMatrix<NI, NX> & C, const KernelVector<NX> & x, float Ts, bool saturated)
+  {
+    if (!saturated) {
+      z_ += Ts * (C * x);
+    }
+  }
+
+  /**
+   * Clears the integrator.
+   */
+  void reset() { z_.setZero(); }
+
+  /**
+   * @return The integrator state.
+   */
+  const KernelVector<NI> & state() const { return z_; }
+
+private:
+  KernelVector<NI> z_;
+};
+
+/**
+ * Limits how fast each input may change between steps. The first step after a reset passes through unchanged.
+ */
+template<int N>
+class RateLimiter
+{
+public:
+  RateLimiter()
+      : initialized_(false)
+  {
+    last_.setZero();
+  }
+
+  /**
+   * Limits the change from the last output.
+   * @param u The requested inputs.
+   * @param max_rate The largest change per second of each input. A rate of zero or less leaves that input unlimited.
+   * @param Ts The sample time (s).
+   * @return The rate limited inputs.
+   */
+  KernelVector<N> limit(const KernelVector<N> & u, const KernelVector<N> & max_rate, float Ts)
+  {
+    if (!initialized_) {
+      initialized_ = true;
+      last_ = u;
+      return last_;
+    }
+
+    KernelVector<N> delta = u - last_;
+    KernelVector<N> step = max_rate * Ts;
+    KernelVector<N> limited = delta.cwiseMax(-step).cwiseMin(step);
+    last_ += (max_rate.array() > 0.0f).select(limited, delta);
+    return last_;
+  }
+
+  /**
+   * Forgets the last output, so the next step passes through.
+   */
+  void reset() { initialized_ = false; }
+
+private:
+  bool initialized_;
+  KernelVector<N> last_;
+};
+
+} // namespace rosplane
+
+#endif // CONTROL_KERNELS_H
@@ -2,7 +2,7 @@
  * @file controller_base.h
  *
  * Base class definition for autopilot controller in chapter 6 of UAVbook, see http://uavbook.byu.edu/doku.php
- * Implements ROS2 functionality and support for control algorithm.
+ * Implements ROS2 functionality and runs a control core, see controller_core.hpp, from the ROS2 topics.
  *
  * @author Ian Reid <iyr27@byu.edu>
  */
@@ -10,12 +10,29 @@
 #ifndef CONTROLLER_BASE_H
 #define CONTROLLER_BASE_H
 
+#include <array>
+#include <atomic>
+#include <cstdint>
 #include <chrono>
+#include <memory>
+#include <vector>
 
 #include <rclcpp/rclcpp.hpp>
 #include <rosflight_msgs/msg/command.hpp>
-
+#include <sensor_msgs/msg/imu.hpp>
+
+#include "allocation_tracker.hpp"
+#include "controller_core.hpp"
+#include "flight_recorder.hpp"
+#include "latency_histogram.hpp"
+#include "lqr_srvs/msg/control_loop_timing.hpp"
+#include "lqr_srvs/msg/pipeline_latency.hpp"
+#include "loaned_publisher.hpp"
 #include "param_manager.hpp"
+#include "pipeline_latency.hpp"
+#include "realtime.hpp"
+#include "seqlock.hpp"
+#include "tick_record.hpp"
 #include "rosplane_msgs/msg/controller_commands.hpp"
 #include "rosplane_msgs/msg/controller_internals.hpp"
 #include "rosplane_msgs/msg/state.hpp"
@@ -25,27 +42,23 @@ using namespace std::chrono_literals;
 
 namespace rosplane
 {
-/**
- * This defines the different portions of the control algorithm.
- */
-enum class AltZones
-{
-  TAKE_OFF, /**< In the take off zone where the aircraft gains speed and altitude */
-  CLIMB, /**< In the climb zone the aircraft proceeds to commanded altitude without course change. */
-  ALTITUDE_HOLD /**< In the altitude hold zone the aircraft keeps altitude and follows commanded course */
-};
 
 /**
- * This class implements all of the basic functionality of a controller interfacing with ROS2.
+ * This class implements all of the basic functionality of a controller interfacing with ROS2. The control law itself
+ * is a ControllerCore, which the node runs once per control tick.
  */
 
 class ControllerBase : public rclcpp::Node
 {
 public:
   /**
-   * Constructor for ROS2 setup and parameter initialization.
+   * Constructor for ROS2 setup and parameter initialization. The parameters of the core are declared with ROS2 along
+   * with the node's own, and the values from the launch are applied to the core at its first tick.
+   * @param core The control law run by the node.
+   * @param options Node options, passed in by a component container.
    */
-  ControllerBase();
+  explicit ControllerBase(std::unique_ptr<ControllerCore> core,
+                          const rclcpp::NodeOptions & options = rclcpp::NodeOptions());
 
   /**
    * Gets the current phi_c value from the current private command message.
@@ -53,7 +66,7 @@ public:
    * @return The latest phi_c value in the controller commands message, as received by the
    * ROS callback.
    */
-  float get_phi_c() { return controller_commands_.phi_c; }
+  float get_phi_c() { return controller_commands_.load().phi_c; }
 
   /**
    * Gets the current theta_c value from the current private command message.
@@ -61,42 +74,35 @@ public:
    * @return The latest theta_c value in the controller commands message, as received by the
    * ROS callback.
    */
-  float get_theta_c() { return controller_commands_.theta_c; };
+  float get_theta_c() { return controller_commands_.load().theta_c; };
+
+  /**
+   * Gets the callback group of the control loop when the real-time profile is enabled. The group is not added to
+   * executors with the node, the caller must spin it on its real-time thread. The profile is only enabled in a process
+   * that called provide_realtime_executor before constructing the node.
+   * @return The control callback group, or nullptr if the real-time profile is disabled.
+   */
+  rclcpp::CallbackGroup::SharedPtr realtime_callback_group();
+
+  /**
+   * Gets the scheduling settings for the real-time control thread, from the realtime_* parameters.
+   * @return The real-time profile.
+   */
+  RealtimeProfile realtime_profile();
 
 protected:
+  using Input = ControllerCore::Input;
+  using Output = ControllerCore::Output;
+
   /**
-   * This struct holds all of the inputs to the control algorithm.
+   * Flight recorder of the control ticks, a few seconds of records at kilohertz rates.
    */
-  struct Input
-  {
-    float Ts;     /**< time step */
-    float h;      /**< altitude */
-    float va;     /**< airspeed */
-    float phi;    /**< roll angle */
-    float theta;  /**< pitch angle */
-    float chi;    /**< course angle */
-    float p;      /**< body frame roll rate */
-    float q;      /**< body frame pitch rate */
-    float r;      /**< body frame yaw rate */
-    float va_c;   /**< commanded airspeed (m/s) */
-    float h_c;    /**< commanded altitude (m) */
-    float chi_c;  /**< commanded course (rad) */
-    float phi_ff; /**< feed forward term for orbits (rad) */
-  };
+  using TickRecorder = FlightRecorder<TickRecord, 4096>;
 
   /**
-   * This struct holds all of the outputs of the control algorithm.
+   * The control law run by the node. Declared before params_, which binds the core's parameters to ROS2.
    */
-  struct Output
-  {
-    float theta_c;         /**< The commanded pitch angle from the altitude control loop */
-    float phi_c;           /**< The commanded roll angle from the course control loop */
-    float delta_e;         /**< The commanded elevator deflection */
-    float delta_a;         /**< The commanded aileron deflection */
-    float delta_r;         /**< The commanded rudder deflection */
-    float delta_t;         /**< The commanded throttle deflection */
-    AltZones current_zone; /**< The current altitude zone for the control */
-  };
+  std::unique_ptr<ControllerCore> core_;
 
   /**
    * Parameter manager object. Contains helper functions to interface parameters with ROS.
@@ -104,22 +110,110 @@ protected:
   ParamManager params_;
 
   /**
-   * Interface for control algorithm.
-   * @param input Inputs to the control algorithm.
-   * @param output Outputs of the controller, including selected intermediate values and final control efforts.
+   * The parameter snapshot of the running control tick, taken when the tick starts. Everything the tick calls reads
+   * its parameters from here, so a parameter update during the tick cannot mix old and new values.
+  */
+  const ParamSnapshot * param_snapshot_;
+
+  /**
+   * Callback group of the control loop. Children put every callback that touches the state of the control law in
+   * this group, so it is serialized with the control loop, and runs on the real-time thread when it is enabled.
+   */
+  rclcpp::CallbackGroup::SharedPtr control_callback_group_;
+
+  /**
+   * Called on the control loop's thread after the core has run and its outputs are published, so children can publish
+   * what the control law reports about the tick.
    */
-  virtual void control(const Input & input, Output & output) = 0;
+  virtual void after_control() {}
 
 private:
+  /**
+   * The fields of the vehicle state the controller uses, copied out of the message so they can be shared through a
+   * seqlock.
+   */
+  struct StateSnapshot
+  {
+    float h;                 /**< altitude */
+    float va;                /**< airspeed */
+    float phi;               /**< roll angle */
+    float theta;             /**< pitch angle */
+    float chi;               /**< course angle */
+    float p;                 /**< body frame roll rate */
+    float q;                 /**< body frame pitch rate */
+    float r;                 /**< body frame yaw rate */
+    float alpha;             /**< angle of attack */
+    float va_rate;           /**< airspeed rate since the previous state (m/s^2) */
+    int64_t received_ns;     /**< steady clock time the state was received (ns) */
+    int64_t stamp_ns;        /**< ROS time stamp of the state (ns) */
+    int64_t sensor_stamp_ns; /**< ROS time stamp of the IMU sample it came from (ns) */
+    int64_t received_ros_ns; /**< ROS time the state was received (ns) */
+  };
+
+  /**
+   * Steady clock times of the stages of one control tick.
+   */
+  struct TickTimes
+  {
+    std::chrono::steady_clock::time_point previous_start; /**< start of the previous tick */
+    std::chrono::steady_clock::time_point start;          /**< start of this tick */
+    std::chrono::steady_clock::time_point state_received; /**< arrival of the state used */
+    std::chrono::steady_clock::time_point control_start;  /**< start of control */
+    std::chrono::steady_clock::time_point control_end;    /**< end of control */
+    std::chrono::steady_clock::time_point pwm_end;        /**< end of convert_to_pwm */
+    std::chrono::steady_clock::time_point publish_end;    /**< end of the publishes */
+    bool controlled; /**< the control law ran, so the stage times are set */
+  };
+
+  /**
+   * Percentiles of one stage of the control loop over a timing window (us).
+   */
+  struct StageSummary
+  {
+    double p50_us;
+    double p99_us;
+    double max_us;
+  };
+
+  /**
+   * Summary of the control loop timing over the last timing window, about a second.
+   */
+  struct TimingSummary
+  {
+    uint64_t window;             /**< sequence number of the window */
+    uint64_t ticks;              /**< control loop ticks run */
+    uint64_t missed_deadlines;   /**< ticks started a period late or longer than a period */
+    StageSummary period_jitter;  /**< deviation of the achieved period from the nominal period */
+    StageSummary control;        /**< time in control */
+    StageSummary convert_to_pwm; /**< time in convert_to_pwm */
+    StageSummary publish;        /**< time filling and publishing the outputs */
+    StageSummary tick;           /**< time from the start of the tick to the end of the publishes */
+    StageSummary state_age;      /**< age of the state used by the tick */
+  };
+
+  /**
+   * The fields of the controller commands the controller uses, copied out of the message so they can be shared
+   * through a seqlock.
+   */
+  struct CommandSnapshot
+  {
+    float va_c;    /**< commanded airspeed (m/s) */
+    float h_c;     /**< commanded altitude (m) */
+    float chi_c;   /**< commanded course (rad) */
+    float phi_ff;  /**< feed forward term for orbits (rad) */
+    float phi_c;   /**< commanded roll angle (rad) */
+    float theta_c; /**< commanded pitch angle (rad) */
+  };
+
   /**
    * This publisher publishes the final calculated control surface deflections.
    */
-  rclcpp::Publisher<rosflight_msgs::msg::Command>::SharedPtr actuators_pub_;
+  LoanedPublisher<rosflight_msgs::msg::Command> actuators_pub_;
 
   /**
    * This publisher publishes the current commands in the control algorithm.
    */
-  rclcpp::Publisher<rosplane_msgs::msg::ControllerInternals>::SharedPtr controller_internals_pub_;
+  LoanedPublisher<rosplane_msgs::msg::ControllerInternals> controller_internals_pub_;
 
   /**
    * This subscriber subscribes to the commands the controller uses to calculate control effort.
@@ -132,7 +226,42 @@ private:
   rclcpp::Subscription<rosplane_msgs::msg::State>::SharedPtr vehicle_state_sub_;
 
   /**
-   * This timer controls how often commands are published by the autopilot.
+   * This subscriber subscribes to the IMU, only for its stamps, to trace states back to the sensor sample they were
+   * estimated from.
+   */
+  rclcpp::Subscription<sensor_msgs::msg::Imu>::SharedPtr imu_sub_;
+
+  /**
+   * Stamps of the latest IMU samples (ns), a ring written by the IMU callback. The State message does not carry the
+   * stamp of the sample it was estimated from, so each state is matched to the newest sample stamped no later.
+   */
+  static constexpr std::size_t SENSOR_STAMPS = 16;
+  std::array<std::atomic<int64_t>, SENSOR_STAMPS> sensor_stamps_;
+  std::size_t sensor_stamp_next_;
+
+  /**
+   * Delays of the sensor to actuator pipeline, recorded by the control loop and summarized with its timing.
+   */
+  PipelineLatency pipeline_latency_;
+
+  /**
+   * Logs every control tick to a file when recorder_enabled is set, otherwise null. Only set at startup.
+   */
+  std::unique_ptr<TickRecorder> recorder_;
+
+  /**
+   * Publishes the pipeline latency summaries to pipeline_latency, along with the timing summaries.
+   */
+  rclcpp::Publisher<lqr_srvs::msg::PipelineLatency>::SharedPtr latency_pub_;
+
+  /**
+   * Callback group of the subscriptions, so they can run on other executor threads while the control loop runs.
+   */
+  rclcpp::CallbackGroup::SharedPtr subscription_callback_group_;
+
+  /**
+   * This timer controls how often commands are published by the autopilot. In the state triggered mode it is the
+   * watchdog, which runs the control loop if no state has arrived within control_watchdog_timeout.
    */
   rclcpp::TimerBase::SharedPtr timer_;
 
@@ -147,19 +276,106 @@ private:
   bool params_initialized_;
 
   /**
-   * The stored value for the most up to date commands for the controller.
+   * Flag that indicates the control loop runs when a new state arrives instead of on the free running timer. Only read
+   * at startup, since it decides which callback group the state subscription is in.
    */
-  rosplane_msgs::msg::ControllerCommands controller_commands_;
+  bool state_triggered_;
 
   /**
-   * The stored value for the most up to date vehicle state (pose).
+   * The time the control loop last ran, used by the minimum interval and the watchdog of the state triggered mode.
    */
-  rosplane_msgs::msg::State vehicle_state_;
+  std::chrono::steady_clock::time_point last_control_time_;
+
+  /**
+   * Flag that indicates the control callback group is spun by a real-time thread instead of the node's executor. Only
+   * read at startup.
+   */
+  bool realtime_;
+
+  /**
+   * Timing of the control loop stages, filled by the control loop and summarized into timing_summary_ about once a
+   * second. The period jitter is the deviation of the achieved control period from the nominal period.
+   */
+  LatencyHistogram<24> period_jitter_hist_;
+  LatencyHistogram<24> control_hist_;
+  LatencyHistogram<24> convert_to_pwm_hist_;
+  LatencyHistogram<24> publish_hist_;
+  LatencyHistogram<24> tick_hist_;
+  LatencyHistogram<24> state_age_hist_;
+  uint64_t timing_ticks_;
+  uint64_t missed_deadlines_;
+  uint64_t timing_window_;
+  std::chrono::steady_clock::time_point timing_window_start_;
+  Seqlock<TimingSummary> timing_summary_;
+
+  /**
+   * Publishes the timing summaries to control_loop_timing, from timing_timer_ outside of the control loop.
+   */
+  rclcpp::Publisher<lqr_srvs::msg::ControlLoopTiming>::SharedPtr timing_pub_;
+  rclcpp::TimerBase::SharedPtr timing_timer_;
+
+  /**
+   * Window of the last published timing summary, so each summary is published once.
+   */
+  uint64_t published_timing_window_;
+
+  /**
+   * Timer that reports the period jitter and the heap allocations of the control loop, outside of the control loop.
+   */
+  rclcpp::TimerBase::SharedPtr report_timer_;
+
+  /**
+   * Number of control ticks before the heap allocations of the control loop are counted.
+   */
+  static constexpr uint64_t ALLOCATION_WARMUP_TICKS = 100;
+
+  /**
+   * Control ticks run so far, up to ALLOCATION_WARMUP_TICKS.
+   */
+  uint64_t control_ticks_;
+
+  /**
+   * Heap allocations made by the control law and by publishing its outputs since the last report, after the warmup.
+   * Only counted when allocation tracking is built in, see allocation_tracker.hpp.
+   */
+  std::atomic<uint64_t> control_allocations_;
+  std::atomic<uint64_t> publish_allocations_;
+
+  /**
+   * Handles of the parameters read by the control loop and the state callback, so they are read without a lookup.
+   */
+  DoubleParam pwm_rad_e_param_;
+  DoubleParam pwm_rad_a_param_;
+  DoubleParam pwm_rad_r_param_;
+  DoubleParam controller_output_frequency_param_;
+  DoubleParam min_control_interval_param_;
+  DoubleParam control_watchdog_timeout_param_;
+  BoolParam state_prediction_param_;
+  DoubleParam state_prediction_lead_param_;
+  DoubleParam state_prediction_max_age_param_;
+
+  /**
+   * Stamp (ns) and airspeed of the previous state, for the airspeed rate. Only used by the state callback.
+   */
+  int64_t previous_state_stamp_ns_;
+  float previous_va_;
+
+  /**
+   * The stored value for the most up to date commands for the controller. Written by the subscription callback and
+   * read by the control loop without locking.
+   */
+  Seqlock<CommandSnapshot> controller_commands_;
+
+  /**
+   * The stored value for the most up to date vehicle state (pose). Written by the subscription callback and read by
+   * the control loop without locking.
+   */
+  Seqlock<StateSnapshot> vehicle_state_;
 
   /**
    * Flag to indicate if the first command has been received.
    */
-  bool command_recieved_;
+  std::atomic<bool> command_recieved_;
 
   /**
    * Convert from deflection angle in radians to pwm.
@@ -172,19 +388,82 @@ private:
    */
   void actuator_controls_publish();
 
+  /**
+   * Creates the flight recorder log in recorder_directory and starts recording.
+   */
+  void start_recorder();
+
+  /**
+   * Propagates the state in the inputs from its stamp to the expected actuation time, the tick time plus
+   * state_prediction_lead, with the body rates and the airspeed rate held. Allocation free.
+   * @param state The state the inputs were assembled from.
+   * @param tick_ns The ROS time of the tick (ns).
+   * @param input The inputs to the control algorithm, updated in place.
+   */
+  void predict_state(const StateSnapshot & state, int64_t tick_ns, Input & input);
+
+  /**
+   * Records the stage times of a tick into the timing histograms, and summarizes them about once a second. Constant
+   * time and allocation free, apart from the summary.
+   * @param times The stage times of this tick.
+   */
+  void record_timing(const TickTimes & times);
+
+  /**
+   * Publishes the latest timing summary and pipeline latency summary, if they have not been published yet.
+   */
+  void publish_timing();
+
+  /**
+   * Callback for new IMU samples, which records their stamps for the pipeline latency.
+   * @param msg Imu message.
+   */
+  void imu_callback(const sensor_msgs::msg::Imu::ConstSharedPtr msg);
+
+  /**
+   * Finds the IMU sample a state was most likely estimated from.
+   * @param stamp_ns The ROS time stamp of the state (ns).
+   * @return The stamp of the newest recent IMU sample stamped no later than the state, or zero if there is none.
+   */
+  int64_t sensor_stamp_before(int64_t stamp_ns) const;
+
+  /**
+   * Adds the heap allocations of a tick to the counts, once the warmup has passed.
+   * @param control Allocations made by the control law.
+   * @param publish Allocations made by publishing its outputs.
+   */
+  void record_allocations(uint64_t control, uint64_t publish);
+
+  /**
+   * Logs the latest period jitter summary, and any heap allocations the control loop made since the last report.
+   */
+  void report_control_loop();
+
+  /**
+   * Runs the control loop from the watchdog timer when no state has triggered it within the timeout.
+   */
+  void watchdog_callback();
+
+  /**
+   * Gets the period of the control timer, the controller period or, in the state triggered mode, the watchdog timeout.
+   * @return The timer period.
+   */
+  std::chrono::microseconds control_timer_period();
+
   /**
    * Callback for new set of controller commands published to the controller_commands_sub_.
-   * This saves the message as the member variable controller_commands_ for use in control loops.
+   * This saves the used fields of the message in controller_commands_ for use in control loops.
    * @param msg ControllerCommands message.
    */
-  void controller_commands_callback(const rosplane_msgs::msg::ControllerCommands::SharedPtr msg);
+  void
+  controller_commands_callback(const rosplane_msgs::msg::ControllerCommands::ConstSharedPtr msg);
 
   /**
    * Callback for the new state of the aircraft published to the vehicle_state_sub_.
-   * This saves the message as the member variable vehicle_state_ for sue in control loops.
+   * This saves the used fields of the message in vehicle_state_ for use in control loops.
    * @param msg
    */
-  void vehicle_state_callback(const rosplane_msgs::msg::State::SharedPtr msg);
+  void vehicle_state_callback(const rosplane_msgs::msg::State::ConstSharedPtr msg);
 
   /**
    * ROS2 parameter system interface. This connects ROS2 parameters with the defined update callback, parametersCallback.
@@ -0,0 +1,228 @@
+/**
+ * @file controller_core.hpp
+ *
+ * Base class of the control laws, independent of ROS. A core holds the parameters and the state of its control law
+ * and runs one control tick per call to update, so benchmarks, fuzzers and batch simulations can construct and run
+ * many controllers without a ROS context. ControllerBase is the ROS2 adapter that feeds a core from topics.
+ */
+
+#ifndef CONTROLLER_CORE_H
+#define CONTROLLER_CORE_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "param_store.hpp"
+
+namespace rosplane
+{
+/**
+ * This defines the different portions of the control algorithm.
+ */
+enum class AltZones
+{
+  TAKE_OFF, /**< In the take off zone where the aircraft gains speed and altitude */
+  CLIMB, /**< In the climb zone the aircraft proceeds to commanded altitude without course change. */
+  ALTITUDE_HOLD /**< In the altitude hold zone the aircraft keeps altitude and follows commanded course */
+};
+
+/**
+ * Severity of a message logged by a control core.
+ */
+enum class LogLevel
+{
+  INFO,
+  WARN,
+  ERROR
+};
+
+class ControllerCore
+{
+public:
+  /**
+   * This struct holds all of the inputs to the control algorithm.
+   */
+  struct Input
+  {
+    float Ts;     /**< time step, the nominal controller period (s) */
+    float h;      /**< altitude */
+    float va;     /**< airspeed */
+    float phi;    /**< roll angle */
+    float theta;  /**< pitch angle */
+    float chi;    /**< course angle */
+    float p;      /**< body frame roll rate */
+    float q;      /**< body frame pitch rate */
+    float r;      /**< body frame yaw rate */
+    float va_c;   /**< commanded airspeed (m/s) */
+    float h_c;    /**< commanded altitude (m) */
+    float chi_c;  /**< commanded course (rad) */
+    float phi_ff; /**< feed forward term for orbits (rad) */
+    int64_t state_stamp_ns;  /**< stamp of the state estimate, zero before the first (ns) */
+    int64_t sensor_stamp_ns; /**< stamp of the IMU sample of the state, zero if unknown (ns) */
+  };
+
+  /**
+   * This struct holds all of the outputs of the control algorithm.
+   */
+  struct Output
+  {
+    float theta_c;         /**< The commanded pitch angle from the altitude control loop */
+    float phi_c;           /**< The commanded roll angle from the course control loop */
+    float delta_e;         /**< The commanded elevator deflection */
+    float delta_a;         /**< The commanded aileron deflection */
+    float delta_r;         /**< The commanded rudder deflection */
+    float delta_t;         /**< The commanded throttle deflection */
+    AltZones current_zone; /**< The current altitude zone for the control */
+  };
+
+  /**
+   * Receives the messages logged by the core. Called from the thread that logs, which is the control loop's thread
+   * for messages logged by update.
+   */
+  using LogHandler = std::function<void(LogLevel level, const char * message)>;
+
+  /**
+   * Declares the parameters shared by every control law, with their default values.
+   */
+  ControllerCore();
+  virtual ~ControllerCore() = default;
+
+  ControllerCore(const ControllerCore &) = delete;
+  ControllerCore & operator=(const ControllerCore &) = delete;
+
+  /**
+   * Runs one control tick with the current parameters. Applies any parameter change made since the last tick first.
+   * Only call from one thread at a time.
+   * @param input Inputs to the control algorithm.
+   * @param output Outputs of the controller, including selected intermediate values and final control efforts.
+   */
+  void update(const Input & input, Output & output);
+
+  /**
+   * Runs one control tick with the given parameter snapshot, so a caller that reads its own parameters from the same
+   * store sees the same values as the control law.
+   * @param input Inputs to the control algorithm.
+   * @param output Outputs of the controller, including selected intermediate values and final control efforts.
+   * @param snapshot The parameters of this tick, taken from params().control_snapshot() by the caller's control loop.
+   */
+  void update(const Input & input, Output & output, const ParamSnapshot & snapshot);
+
+  /**
+   * Gets the parameters of the control law. An adapter can declare its own parameters here too, so one snapshot holds
+   * all of the parameters of a tick.
+   * @return The parameter store.
+   */
+  ParamStore & params() { return params_; }
+
+  /**
+   * Sets parameters by name, all or none, and has the control law apply them at the start of its next tick. Safe to
+   * call from any thread but the control loop's, since the control law prepares the new values on the calling thread.
+   * @param values The names and new values of the parameters.
+   * @param error Set to the reason if the values were not set.
+   * @return True if the values were set.
+   */
+  bool set_parameters(const std::vector<std::pair<std::string, ParamValue>> & values,
+                      std::string & error);
+
+  /**
+   * Sets parameters from a ROS2 parameter file, for running a core with the parameters of a launch. The parameters of
+   * every node in the file are read, and names the core has not declared are ignored. Applied at the start of the next
+   * tick, like set_parameters.
+   * @param path Path of the YAML parameter file.
+   * @param error Set to the reason if the file could not be read or a value has the wrong type.
+   * @return True if the file was read.
+   */
+  bool load_parameters(const std::string & path, std::string & error);
+
+  /**
+   * Has the control law apply parameters changed directly through params() at the start of its next tick. Anything
+   * expensive the new values need is prepared on the calling thread first, so the tick only swaps it in. Safe to call
+   * from any thread but the control loop's.
+   */
+  void notify_parameters_changed();
+
+  /**
+   * Applies parameter changes now instead of at the next tick, for example to set up an expensive backend before the
+   * control loop starts. Only call when update cannot be running.
+   */
+  void apply_parameters();
+
+  /**
+   * Sets the receiver of the messages logged by the core. Without one, warnings and errors are written to std::cerr and
+   * other messages are dropped. Only call when update cannot be running.
+   * @param handler The log handler.
+   */
+  void set_log_handler(LogHandler handler);
+
+protected:
+  /**
+   * The parameters of the control law.
+   */
+  ParamStore params_;
+
+  /**
+   * The parameter snapshot of the running control tick, taken when the tick starts. Everything the tick calls reads
+   * its parameters from here, so a parameter update during the tick cannot mix old and new values.
+  */
+  const ParamSnapshot * param_snapshot_;
+
+  /**
+   * Handle of the rate the control law runs at (Hz), read every tick by the laws that integrate.
+   */
+  DoubleParam controller_output_frequency_param_;
+
+  /**
+   * Interface for control algorithm.
+   * @param input Inputs to the control algorithm.
+   * @param output Outputs of the controller, including selected intermediate values and final control efforts.
+   */
+  virtual void control(const Input & input, Output & output) = 0;
+
+  /**
+   * Called after parameters have been changed, on the thread that changed them. Children can override this to build
+   * anything expensive the new values need, such as loaded files or solved problems, off the control loop's thread.
+   * Calls are serialized, but may run while update is running.
+   */
+  virtual void prepare_parameters() {}
+
+  /**
+   * Called after parameters have been changed and prepared. Children can override this to refresh any values they
+   * cache from the params_ object. It runs on the control loop's thread, at the start of the next tick, so it should
+   * only swap in what prepare_parameters built.
+   */
+  virtual void parameters_changed() {}
+
+  /**
+   * Logs a message through the log handler.
+   * @param level Severity of the message.
+   * @param message The message.
+   */
+  void log(LogLevel level, const char * message) const;
+
+private:
+  /**
+   * Set when parameters change outside of the control loop, so the control loop calls parameters_changed at the start
+   * of its next tick.
+   */
+  std::atomic<bool> parameters_changed_pending_;
+
+  /**
+   * Serializes the calls to prepare_parameters.
+   */
+  std::mutex prepare_mutex_;
+
+  /**
+   * Receiver of the logged messages, or empty for the default.
+   */
+  LogHandler log_handler_;
+};
+
+} // namespace rosplane
+
+#endif // CONTROLLER_CORE_H
@@ -1,12 +1,12 @@
 #ifndef BUILD_CONTROLLER_STATE_MACHINE_H
 #define BUILD_CONTROLLER_STATE_MACHINE_H
 
-#include "controller_base.hpp"
+#include "controller_core.hpp"
 
 namespace rosplane
 {
 
-class ControllerStateMachine : public ControllerBase
+class ControllerStateMachine : public ControllerCore
 {
 
 public:
@@ -66,10 +66,15 @@ protected:
 
 private:
   /**
-   * Declares the parameters associated to this controller, controller_state_machine, so that ROS2 can see them.
-   * Also declares default values before they are set to the values set in the launch script.
+   * Declares the parameters associated to this controller, controller_state_machine, with their default values.
   */
   void declare_parameters();
+
+  /**
+   * Handles of the zone altitudes, read every control tick.
+   */
+  DoubleParam alt_toz_param_;
+  DoubleParam alt_hz_param_;
 };
 
 } // namespace rosplane
@@ -0,0 +1,172 @@
+/**
+ * @file dare_solver.hpp
+ *
+ * Solver for the discrete algebraic Riccati equation, P = A' P A - A' P B (R + B' P B)^-1 B' P A + Q, that gives the
+ * infinite horizon LQR gain K = (R + B' P B)^-1 B' P A for the law u = -K x.
+ */
+
+#ifndef DARE_SOLVER_H
+#define DARE_SOLVER_H
+
+#include <Eigen/Dense>
+#include <Eigen/Eigenvalues>
+
+namespace rosplane
+{
+
+/**
+ * DARE solver for a system with NX states and NU inputs. The first solve uses the structure-preserving doubling
+ * algorithm. Later solves are warm started from the previous gain with Newton (Hewer) iterations, which converge in a
+ * few steps when the weights or model change a little, and fall back to doubling if the previous gain no longer
+ * stabilizes the system.
+ */
+template<int NX, int NU>
+class DareSolver
+{
+public:
+  using MatrixX = Eigen::Matrix<double, NX, NX>;
+  using MatrixB = Eigen::Matrix<double, NX, NU>;
+  using MatrixU = Eigen::Matrix<double, NU, NU>;
+  using MatrixK = Eigen::Matrix<double, NU, NX>;
+
+  DareSolver()
+      : warm_(false)
+      , iterations_(0)
+  {}
+
+  /**
+   * Solves the DARE for the given system and weights.
+   * @param A The discrete state matrix.
+   * @param B The discrete input matrix.
+   * @param Q The state weight, symmetric positive semi-definite.
+   * @param R The input weight, symmetric positive definite.
+   * @return True if the solver converged. The gain and cost are only updated on success.
+   */
+  bool solve(const MatrixX & A, const MatrixB & B, const MatrixX & Q, const MatrixU & R)
+  {
+    if (warm_ && spectral_radius(A - B * K_) < 1.0 && solve_newton(A, B, Q, R)) {
+      return true;
+    }
+    return solve_doubling(A, B, Q, R);
+  }
+
+  /**
+   * Drops the previous solution, so the next solve starts cold.
+   */
+  void reset() { warm_ = false; }
+
+  /**
+   * @return The gain of the last successful solve.
+   */
+  const MatrixK & gain() const { return K_; }
+
+  /**
+   * @return The Riccati solution of the last successful solve.
+   */
+  const MatrixX & cost() const { return P_; }
+
+  /**
+   * @return The number of iterations the last solve took.
+   */
+  int iterations() const { return iterations_; }
+
+private:
+  static constexpr int MAX_ITERATIONS = 50;
+  static constexpr double TOLERANCE = 1e-10;
+
+  bool warm_;
+  int iterations_;
+  MatrixX P_;
+  MatrixK K_;
+
+  static double spectral_radius(const MatrixX & M)
+  {
+    return Eigen::EigenSolver<MatrixX>(M, false).eigenvalues().cwiseAbs().maxCoeff();
+  }
+
+  static MatrixK optimal_gain(const MatrixX & A, const MatrixB & B, const MatrixX & P, const MatrixU & R)
+  {
+    return (R + B.transpose() * P * B).ldlt().solve(B.transpose() * P * A);
+  }
+
+  /**
+   * Solves the Stein equation P = Acl' P Acl + W through its Kronecker form.
+   */
+  static MatrixX solve_stein(const MatrixX & Acl, const MatrixX & W)
+  {
+    Eigen::Matrix<double, NX * NX, NX * NX> lhs = Eigen::Matrix<double, NX * NX, NX * NX>::Identity();
+    for (int i = 0; i < NX; i++) {
+      for (int j = 0; j < NX; j++) {
+        lhs.template block<NX, NX>(i * NX, j * NX) -= Acl(j, i) * Acl.transpose();
+      }
+    }
+
+    Eigen::Matrix<double, NX * NX, 1> w = Eigen::Map<const Eigen::Matrix<double, NX * NX, 1>>(W.data());
+    Eigen::Matrix<double, NX * NX, 1> p = lhs.partialPivLu().solve(w);
+
+    MatrixX P = Eigen::Map<MatrixX>(p.data());
+    return 0.5 * (P + P.transpose());
+  }
+
+  bool solve_newton(const MatrixX & A, const MatrixB & B, const MatrixX & Q, const MatrixU & R)
+  {
+    MatrixK K = K_;
+    MatrixX P;
+
+    for (iterations_ = 1; iterations_ <= MAX_ITERATIONS; iterations_++) {
+      // Cost of the current gain, then the gain that is optimal for that cost.
+      P = solve_stein(A - B * K, Q + K.transpose() * R * K);
+      MatrixK K_next = optimal_gain(A, B, P, R);
+
+      if (!K_next.allFinite()) {
+        return false;
+      }
+
+      bool converged = (K_next - K).norm() <= TOLERANCE * (1.0 + K.norm());
+      K = K_next;
+      if (converged) {
+        P_ = P;
+        K_ = K;
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  bool solve_doubling(const MatrixX & A, const MatrixB & B, const MatrixX & Q, const MatrixU & R)
+  {
+    MatrixX Ak = A;
+    MatrixX Gk = B * R.ldlt().solve(B.transpose());
+    MatrixX Hk = Q;
+
+    for (iterations_ = 1; iterations_ <= MAX_ITERATIONS; iterations_++) {
+      Eigen::PartialPivLU<MatrixX> W(MatrixX::Identity() + Gk * Hk);
+
+      MatrixX W_inv_A = W.solve(Ak);
+      MatrixX H_next = Hk + Ak.transpose() * Hk * W_inv_A;
+      MatrixX G_next = Gk + Ak * W.solve(Gk) * Ak.transpose();
+      Ak = Ak * W_inv_A;
+
+      if (!H_next.allFinite()) {
+        return false;
+      }
+
+      bool converged = (H_next - Hk).norm() <= TOLERANCE * (1.0 + H_next.norm());
+      Hk = 0.5 * (H_next + H_next.transpose());
+      Gk = G_next;
+      if (converged) {
+        P_ = Hk;
+        K_ = optimal_gain(A, B, P_, R);
+        warm_ = true;
+        return true;
+      }
+    }
+
+    return false;
+  }
+};
+
+} // namespace rosplane
+
+#endif // DARE_SOLVER_H
@@ -0,0 +1,107 @@
+/**
+ * @file embedded_python_lqr.hpp
+ *
+ * Runs a control law written in Python inside the controller process, using an embedded CPython interpreter.
+ * The inputs and outputs are exchanged through numpy arrays that view C++ owned buffers, so no ROS messages or
+ * copies through the middleware are involved.
+ */
+
+#ifndef EMBEDDED_PYTHON_LQR_H
+#define EMBEDDED_PYTHON_LQR_H
+
+#include <array>
+#include <memory>
+#include <string>
+
+#include <pybind11/embed.h>
+#include <pybind11/numpy.h>
+
+namespace rosplane
+{
+
+class EmbeddedPythonLqr
+{
+public:
+  /**
+   * Number of floats in the input buffer. The first 13 are the float fields of the controller Input struct, in
+   * declaration order, followed by the LQR reference (va, theta, h, phi, chi).
+   */
+  static constexpr std::size_t INPUT_SIZE = 18;
+
+  /**
+   * Number of floats in the output buffer, ordered (delta_e, delta_a, delta_r, delta_t).
+   */
+  static constexpr std::size_t OUTPUT_SIZE = 4;
+
+  /**
+   * Starts the interpreter, imports the module and looks up the control function. The function is called as
+   * function(x, u), where x is a read-only view of the input buffer and u is a writable view of the output buffer
+   * that the function fills in place.
+   * @param module_name The name of the Python module that holds the control law.
+   * @param function_name The name of the control function in the module.
+   * @param module_path Directory added to sys.path before importing the module. Ignored if empty.
+   * @throws pybind11::error_already_set If the module or function cannot be loaded.
+   */
+  EmbeddedPythonLqr(const std::string & module_name, const std::string & function_name,
+                    const std::string & module_path);
+
+  /**
+   * Gets the buffer viewed by the Python input array. Fill this before calling evaluate.
+   * @return The input buffer.
+   */
+  std::array<float, INPUT_SIZE> & input() { return input_; }
+
+  /**
+   * Gets the buffer viewed by the Python output array. Valid after a successful call to evaluate.
+   * @return The output buffer.
+   */
+  const std::array<float, OUTPUT_SIZE> & output() const { return output_; }
+
+  /**
+   * Calls the Python control function on the current input buffer.
+   * @param error Set to the Python exception text if the call fails.
+   * @return True if the call succeeded and the output buffer is valid.
+   */
+  bool evaluate(std::string & error);
+
+private:
+  /**
+   * The buffer the Python input array views.
+   */
+  std::array<float, INPUT_SIZE> input_;
+
+  /**
+   * The buffer the Python output array views.
+   */
+  std::array<float, OUTPUT_SIZE> output_;
+
+  /**
+   * Keeps the interpreter alive for the lifetime of this object. Only one may exist per process.
+   */
+  std::unique_ptr<pybind11::scoped_interpreter> interpreter_;
+
+  /**
+   * The Python control function.
+   */
+  pybind11::object function_;
+
+  /**
+   * Numpy array that views input_ without copying.
+   */
+  pybind11::array_t<float> input_view_;
+
+  /**
+   * Numpy array that views output_ without copying.
+   */
+  pybind11::array_t<float> output_view_;
+
+  /**
+   * Releases the GIL between calls so the interpreter can be used from whichever thread runs the control loop.
+   * Declared last so it is destroyed first, reacquiring the GIL before the Python objects are released.
+   */
+  std::unique_ptr<pybind11::gil_scoped_release> gil_release_;
+};
+
+} // namespace rosplane
+
+#endif // EMBEDDED_PYTHON_LQR_H
@@ -0,0 +1,89 @@
+/**
+ * @file explicit_mpc.hpp
+ *
+ * Online evaluation of an explicit MPC law. The piecewise affine law is computed offline and stored as a binary tree
+ * of hyperplanes, so finding the region that holds the state takes one comparison per tree level.
+ */
+
+#ifndef EXPLICIT_MPC_H
+#define EXPLICIT_MPC_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+
+namespace rosplane
+{
+
+/**
+ * An explicit MPC law over four states and two inputs, u = F x + g in the region holding x.
+ *
+ * The tree file is little endian binary, as written by scripts/build_explicit_mpc_tree.py:
+ *
+ *   char[8]  magic "RPEMPC1"
+ *   uint32   number of states (4), number of inputs (2), number of nodes, number of leaves
+ *   nodes    float a[4], float b, int32 left, int32 right   (go left if a x <= b)
+ *   leaves   float F[2][4] (row major), float g[2]
+ *
+ * A child index of zero or more is a node, a negative child index c is the leaf -c - 1. Children must come after
+ * their parent, which guarantees every search terminates.
+ */
+class ExplicitMpc
+{
+public:
+  ExplicitMpc();
+
+  /**
+   * Loads a tree, replacing the current one.
+   * @param filename Path to the tree file.
+   * @throws std::runtime_error If the file cannot be read or is malformed.
+   */
+  void load(const std::string & filename);
+
+  /**
+   * @return True if no tree has been loaded.
+   */
+  bool empty() const { return leaves_.empty(); }
+
+  /**
+   * Evaluates the law. Visits at most depth() nodes and does not allocate.
+   * @param x The state, relative to the point the law was designed about.
+   * @return The input, relative to trim.
+   */
+  Eigen::Vector2f evaluate(const Eigen::Vector4f & x) const;
+
+  /**
+   * @return The number of regions (leaves) in the tree.
+   */
+  std::size_t regions() const { return leaves_.size(); }
+
+  /**
+   * @return The largest number of nodes visited by any search, which bounds the evaluation time.
+   */
+  uint32_t depth() const { return depth_; }
+
+private:
+  struct Node
+  {
+    Eigen::Vector4f a;
+    float b;
+    int32_t left;
+    int32_t right;
+  };
+
+  struct Leaf
+  {
+    Eigen::Matrix<float, 2, 4> F;
+    Eigen::Vector2f g;
+  };
+
+  std::vector<Node> nodes_;
+  std::vector<Leaf> leaves_;
+  uint32_t depth_;
+};
+
+} // namespace rosplane
+
+#endif // EXPLICIT_MPC_H
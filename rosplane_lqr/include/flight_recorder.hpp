@@ -0,0 +1,230 @@
+/**
+ * @file flight_recorder.hpp
+ *
+ * In-process flight data recorder. The control loop pushes fixed size records into a lock free ring, and a background
+ * thread drains them into a memory mapped, append only binary log that starts with a schema of the record fields.
+ * scripts/convert_flight_log.py converts the logs to CSV or Parquet.
+ */
+
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "spsc_ring.hpp"
+
+namespace rosplane
+{
+
+/**
+ * Types of the record fields in a log schema.
+ */
+enum class RecordFieldType : uint32_t
+{
+  FLOAT32 = 0,
+  FLOAT64 = 1,
+  INT32 = 2,
+  INT64 = 3,
+};
+
+/**
+ * One field of a record, as described in the log schema.
+ */
+struct RecordField
+{
+  std::string name;     /**< field name, at most 47 characters */
+  RecordFieldType type; /**< field type */
+  uint32_t offset;      /**< byte offset of the field in the record */
+};
+
+/**
+ * Append only binary log of fixed size records, written through memory mappings of the file.
+ *
+ * The first 4096 bytes are the header: the magic "RPLQRLOG", then the version, record size, field count and data
+ * offset as uint32, the record count as uint64, and one 56 byte entry per field, a 48 byte zero padded name followed by
+ * the type and offset as uint32. The records follow at the data offset. All values are little endian. The record count
+ * is updated after every append, so a log cut short by a crash is still readable up to its last append.
+ */
+class RecordLog
+{
+public:
+  RecordLog();
+  ~RecordLog();
+
+  RecordLog(const RecordLog &) = delete;
+  RecordLog & operator=(const RecordLog &) = delete;
+
+  /**
+   * Creates the log file and writes its header.
+   * @param path Path of the log file, replaced if it exists.
+   * @param schema The fields of the records.
+   * @param record_size Size of each record (bytes).
+   * @param error Set to the reason if the log could not be created.
+   * @return True if the log was created.
+   */
+  bool open(const std::string & path, const std::vector<RecordField> & schema, std::size_t record_size,
+            std::string & error);
+
+  /**
+   * Appends records to the log, growing the file as needed.
+   * @param records The records, stored contiguously.
+   * @param count Number of records.
+   * @return False if the file could not be grown. The log is closed then.
+   */
+  bool append(const void * records, std::size_t count);
+
+  /**
+   * Trims the file to the records written and closes it.
+   */
+  void close();
+
+  bool is_open() const { return fd_ >= 0; }
+
+private:
+  /**
+   * Maps the next chunk of the data section, growing the file to hold it.
+   */
+  bool map_next_chunk();
+
+  int fd_;
+  uint8_t * header_;
+  uint8_t * chunk_;
+  std::size_t chunk_index_;
+  std::size_t chunk_used_;
+  std::size_t record_size_;
+  uint64_t record_count_;
+};
+
+/**
+ * Reads a whole log written by a RecordLog.
+ * @param path Path of the log file.
+ * @param schema Set to the fields of the records.
+ * @param record_size Set to the size of each record (bytes).
+ * @param records Set to the records, stored contiguously.
+ * @param error Set to the reason if the log could not be read.
+ * @return True if the log was read.
+ */
+bool read_record_log(const std::string & path, std::vector<RecordField> & schema,
+                     std::size_t & record_size, std::vector<uint8_t> & records, std::string & error);
+
+/**
+ * Records values of type Record from one producer thread, usually the control loop, into a RecordLog. Recording is wait
+ * free: a record is copied into a ring of N records, and dropped if the ring is full. A background thread drains the
+ * ring into the log every DRAIN_PERIOD.
+ */
+template<typename Record, std::size_t N>
+class FlightRecorder
+{
+public:
+  /**
+   * How often the background thread drains the ring.
+   */
+  static constexpr std::chrono::milliseconds DRAIN_PERIOD{10};
+
+  FlightRecorder()
+      : running_(false)
+      , dropped_(0)
+  {}
+
+  ~FlightRecorder() { stop(); }
+
+  FlightRecorder(const FlightRecorder &) = delete;
+  FlightRecorder & operator=(const FlightRecorder &) = delete;
+
+  /**
+   * Creates the log and starts the background thread.
+   * @param path Path of the log file.
+   * @param schema The fields of Record.
+   * @param error Set to the reason if the log could not be created.
+   * @return True if recording started.
+   */
+  bool start(const std::string & path, const std::vector<RecordField> & schema, std::string & error)
+  {
+    if (!log_.open(path, schema, sizeof(Record), error)) {
+      return false;
+    }
+
+    running_ = true;
+    thread_ = std::thread([this]() {
+      while (running_.load(std::memory_order_relaxed)) {
+        drain();
+        std::this_thread::sleep_for(DRAIN_PERIOD);
+      }
+      drain();
+      log_.close();
+    });
+    return true;
+  }
+
+  /**
+   * Drains the remaining records, closes the log and stops the background thread.
+   */
+  void stop()
+  {
+    running_ = false;
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+  /**
+   * Records a value. Wait free and allocation free. Only call from the producer thread.
+   * @param record The value to record.
+   */
+  void record(const Record & record)
+  {
+    if (!ring_.push(record)) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * Gets and clears the number of records dropped because the ring was full, or the log could not be written.
+   * @return The records dropped since the last call.
+   */
+  uint64_t take_dropped() { return dropped_.exchange(0, std::memory_order_relaxed); }
+
+private:
+  /**
+   * Moves every record in the ring to the log, in batches.
+   */
+  void drain()
+  {
+    std::size_t count = 0;
+    while (ring_.pop(batch_[count])) {
+      if (++count == batch_.size()) {
+        write(count);
+        count = 0;
+      }
+    }
+    write(count);
+  }
+
+  void write(std::size_t count)
+  {
+    if (count == 0) {
+      return;
+    }
+    if (!log_.is_open() || !log_.append(batch_.data(), count)) {
+      dropped_.fetch_add(count, std::memory_order_relaxed);
+    }
+  }
+
+  SpscRing<Record, N> ring_;
+  std::array<Record, 256> batch_;
+  RecordLog log_;
+  std::thread thread_;
+  std::atomic<bool> running_;
+  std::atomic<uint64_t> dropped_;
+};
+
+} // namespace rosplane
+
+#endif // FLIGHT_RECORDER_H
@@ -0,0 +1,89 @@
+/**
+ * @file gain_schedule.hpp
+ *
+ * Precomputed LQR gains over a grid of airspeed and altitude, interpolated at run time.
+ */
+
+#ifndef GAIN_SCHEDULE_H
+#define GAIN_SCHEDULE_H
+
+#include <string>
+#include <vector>
+
+#include "lqr_gains.hpp"
+
+namespace rosplane
+{
+
+/**
+ * A rectangular grid of LQR gain blocks indexed by airspeed and altitude. The blocks are stored contiguously, airspeed
+ * major, so the four blocks around a point are two pairs of neighbours in memory.
+ *
+ * The schedule file is YAML:
+ *
+ *   va: [15.0, 20.0, 25.0, 30.0]   # increasing airspeed breakpoints (m/s)
+ *   h: [0.0, 100.0]                # increasing altitude breakpoints (m)
+ *   points:                        # one entry per (va, h) pair, airspeed major
+ *     - k_lon: [8 values, row major]
+ *       k_lat: [8 values, row major]
+ *       u_trim: [delta_e, delta_a, delta_r, delta_t]
+ */
+class GainSchedule
+{
+public:
+  /**
+   * Loads a schedule from a YAML file, replacing the current contents.
+   * @param filename Path to the schedule file.
+   * @throws std::runtime_error If the file cannot be read or the grid is malformed.
+   */
+  void load(const std::string & filename);
+
+  /**
+   * Removes every grid point, so the schedule is empty.
+   */
+  void clear();
+
+  /**
+   * @return True if no schedule has been loaded.
+   */
+  bool empty() const { return blocks_.empty(); }
+
+  /**
+   * Bilinearly interpolates the gains at the given flight condition. Points outside the grid are clamped to its edge,
+   * and a non-finite airspeed or altitude to its first breakpoint. Does not allocate.
+   * @param va The airspeed (m/s).
+   * @param h The altitude (m).
+   * @param gains The interpolated gains.
+   */
+  void interpolate(float va, float h, LqrGains & gains) const;
+
+private:
+  /**
+   * The airspeed breakpoints.
+   */
+  std::vector<float> va_;
+
+  /**
+   * The altitude breakpoints.
+   */
+  std::vector<float> h_;
+
+  /**
+   * The gain blocks at each grid point, airspeed major.
+   */
+  std::vector<LqrGains> blocks_;
+
+  /**
+   * Finds the cell of the breakpoints that holds a value and the fraction of the way across it.
+   * @param breakpoints The increasing breakpoints.
+   * @param value The value to locate, clamped to the breakpoints. A non-finite value is clamped to the first.
+   * @param index The index of the lower breakpoint of the cell.
+   * @param fraction The fraction of the way from the lower to the upper breakpoint.
+   */
+  static void locate(const std::vector<float> & breakpoints, float value, std::size_t & index,
+                     float & fraction);
+};
+
+} // namespace rosplane
+
+#endif // GAIN_SCHEDULE_H
@@ -0,0 +1,109 @@
+/**
+ * @file latency_histogram.hpp
+ *
+ * Fixed-bucket latency histogram. Recording is constant time and allocation free, so it can be used inside the
+ * control loop.
+ */
+
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+namespace rosplane
+{
+
+/**
+ * Histogram with N geometrically spaced buckets. Bucket 0 holds every sample below the minimum edge and the last
+ * bucket holds every sample above the maximum edge.
+ */
+template<std::size_t N>
+class LatencyHistogram
+{
+  static_assert(N >= 3, "A latency histogram needs at least three buckets.");
+
+public:
+  /**
+   * Constructor that places the bucket edges.
+   * @param min_us Upper edge of the first bucket (us).
+   * @param max_us Upper edge of the second to last bucket (us). Larger samples fall in the last bucket.
+   */
+  LatencyHistogram(double min_us, double max_us)
+      : min_us_(min_us)
+      , log_ratio_(std::log(max_us / min_us) / (N - 2))
+  {
+    for (std::size_t i = 0; i < N - 1; i++) {
+      upper_edges_[i] = min_us_ * std::exp(log_ratio_ * i);
+    }
+    upper_edges_[N - 1] = INFINITY;
+    reset();
+  }
+
+  /**
+   * Adds a sample to the histogram.
+   * @param us The latency to record (us).
+   */
+  void record(double us)
+  {
+    std::size_t bucket = 0;
+    if (us >= min_us_) {
+      bucket = std::min<std::size_t>(static_cast<std::size_t>(std::log(us / min_us_) / log_ratio_) + 1, N - 1);
+    }
+
+    counts_[bucket]++;
+    count_++;
+    max_us_ = std::max(max_us_, us);
+  }
+
+  /**
+   * Finds the bucket that contains the given quantile.
+   * @param quantile The quantile to find, between 0 and 1.
+   * @return The upper edge of the bucket holding the quantile (us), or the maximum sample if it is in the last bucket.
+   */
+  double percentile(double quantile) const
+  {
+    if (count_ == 0) {
+      return 0.0;
+    }
+
+    uint64_t target = static_cast<uint64_t>(std::ceil(quantile * count_));
+    uint64_t cumulative = 0;
+    for (std::size_t i = 0; i < N - 1; i++) {
+      cumulative += counts_[i];
+      if (cumulative >= target) {
+        return std::min(upper_edges_[i], max_us_);
+      }
+    }
+    return max_us_;
+  }
+
+  /**
+   * Clears all of the recorded samples.
+   */
+  void reset()
+  {
+    counts_.fill(0);
+    count_ = 0;
+    max_us_ = 0.0;
+  }
+
+  double max() const { return max_us_; }
+  uint64_t count() const { return count_; }
+  const std::array<double, N> & upper_edges() const { return upper_edges_; }
+  const std::array<uint64_t, N> & counts() const { return counts_; }
+
+private:
+  double min_us_;
+  double log_ratio_;
+  std::array<double, N> upper_edges_;
+  std::array<uint64_t, N> counts_;
+  uint64_t count_;
+  double max_us_;
+};
+
+} // namespace rosplane
+
+#endif // LATENCY_HISTOGRAM_H
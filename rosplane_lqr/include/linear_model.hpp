@@ -0,0 +1,69 @@
+/**
+ * @file linear_model.hpp
+ *
+ * Linear models of the decoupled longitudinal and lateral aircraft dynamics used to design the LQR gains. They follow
+ * the transfer function models of chapter 5 of UAVbook, see http://uavbook.byu.edu/doku.php, written in the state
+ * ordering of the LQR controller.
+ */
+
+#ifndef LINEAR_MODEL_H
+#define LINEAR_MODEL_H
+
+#include <Eigen/Core>
+
+namespace rosplane
+{
+
+/**
+ * Coefficients of the linear models, linearized about wings-level trim at the trim airspeed.
+ */
+struct LinearModelCoefficients
+{
+  double va_trim;  /**< trim airspeed (m/s) */
+  double gravity;  /**< gravitational acceleration (m/s^2) */
+  double a_phi1;   /**< roll rate damping, p' = -a_phi1 p + a_phi2 delta_a */
+  double a_phi2;   /**< aileron effectiveness */
+  double a_r1;     /**< yaw rate damping, r' = -a_r1 r + a_r2 delta_r */
+  double a_r2;     /**< rudder effectiveness */
+  double a_theta1; /**< pitch rate damping, q' = -a_theta1 q - a_theta2 theta + a_theta3 delta_e */
+  double a_theta2; /**< pitch stiffness */
+  double a_theta3; /**< elevator effectiveness */
+  double a_v1;     /**< airspeed damping, va' = -a_v1 va + a_v2 delta_t - a_v3 theta */
+  double a_v2;     /**< throttle effectiveness */
+  double a_v3;     /**< gravity coupling of pitch into airspeed */
+};
+
+/**
+ * A discrete linear model, x[k+1] = A x[k] + B u[k], with four states and two inputs.
+ */
+struct LinearModel
+{
+  Eigen::Matrix4d A;
+  Eigen::Matrix<double, 4, 2> B;
+};
+
+/**
+ * Builds the continuous longitudinal model. The states are (va, theta, q, h) and the inputs (delta_e, delta_t).
+ * @param coefficients The model coefficients.
+ * @return The continuous time model.
+ */
+LinearModel longitudinal_model(const LinearModelCoefficients & coefficients);
+
+/**
+ * Builds the continuous lateral model. The states are (phi, chi, p, r) and the inputs (delta_a, delta_r).
+ * @param coefficients The model coefficients.
+ * @return The continuous time model.
+ */
+LinearModel lateral_model(const LinearModelCoefficients & coefficients);
+
+/**
+ * Discretizes a continuous model with a zero order hold on the inputs.
+ * @param model The continuous time model.
+ * @param Ts The sample time (s).
+ * @return The discrete time model.
+ */
+LinearModel discretize(const LinearModel & model, double Ts);
+
+} // namespace rosplane
+
+#endif // LINEAR_MODEL_H
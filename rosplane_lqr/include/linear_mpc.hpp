@@ -0,0 +1,207 @@
+/**
+ * @file linear_mpc.hpp
+ *
+ * Online linear model predictive control with input bounds. The finite horizon problem is condensed into a small dense
+ * box constrained QP in the input sequence, sized at compile time, and solved with accelerated projected gradient
+ * (FISTA) iterations warm started from the previous solution shifted by one step.
+ */
+
+#ifndef LINEAR_MPC_H
+#define LINEAR_MPC_H
+
+#include <chrono>
+#include <cmath>
+
+#include <Eigen/Dense>
+#include <Eigen/Eigenvalues>
+
+#include "dare_solver.hpp"
+
+namespace rosplane
+{
+
+/**
+ * Linear MPC for a system with NX states, NU inputs and a horizon of N steps. Minimizes
+ * sum_{k<N} (x_k' Q x_k + u_k' R u_k) + x_N' P x_N subject to u_min <= u_k <= u_max, where P is the infinite horizon
+ * LQR cost, so the law matches the LQR law whenever the bounds are inactive. The states and inputs are deviations from
+ * trim.
+ */
+template<int NX, int NU, int N>
+class LinearMpc
+{
+public:
+  static constexpr int NV = N * NU;
+
+  using MatrixX = Eigen::Matrix<double, NX, NX>;
+  using MatrixB = Eigen::Matrix<double, NX, NU>;
+  using MatrixU = Eigen::Matrix<double, NU, NU>;
+  using VectorX = Eigen::Matrix<double, NX, 1>;
+  using VectorU = Eigen::Matrix<double, NU, 1>;
+  using VectorV = Eigen::Matrix<double, NV, 1>;
+
+  /**
+   * Outcome of a solve.
+   */
+  struct SolveStats
+  {
+    int iterations;        /**< projected gradient iterations run */
+    bool converged;        /**< the step size fell below the tolerance */
+    bool iteration_cap_hit; /**< stopped by the iteration cap or the deadline before converging */
+  };
+
+  LinearMpc()
+      : ready_(false)
+      , step_(0.0)
+  {
+    U_.setZero();
+  }
+
+  /**
+   * Condenses the horizon problem. Not real time safe, call it when the model or weights change.
+   * @param A The discrete state matrix.
+   * @param B The discrete input matrix.
+   * @param Q The state weight, symmetric positive semi-definite.
+   * @param R The input weight, symmetric positive definite.
+   * @param u_min The lower input bound.
+   * @param u_max The upper input bound.
+   * @return True if the terminal cost could be computed. The previous problem is kept on failure.
+   */
+  bool setup(const MatrixX & A, const MatrixB & B, const MatrixX & Q, const MatrixU & R,
+             const VectorU & u_min, const VectorU & u_max)
+  {
+    DareSolver<NX, NU> dare;
+    if (!dare.solve(A, B, Q, R)) {
+      return false;
+    }
+    const MatrixX & P = dare.cost();
+
+    // Predicted states x_1 ... x_N as Sx x_0 + Su U.
+    Eigen::MatrixXd Sx(N * NX, NX);
+    Eigen::MatrixXd Su = Eigen::MatrixXd::Zero(N * NX, NV);
+    MatrixX Ak = A;
+    for (int k = 0; k < N; k++) {
+      Sx.block<NX, NX>(k * NX, 0) = Ak;
+      Ak = A * Ak;
+    }
+    for (int k = 0; k < N; k++) {
+      // x_{k+1} depends on u_j for j <= k through A^(k-j) B.
+      MatrixB AB = B;
+      for (int j = k; j >= 0; j--) {
+        Su.block<NX, NU>(k * NX, j * NU) = AB;
+        AB = A * AB;
+      }
+    }
+
+    // Weight each predicted state with Q, and the last one with the terminal cost.
+    Eigen::MatrixXd QSu(N * NX, NV);
+    Eigen::MatrixXd QSx(N * NX, NX);
+    for (int k = 0; k < N; k++) {
+      const MatrixX & W = k == N - 1 ? P : Q;
+      QSu.middleRows<NX>(k * NX) = W * Su.middleRows<NX>(k * NX);
+      QSx.middleRows<NX>(k * NX) = W * Sx.middleRows<NX>(k * NX);
+    }
+
+    Eigen::MatrixXd H = Su.transpose() * QSu;
+    for (int k = 0; k < N; k++) {
+      H.block<NU, NU>(k * NU, k * NU) += R;
+    }
+    H_ = 0.5 * (H + H.transpose());
+    F_ = Su.transpose() * QSx;
+
+    // The gradient is Lipschitz with the largest eigenvalue of H.
+    double lipschitz = Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd>(H_, Eigen::EigenvaluesOnly)
+                         .eigenvalues()
+                         .maxCoeff();
+    step_ = 1.0 / lipschitz;
+
+    for (int k = 0; k < N; k++) {
+      lower_.template segment<NU>(k * NU) = u_min;
+      upper_.template segment<NU>(k * NU) = u_max;
+    }
+
+    // Keep the warm start, it is still a good guess when the problem only changed a little.
+    U_ = U_.cwiseMax(lower_).cwiseMin(upper_);
+    ready_ = true;
+    return true;
+  }
+
+  /**
+   * Solves the QP for the current state. Lock and allocation free.
+   * @param x0 The current state.
+   * @param max_iterations The most iterations to run.
+   * @param deadline The time to stop iterating, even if not converged.
+   * @return The iteration count and whether the solve converged.
+   */
+  SolveStats solve(const VectorX & x0, int max_iterations,
+                   std::chrono::steady_clock::time_point deadline)
+  {
+    // Warm start from the previous solution shifted one step, repeating the last input.
+    VectorV U;
+    U.template head<NV - NU>() = U_.template tail<NV - NU>();
+    U.template tail<NU>() = U_.template tail<NU>();
+
+    VectorV f = F_ * x0;
+    VectorV Y = U;
+    VectorV U_next;
+    double t = 1.0;
+
+    SolveStats stats{0, false, false};
+    while (stats.iterations < max_iterations) {
+      stats.iterations++;
+
+      U_next = (Y - step_ * (H_ * Y + f)).cwiseMax(lower_).cwiseMin(upper_);
+
+      // Restart the momentum when it points uphill.
+      if ((Y - U_next).dot(U_next - U) > 0.0) {
+        t = 1.0;
+      }
+      double t_next = 0.5 * (1.0 + std::sqrt(1.0 + 4.0 * t * t));
+      Y = U_next + ((t - 1.0) / t_next) * (U_next - U);
+      t = t_next;
+
+      double change = (U_next - U).squaredNorm();
+      U = U_next;
+      if (change <= TOLERANCE * TOLERANCE) {
+        stats.converged = true;
+        break;
+      }
+      if (std::chrono::steady_clock::now() >= deadline) {
+        break;
+      }
+    }
+
+    stats.iteration_cap_hit = !stats.converged;
+    U_ = U;
+    return stats;
+  }
+
+  /**
+   * Drops the warm start, so the next solve starts from zero input.
+   */
+  void reset() { U_.setZero(); }
+
+  /**
+   * @return True once a problem has been set up.
+   */
+  bool ready() const { return ready_; }
+
+  /**
+   * @return The first input of the last solution, the one to apply.
+   */
+  VectorU first_input() const { return U_.template head<NU>(); }
+
+private:
+  static constexpr double TOLERANCE = 1e-6;
+
+  bool ready_;
+  double step_;
+  Eigen::Matrix<double, NV, NV> H_;
+  Eigen::Matrix<double, NV, NX> F_;
+  VectorV lower_;
+  VectorV upper_;
+  VectorV U_;
+};
+
+} // namespace rosplane
+
+#endif // LINEAR_MPC_H
@@ -0,0 +1,115 @@
+/**
+ * @file loaned_publisher.hpp
+ *
+ * Publisher wrapper that fills messages in middleware loaned memory when the middleware supports it, or in messages
+ * from a preallocated pool otherwise, so the control loop publishes without copying or allocating the message.
+ */
+
+#ifndef LOANED_PUBLISHER_H
+#define LOANED_PUBLISHER_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include <rclcpp/rclcpp.hpp>
+
+#include "message_pool.hpp"
+
+namespace rosplane
+{
+
+/**
+ * Publishes messages of type MessageT that are filled in place. If the middleware can loan messages, each message is
+ * filled in a loan and handed to the middleware without a copy. Otherwise it is filled in a message from the
+ * publisher's pool and published as a unique_ptr, so with intra-process comms its ownership moves to the subscribers
+ * instead of being copied for them. The message goes back to the pool once it is published to the middleware, or once
+ * the last intra-process subscriber releases it. Middlewares only loan fixed size messages, ones without strings or
+ * unbounded sequences.
+ *
+ * Not thread safe, each loaned publisher needs a single publishing thread.
+ */
+template<typename MessageT>
+class LoanedPublisher
+{
+public:
+  using Allocator = PoolAllocator<void>;
+  using Publisher = rclcpp::Publisher<MessageT, Allocator>;
+
+  /**
+   * Messages in the pool of each publisher, enough for the queues of a few subscribers that keep the last 10.
+   */
+  static constexpr std::size_t POOL_MESSAGES = 64;
+
+  LoanedPublisher() = default;
+
+  /**
+   * Creates the publisher and its pool of messages.
+   * @param node The node to publish from.
+   * @param topic The topic to publish on.
+   * @param qos The quality of service of the publisher.
+   */
+  LoanedPublisher(rclcpp::Node & node, const std::string & topic, const rclcpp::QoS & qos)
+  {
+    // Each block also fits the reference counts of a shared_ptr made around the message with the same allocator, for
+    // intra-process subscribers that share it.
+    auto pool = std::make_shared<MessagePool>(sizeof(MessageT) + SHARED_OVERHEAD, POOL_MESSAGES);
+
+    rclcpp::PublisherOptionsWithAllocator<Allocator> options;
+    options.allocator = std::make_shared<Allocator>(pool);
+    publisher_ = node.create_publisher<MessageT, Allocator>(topic, qos, options);
+    allocator_ = publisher_->get_allocator();
+  }
+
+  /**
+   * Fills a message and publishes it. Allocation free when loaned, or while the pool has a free message. When every
+   * intra-process subscriber only shares the message, rclcpp still allocates the reference counts of the shared_ptr it
+   * makes from the unique_ptr.
+   * @param fill Called with the message to fill, which starts from its defaults.
+   */
+  template<typename Fill>
+  void publish(Fill && fill)
+  {
+    if (publisher_->can_loan_messages()) {
+      auto loaned = publisher_->borrow_loaned_message();
+      if (loaned.is_valid()) {
+        loaned.get() = MessageT();
+        fill(loaned.get());
+        publisher_->publish(std::move(loaned));
+        return;
+      }
+    }
+
+    using Traits = typename Publisher::ROSMessageTypeAllocatorTraits;
+    using Deleter = typename Publisher::ROSMessageTypeDeleter;
+    MessageT * message = Traits::allocate(*allocator_, 1);
+    Traits::construct(*allocator_, message);
+    std::unique_ptr<MessageT, Deleter> owned(message, Deleter(allocator_.get()));
+    fill(*owned);
+    publisher_->publish(std::move(owned));
+  }
+
+  /**
+   * @return True if the middleware loans the messages.
+   */
+  bool loaning() const { return publisher_->can_loan_messages(); }
+
+private:
+  /**
+   * Room left in each pool block for the reference counts and allocator of a shared_ptr made around the message
+   * (bytes).
+   */
+  static constexpr std::size_t SHARED_OVERHEAD = 64;
+
+  std::shared_ptr<Publisher> publisher_;
+
+  /**
+   * The publisher's message allocator over the pool, which the deleters of the published messages point to.
+   */
+  std::shared_ptr<typename Publisher::ROSMessageTypeAllocator> allocator_;
+};
+
+} // namespace rosplane
+
+#endif // LOANED_PUBLISHER_H
@@ -0,0 +1,626 @@
+/**
+ * @file lqr_controller.hpp
+ *
+ * The LQR control laws and their backends, independent of ROS. PythonControllerInterface runs an LqrController in the
+ * lqr_controller node, and benchmarks or simulations can construct and run it directly.
+ */
+
+#ifndef LQR_CONTROLLER_H
+#define LQR_CONTROLLER_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <Eigen/Core>
+
+#include "control_kernels.hpp"
+#include "controller_state_machine.hpp"
+#include "explicit_mpc.hpp"
+#include "gain_schedule.hpp"
+#include "linear_mpc.hpp"
+#include "lqr_gain_solver.hpp"
+#include "lqr_gains.hpp"
+#include "tvlqr.hpp"
+
+#ifdef ROSPLANE_LQR_EMBEDDED_PYTHON
+#include "embedded_python_lqr.hpp"
+#endif
+
+namespace rosplane
+{
+
+/**
+ * This defines which control law is used and where it is evaluated.
+ */
+enum class LqrBackend
+{
+  NATIVE,          /**< The control law is evaluated in C++ with the cached gain matrices */
+  EMBEDDED_PYTHON, /**< The control law is evaluated by a Python function in an embedded interpreter */
+  SERVICE,         /**< The control law is evaluated by the lqr_controller_update service, without blocking */
+  EXPLICIT_MPC,    /**< A precomputed explicit MPC law is evaluated by searching its region tree */
+  LINEAR_MPC       /**< A linear MPC problem is solved online every tick */
+};
+
+/**
+ * Gets the name of a backend, as it is given in the lqr_backend parameter.
+ * @param backend The backend.
+ * @return The name.
+ */
+const char * lqr_backend_name(LqrBackend backend);
+
+class LqrController : public ControllerStateMachine
+{
+public:
+  /**
+   * This struct holds the reference point the LQR regulates the aircraft to. The state error is taken with respect to
+   * these values.
+   */
+  struct Reference
+  {
+    float va;    /**< reference airspeed (m/s) */
+    float theta; /**< reference pitch angle (rad) */
+    float h;     /**< reference altitude (m) */
+    float phi;   /**< reference roll angle (rad) */
+    float chi;   /**< reference course (rad) */
+  };
+
+  /**
+   * A control law evaluated outside of the controller, used by the service backend. The ROS2 adapter attaches one that
+   * calls the lqr_controller_update service.
+   */
+  class Service
+  {
+  public:
+    virtual ~Service() = default;
+
+    /**
+     * Evaluates the control law for this tick. Called from update, so it must not block.
+     * @param input The command inputs to the controller such as course and airspeed.
+     * @param reference The reference point the state error is taken with respect to.
+     * @param gains The gains and trim inputs for the current zone and flight condition.
+     * @param output The control efforts calculated and selected intermediate values.
+     * @return True if a command was applied to the output.
+     */
+    virtual bool evaluate(const Input & input, const Reference & reference, const LqrGains & gains,
+                          Output & output) = 0;
+
+    /**
+     * Called when the service backend is selected, so a command from before is not reused.
+     */
+    virtual void selected() {}
+  };
+
+  /**
+   * A path segment from the path manager, used to plan the time-varying lateral gains.
+   */
+  struct PathSegment
+  {
+    bool orbit;             /**< true for an orbit, false for a line */
+    float va_d;             /**< desired airspeed, zero for the trim airspeed (m/s) */
+    std::array<float, 3> r; /**< origin of a line */
+    std::array<float, 3> q; /**< direction of a line */
+    std::array<float, 3> c; /**< center of an orbit */
+    float rho;              /**< radius of an orbit (m) */
+    int lamda;              /**< direction of an orbit, 1 clockwise and -1 counter clockwise */
+  };
+
+  /**
+   * Latency of the control law calls over a reporting window.
+   */
+  struct CallSummary
+  {
+    uint64_t calls;        /**< calls since the controller was constructed */
+    uint64_t window_calls; /**< calls in the window */
+    double last_call_us;   /**< latency of the most recent call */
+    double mean_call_us;   /**< mean latency in the window */
+    double max_call_us;    /**< largest latency in the window */
+  };
+
+  /**
+   * Solve time and iterations of the linear MPC in one tick.
+   */
+  struct MpcSolveSummary
+  {
+    double solve_time_us;     /**< time of both solves */
+    double max_solve_time_us; /**< worst solve time since the controller was constructed */
+    double budget_us;         /**< time budget of both solves */
+    int lon_iterations;       /**< iterations of the longitudinal solve */
+    int lat_iterations;       /**< iterations of the lateral solve */
+    bool iteration_cap_hit;   /**< a solve stopped before converging */
+  };
+
+  /**
+   * Declares the parameters of the LQR control laws with their default values and sets up the backend they select.
+   */
+  LqrController();
+
+  /**
+   * Frees the active, pending and retired configurations.
+   */
+  ~LqrController() override;
+
+  /**
+   * Attaches the law the service backend evaluates. Without one, selecting the service backend uses the native law.
+   * Only call when update cannot be running, and call apply_parameters after it to select the service backend.
+   * @param service The service law, which must outlive the controller, or nullptr to detach it.
+   */
+  void set_service(Service * service);
+
+  /**
+   * Queues the time-varying lateral gains to be planned when tracking is enabled and the path manager switches to a
+   * new segment. The path is republished at a fixed rate, so unchanged segments are ignored. Only call from the control
+   * loop's thread. Lock and allocation free, the plan is made on the planner's thread.
+   * @param path The current path segment.
+   */
+  void set_path(const PathSegment & path);
+
+  /**
+   * @return The backend currently used to evaluate the control law.
+   */
+  LqrBackend backend() const { return lqr_backend_; }
+
+  /**
+   * Gets the call latency of the current reporting window and starts a new window. Only call from the control loop's
+   * thread.
+   * @return The call latency.
+   */
+  CallSummary take_call_summary();
+
+  /**
+   * Gets the linear MPC solve of the last tick, once.
+   * @param summary Set to the solve time and iterations.
+   * @return False if no linear MPC problem was solved since the last call.
+   */
+  bool take_mpc_summary(MpcSolveSummary & summary);
+
+protected:
+  /**
+   * Steps the time-varying lateral gains, whatever the zone, then runs the state machine.
+   * @param input The command inputs to the controller such as course and airspeed.
+   * @param output The control efforts calculated and selected intermediate values.
+   */
+  void control(const Input & input, Output & output) override;
+
+  /**
+   * This function continually loops while the aircraft is in the take-off zone. The lateral and longitudinal control
+   * for the take-off zone is called in this function.
+   * @param input The command inputs to the controller such as course and airspeed.
+   * @param output The control efforts calculated and selected intermediate values.
+   */
+  virtual void take_off(const Input & input, Output & output);
+
+  /**
+   * This function continually loops while the aircraft is in the climb zone. The lateral and longitudinal control
+   * for the climb zone is called in this function.
+   * @param input The command inputs to the controller such as course and airspeed.
+   * @param output The control efforts calculated and selected intermediate values.
+   */
+  virtual void climb(const Input & input, Output & output);
+
+  /**
+   * This function continually loops while the aircraft is in the altitude hold zone. The lateral and longitudinal
+   * control for the altitude hold zone is called in this function.
+   * @param input The command inputs to the controller such as course and airspeed.
+   * @param output The control efforts calculated and selected intermediate values.
+   */
+  virtual void altitude_hold(const Input & input, Output & output);
+
+  /**
+   * This function runs when the aircraft exits the take-off zone. Any changes to the controller that need to happen
+   * only once as the aircraft exits take-off mode should be placed here. This sets differentiators and integrators to 0.
+   */
+  virtual void take_off_exit();
+
+  /**
+   * This function runs when the aircraft exits the climb zone. Any changes to the controller that need to happen
+   * only once as the aircraft exits climb mode should be placed here. This sets differentiators and integrators to 0.
+   */
+  virtual void climb_exit();
+
+  /**
+   * This function runs when the aircraft exits the altitude hold zone (usually a crash). Any changes to the controller that
+   * need to happen only once as the aircraft exits altitude mode should be placed here. This sets differentiators and
+   * integrators to 0.
+   */
+  virtual void altitude_hold_exit();
+
+  /**
+   * Evaluates the LQR control law with the selected backend, saturates the control efforts and records the latency
+   * of the call.
+   * @param input The command inputs to the controller such as course and airspeed.
+   * @param reference The reference point the state error is taken with respect to.
+   * @param gains The gains and trim inputs for the current zone and flight condition.
+   * @param output The control efforts calculated and selected intermediate values.
+   */
+  void lqr_control(const Input & input, const Reference & reference, const LqrGains & gains,
+                   Output & output);
+
+  /**
+   * Assembles the longitudinal and lateral state errors. The course error is wrapped so the aircraft turns the short
+   * way.
+   * @param input The command inputs to the controller such as course and airspeed.
+   * @param reference The reference point the state error is taken with respect to.
+   * @param x_lon The longitudinal state error (va, theta, q, h).
+   * @param x_lat The lateral state error (phi, chi, p, r).
+   */
+  void state_errors(const Input & input, const Reference & reference, Eigen::Vector4f & x_lon,
+                    Eigen::Vector4f & x_lat);
+
+  /**
+   * The native LQR control law. Computes the control surface deflections and throttle as the trim inputs minus the
+   * gain matrices times the state error, u = u_trim - K (x - x_ref), for the decoupled longitudinal and lateral states.
+   * The integrated altitude and course errors are fed back through the integral gains.
+   * @param input The command inputs to the controller such as course and airspeed.
+   * @param reference The reference point the state error is taken with respect to.
+   * @param gains The gains and trim inputs for the current zone and flight condition.
+   * @param output The control efforts calculated and selected intermediate values.
+   */
+  void native_lqr_control(const Input & input, const Reference & reference, const LqrGains & gains,
+                          Output & output);
+
+  /**
+   * The prediction horizon of the linear MPC, in controller ticks. Fixed at compile time so the QP is sized statically.
+   */
+  static constexpr int MPC_HORIZON = 20;
+
+  /**
+   * Everything the control laws cache from the parameters. A configuration is built off the control loop's thread
+   * whenever parameters change and handed to the control loop with an atomic pointer exchange, so loading files and
+   * setting up backends never delays a tick.
+   */
+  struct Configuration
+  {
+    /**
+     * The fixed LQR gains and trim inputs, used by any zone without a gain schedule.
+     */
+    LqrGains gains;
+
+    /**
+     * Integral gains to (delta_e, delta_t) and (delta_a, delta_r).
+     */
+    KernelMatrix<2, 1> ki_lon;
+    KernelMatrix<2, 1> ki_lat;
+
+    /**
+     * Gain schedules for the take-off, climb and altitude hold zones, indexed by airspeed and altitude.
+     */
+    GainSchedule take_off_schedule;
+    GainSchedule climb_schedule;
+    GainSchedule altitude_hold_schedule;
+
+    /**
+     * Flag that indicates the fixed gains are replaced by gains solved online from the linear model.
+     */
+    bool online_dare;
+
+    /**
+     * Flag that indicates altitude hold tracks path segments with the time-varying lateral gains.
+     */
+    bool lqr_tracking;
+
+    /**
+     * The backend selected by the lqr_backend parameter, or the native backend if it could not be set up.
+     */
+    LqrBackend backend;
+
+    /**
+     * Explicit MPC laws for the longitudinal and lateral states, loaded when the backend is selected.
+     */
+    ExplicitMpc explicit_mpc_lon;
+    ExplicitMpc explicit_mpc_lat;
+
+    /**
+     * Linear MPC problems for the longitudinal and lateral states, set up when the backend is selected. Their warm
+     * start is updated by the control loop.
+     */
+    LinearMpc<4, 2, MPC_HORIZON> linear_mpc_lon;
+    LinearMpc<4, 2, MPC_HORIZON> linear_mpc_lat;
+
+    /**
+     * The next configuration in the retired list.
+     */
+    Configuration * next;
+  };
+
+  /**
+   * Selects the LQR backend from the lqr_backend parameter, starting the embedded interpreter if it is needed.
+   * @param config The configuration to set the backend of, with its gains loaded.
+   */
+  void configure_lqr_backend(Configuration & config);
+
+  /**
+   * Loads the LQR gain matrices and trim inputs from the params_ object into their fixed-size members.
+   * @param config The configuration to load the gains into.
+   */
+  void load_lqr_gains(Configuration & config);
+
+  /**
+   * Loads the gain schedule of each zone from the file named by its parameter. A zone with no file, or a file that
+   * cannot be read, uses the fixed gains.
+   * @param config The configuration to load the schedules into.
+   */
+  void load_gain_schedules(Configuration & config);
+
+  /**
+   * Loads a single zone's gain schedule.
+   * @param param_name The parameter that holds the schedule file name.
+   * @param schedule The schedule to load.
+   */
+  void load_gain_schedule(const std::string & param_name, GainSchedule & schedule);
+
+  /**
+   * Builds an LQR design from the model, weight and trim parameters.
+   * @return The design.
+   */
+  LqrDesign lqr_design();
+
+  /**
+   * Queues a new LQR design on the gain solver from the model, weight and trim parameters, if online DARE solving is
+   * enabled. Starts the gain solver the first time.
+   * @param config The configuration the design is for.
+   */
+  void request_lqr_design(const Configuration & config);
+
+  /**
+   * Sets the design of the time-varying gains on the planner from the model, weight and tracking parameters, if
+   * tracking is enabled. Starts the planner the first time.
+   * @param config The configuration the design is for.
+   */
+  void configure_tvlqr(const Configuration & config);
+
+  /**
+   * Selects the gains for the current flight condition. Interpolates the zone's schedule if it has one, otherwise
+   * returns the gains from the online DARE solver if it is enabled and has a solution, or else the fixed gains.
+   * @param schedule The schedule of the current zone.
+   * @param input The command inputs to the controller such as course and airspeed.
+   * @return The gains to use this tick.
+   */
+  const LqrGains & select_gains(const GainSchedule & schedule, const Input & input);
+
+  /**
+   * Gets the actuator limits, ordered (delta_e, delta_a, delta_r, delta_t).
+   * @param lower The lower limits.
+   * @param upper The upper limits.
+   */
+  void actuator_limits(KernelVector<4> & lower, KernelVector<4> & upper);
+
+  /**
+   * Builds a configuration from the changed parameters and queues it for the control loop.
+   */
+  void prepare_parameters() override;
+
+  /**
+   * Swaps in the newest prepared configuration when parameters are changed.
+   */
+  void parameters_changed() override;
+
+  /**
+   * The configuration the control loop is using. Only touched by the control loop.
+   */
+  Configuration * config_;
+
+  /**
+   * Storage for the gains interpolated from a schedule this tick, so selecting gains does not allocate.
+   */
+  LqrGains scheduled_gains_;
+
+  /**
+   * Integrators of the altitude error for the longitudinal law and the course error for the lateral law. Cleared
+   * whenever the aircraft leaves a zone.
+   */
+  IntegralAugmentation<4, 2, 1> lon_integrator_;
+  IntegralAugmentation<4, 2, 1> lat_integrator_;
+
+  /**
+   * Limits the actuator slew rates of every backend, ordered (delta_e, delta_a, delta_r, delta_t).
+   */
+  RateLimiter<4> rate_limiter_;
+
+  /**
+   * Background DARE solver, created the first time online solving is enabled. Only the control loop reads it, and only
+   * through a configuration published after it was created.
+   */
+  std::unique_ptr<LqrGainSolver> gain_solver_;
+
+  /**
+   * Background planner of the time-varying lateral gains, created the first time tracking is enabled. Only the control
+   * loop reads it, and only through a configuration published after it was created.
+   */
+  std::unique_ptr<TvlqrPlanner> tvlqr_planner_;
+
+  /**
+   * This tick's plan of the time-varying gains, or nullptr if tracking is off or no segment is planned yet.
+   */
+  const TvlqrGainTrajectory * tvlqr_;
+
+  /**
+   * Number of control ticks run, which the plans are indexed by.
+   */
+  uint64_t tvlqr_tick_;
+
+  /**
+   * This tick's step of the time-varying gains, or nullptr if tracking is off, no segment is planned or the horizon
+   * has passed.
+   */
+  const TvlqrGainTrajectory::Step * tvlqr_step_;
+
+  /**
+   * Storage for the gains with this tick's time-varying lateral gain, so tracking does not allocate.
+   */
+  LqrGains tracking_gains_;
+
+  /**
+   * The last path received, to tell when the path manager switches segments.
+   */
+  PathSegment last_path_;
+  bool have_path_;
+
+  /**
+   * The roll angle at the last control tick, where the roll reference of a new segment starts.
+   */
+  float last_phi_;
+
+  /**
+   * Replaces the lateral gain with this tick's time-varying gain when tracking is enabled and a segment is planned, or
+   * with the segment's steady state gain once the horizon has passed.
+   * @param gains The gains for the current zone and flight condition.
+   * @return The gains to use this tick.
+   */
+  const LqrGains & tracking_gains(const LqrGains & gains);
+
+  float sat(float value, float up_limit, float low_limit);
+
+  float adjust_h_c(float h_c, float h, float max_diff);
+
+private:
+  /**
+   * Declares the parameters associated to this controller, controller_successive_loop, with their default values.
+  */
+  void declare_parameters();
+
+  /**
+   * Handles of the parameters read every control tick, so the control loop reads them without a string lookup.
+   */
+  struct TickParams
+  {
+    DoubleParam alt_hz; /**< declared in controller_state_machine */
+    DoubleParam cmd_takeoff_pitch;
+    DoubleParam max_takeoff_throttle;
+    DoubleParam max_e;
+    DoubleParam max_a;
+    DoubleParam max_r;
+    DoubleParam max_t;
+    DoubleParam max_rate_e;
+    DoubleParam max_rate_a;
+    DoubleParam max_rate_r;
+    DoubleParam max_rate_t;
+    IntParam mpc_max_iterations;
+    DoubleParam mpc_budget_fraction;
+  };
+  TickParams tick_params_;
+
+  /**
+   * The backend currently used to evaluate the control law. The configured backend, unless it is the service backend
+   * and no service is attached.
+   */
+  LqrBackend lqr_backend_;
+
+  /**
+   * The newest configuration prepared and not yet picked up by the control loop.
+   */
+  std::atomic<Configuration *> config_ready_;
+
+  /**
+   * Configurations the control loop has replaced, waiting to be freed by the next prepare_parameters.
+   */
+  std::atomic<Configuration *> config_retired_;
+
+  /**
+   * Frees the configurations the control loop has replaced.
+   */
+  void free_retired_configurations();
+
+  /**
+   * The law evaluated by the service backend, or nullptr if none is attached.
+   */
+  Service * service_;
+
+  /**
+   * Flag that indicates the negative saturation limit warning was logged, so it is only logged once.
+   */
+  bool sat_warned_;
+
+#ifdef ROSPLANE_LQR_EMBEDDED_PYTHON
+  /**
+   * The embedded interpreter running the Python control law. Created the first time the backend is selected and kept
+   * for the life of the controller, since the interpreter cannot be restarted. Only the control loop evaluates it, and
+   * only through a configuration published after it was created.
+   */
+  std::unique_ptr<EmbeddedPythonLqr> python_lqr_;
+
+  /**
+   * The time the last Python failure was logged, so failures are logged at most once a second.
+   */
+  std::chrono::steady_clock::time_point python_error_time_;
+
+  /**
+   * Evaluates the control law with the embedded Python function.
+   * @param input The command inputs to the controller such as course and airspeed.
+   * @param reference The reference point the state error is taken with respect to.
+   * @param output The control efforts calculated and selected intermediate values.
+   * @return True if the Python function succeeded and the output is valid.
+   */
+  bool python_lqr_control(const Input & input, const Reference & reference, Output & output);
+#endif
+
+  /**
+   * Evaluates the explicit MPC laws, u = u_trim + F x + g, with x the state error.
+   * @param input The command inputs to the controller such as course and airspeed.
+   * @param reference The reference point the state error is taken with respect to.
+   * @param gains The gains and trim inputs for the current zone and flight condition. Only the trim is used.
+   * @param output The control efforts calculated and selected intermediate values.
+   */
+  void explicit_mpc_control(const Input & input, const Reference & reference,
+                            const LqrGains & gains, Output & output);
+
+  /**
+   * Loads the explicit MPC trees named by the explicit_mpc_lon_file and explicit_mpc_lat_file parameters.
+   * @param config The configuration to load the trees into.
+   * @return True if both trees were loaded.
+   */
+  bool load_explicit_mpc(Configuration & config);
+
+  /**
+   * The linear MPC solve of the last tick, and whether it has been taken yet.
+   */
+  MpcSolveSummary mpc_summary_;
+  bool mpc_summary_ready_;
+
+  /**
+   * Solves the linear MPC problems for the current state error and applies the first input of each, u = u_trim + u0.
+   * The solves share a budget of mpc_budget_fraction of the controller period and are capped at mpc_max_iterations.
+   * @param input The command inputs to the controller such as course and airspeed.
+   * @param reference The reference point the state error is taken with respect to.
+   * @param gains The gains and trim inputs for the current zone and flight condition. Only the trim is used.
+   * @param output The control efforts calculated and selected intermediate values.
+   */
+  void linear_mpc_control(const Input & input, const Reference & reference, const LqrGains & gains,
+                          Output & output);
+
+  /**
+   * Condenses the linear MPC problems from the model, weight, trim and limit parameters.
+   * @param config The configuration to set the problems up in.
+   * @return True if both problems were set up.
+   */
+  bool setup_linear_mpc(Configuration & config);
+
+  /**
+   * Number of control law calls since the controller was constructed.
+   */
+  uint64_t lqr_calls_;
+
+  /**
+   * Number of calls, summed latency and maximum latency in the current reporting window (us).
+   */
+  uint64_t lqr_window_calls_;
+  double lqr_window_sum_us_;
+  double lqr_window_max_us_;
+
+  /**
+   * Latency of the most recent control law call (us).
+   */
+  double lqr_last_call_us_;
+
+  /**
+   * Records the latency of a control law call that started at the given time.
+   * @param start The time the call started.
+   */
+  void record_lqr_call(std::chrono::steady_clock::time_point start);
+};
+} // namespace rosplane
+
+#endif // LQR_CONTROLLER_H
@@ -0,0 +1,130 @@
+/**
+ * @file lqr_gain_solver.hpp
+ *
+ * Background worker that recomputes the LQR gains from the linear model and weights whenever they change, and hands
+ * the result to the control loop without ever blocking it.
+ */
+
+#ifndef LQR_GAIN_SOLVER_H
+#define LQR_GAIN_SOLVER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "dare_solver.hpp"
+#include "linear_model.hpp"
+#include "lqr_gains.hpp"
+
+namespace rosplane
+{
+
+/**
+ * Everything needed to design the LQR gains.
+ */
+struct LqrDesign
+{
+  LinearModelCoefficients coefficients; /**< linear model coefficients at trim */
+  double Ts;                            /**< controller sample time (s) */
+  Eigen::Vector4d q_lon;                /**< diagonal state weights for (va, theta, q, h) */
+  Eigen::Vector2d r_lon;                /**< diagonal input weights for (delta_e, delta_t) */
+  Eigen::Vector4d q_lat;                /**< diagonal state weights for (phi, chi, p, r) */
+  Eigen::Vector2d r_lat;                /**< diagonal input weights for (delta_a, delta_r) */
+  Eigen::Vector4f u_trim;               /**< trim inputs, ordered (delta_e, delta_a, delta_r, delta_t) */
+};
+
+/**
+ * Runs the DARE on a low priority thread. Designs are queued with request, and only the newest queued design is
+ * solved. Each solve is warm started from the previous solution. Solved gains are published with an atomic pointer
+ * exchange and picked up by the control loop through latest, which never locks or allocates.
+ */
+class LqrGainSolver
+{
+public:
+  /**
+   * Starts the worker thread.
+   */
+  LqrGainSolver();
+
+  /**
+   * Stops the worker thread and frees every published gain block.
+   */
+  ~LqrGainSolver();
+
+  LqrGainSolver(const LqrGainSolver &) = delete;
+  LqrGainSolver & operator=(const LqrGainSolver &) = delete;
+
+  /**
+   * Queues a design to be solved, replacing any design that has not been started yet. Must not be called from the
+   * control loop.
+   * @param design The design to solve.
+   */
+  void request(const LqrDesign & design);
+
+  /**
+   * Gets the newest solved gains. Must only be called from the control loop. Lock and allocation free.
+   * @return The newest gains, or nullptr if no design has been solved yet. Valid until the next call.
+   */
+  const LqrGains * latest();
+
+private:
+  /**
+   * A published gain block. Blocks the control loop has replaced are chained together until the worker frees them.
+   */
+  struct Block
+  {
+    LqrGains gains;
+    Block * next;
+  };
+
+  /**
+   * The worker thread loop. Waits for a design, solves it and publishes the gains.
+   */
+  void run();
+
+  /**
+   * Solves a design.
+   * @param design The design to solve.
+   * @param gains The solved gains.
+   * @return True if both the longitudinal and lateral DARE converged.
+   */
+  bool solve(const LqrDesign & design, LqrGains & gains);
+
+  /**
+   * Frees the blocks the control loop has replaced.
+   */
+  void free_retired();
+
+  std::thread worker_;
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  LqrDesign design_;
+  bool design_pending_;
+  bool stop_;
+
+  /**
+   * Warm start state of the longitudinal and lateral solvers. Only touched by the worker thread.
+   */
+  DareSolver<4, 2> lon_solver_;
+  DareSolver<4, 2> lat_solver_;
+
+  /**
+   * The newest block published by the worker and not yet picked up by the control loop.
+   */
+  std::atomic<Block *> ready_;
+
+  /**
+   * Blocks the control loop has replaced, waiting to be freed by the worker.
+   */
+  std::atomic<Block *> retired_;
+
+  /**
+   * The block the control loop is using. Only touched by the control loop.
+   */
+  Block * active_;
+};
+
+} // namespace rosplane
+
+#endif // LQR_GAIN_SOLVER_H
@@ -0,0 +1,39 @@
+/**
+ * @file lqr_gains.hpp
+ *
+ * Gain and trim block used by the LQR control law.
+ */
+
+#ifndef LQR_GAINS_H
+#define LQR_GAINS_H
+
+#include <Eigen/Core>
+
+namespace rosplane
+{
+
+/**
+ * The gain matrices and trim inputs of the decoupled longitudinal and lateral LQR. Aligned to 32 bytes so that an
+ * array of blocks keeps every block on a SIMD boundary.
+ */
+struct alignas(32) LqrGains
+{
+  /**
+   * Longitudinal gain matrix. Rows are (delta_e, delta_t), columns are the state errors (va, theta, q, h).
+   */
+  Eigen::Matrix<float, 2, 4> k_lon;
+
+  /**
+   * Lateral gain matrix. Rows are (delta_a, delta_r), columns are the state errors (phi, chi, p, r).
+   */
+  Eigen::Matrix<float, 2, 4> k_lat;
+
+  /**
+   * Trim control inputs, ordered (delta_e, delta_a, delta_r, delta_t).
+   */
+  Eigen::Vector4f u_trim;
+};
+
+} // namespace rosplane
+
+#endif // LQR_GAINS_H
@@ -0,0 +1,181 @@
+/**
+ * @file message_pool.hpp
+ *
+ * Pool of preallocated blocks for the messages the control loop publishes, with an allocator over it for rclcpp
+ * publishers, so handing owned messages to the subscribers does not touch the heap.
+ */
+
+#ifndef MESSAGE_POOL_H
+#define MESSAGE_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace rosplane
+{
+
+/**
+ * Fixed number of blocks of a fixed size, allocated once. Blocks are taken by a single thread, the one publishing
+ * through the pool, and may be given back from any thread, such as the executor of a subscriber releasing a message.
+ * Both are lock free. Since only one thread takes blocks, a block cannot be taken and given back while another take
+ * is reading it, so the free list needs no ABA protection.
+ */
+class MessagePool
+{
+public:
+  /**
+   * @param block_size Size of each block, rounded up to the largest fundamental alignment (bytes).
+   * @param blocks Number of blocks.
+   */
+  MessagePool(std::size_t block_size, std::size_t blocks)
+      : block_size_((block_size + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t)
+                    * sizeof(std::max_align_t))
+      , storage_(new std::max_align_t[block_size_ / sizeof(std::max_align_t) * blocks])
+      , begin_(reinterpret_cast<unsigned char *>(storage_.get()))
+      , end_(begin_ + block_size_ * blocks)
+      , free_(nullptr)
+  {
+    for (unsigned char * block = begin_; block != end_; block += block_size_) {
+      give_back(block);
+    }
+  }
+
+  MessagePool(const MessagePool &) = delete;
+  MessagePool & operator=(const MessagePool &) = delete;
+
+  /**
+   * Takes a block. Only call from the thread publishing through the pool.
+   * @param size Size needed (bytes).
+   * @return The block, or nullptr if the size does not fit in a block or every block is in use.
+   */
+  void * take(std::size_t size)
+  {
+    if (size > block_size_) {
+      return nullptr;
+    }
+
+    Block * block = free_.load(std::memory_order_acquire);
+    while (block != nullptr
+           && !free_.compare_exchange_weak(block, block->next, std::memory_order_acquire,
+                                           std::memory_order_acquire)) {
+    }
+    return block;
+  }
+
+  /**
+   * Gives a block back. May be called from any thread.
+   * @param pointer The block, which must have been taken from this pool.
+   */
+  void give_back(void * pointer)
+  {
+    Block * block = static_cast<Block *>(pointer);
+    block->next = free_.load(std::memory_order_relaxed);
+    while (!free_.compare_exchange_weak(block->next, block, std::memory_order_release,
+                                        std::memory_order_relaxed)) {
+    }
+  }
+
+  /**
+   * @param pointer A pointer to memory from this pool or the heap.
+   * @return True if the memory is a block of this pool.
+   */
+  bool owns(const void * pointer) const
+  {
+    auto address = static_cast<const unsigned char *>(pointer);
+    return address >= begin_ && address < end_;
+  }
+
+private:
+  /**
+   * A free block, linked to the next free block.
+   */
+  struct Block
+  {
+    Block * next;
+  };
+
+  std::size_t block_size_;
+  std::unique_ptr<std::max_align_t[]> storage_;
+  unsigned char * begin_;
+  unsigned char * end_;
+  std::atomic<Block *> free_;
+};
+
+/**
+ * Allocator over a MessagePool, for the publishers created with rclcpp::PublisherOptionsWithAllocator. The messages,
+ * and the shared_ptr blocks rclcpp builds around them for intra-process subscribers, come from the pool. Anything too
+ * large for a block, or allocated while every block is in use, falls back to the heap. Byte allocations go to the heap
+ * too, since rcl allocates its own bookkeeping through them and would otherwise hold blocks for the publisher's
+ * lifetime. A default constructed allocator has no pool and only uses the heap.
+ */
+template<typename T>
+class PoolAllocator
+{
+public:
+  using value_type = T;
+
+  PoolAllocator() = default;
+
+  /**
+   * @param pool The pool to allocate from.
+   */
+  explicit PoolAllocator(std::shared_ptr<MessagePool> pool)
+      : pool_(std::move(pool))
+  {}
+
+  template<typename U>
+  PoolAllocator(const PoolAllocator<U> & other)
+      : pool_(other.pool())
+  {}
+
+  T * allocate(std::size_t n)
+  {
+    static_assert(alignof(T) <= alignof(std::max_align_t), "Pool blocks are not aligned for this type.");
+
+    void * pointer = nullptr;
+    if (pool_ && !std::is_same<T, char>::value) {
+      pointer = pool_->take(n * sizeof(T));
+    }
+    if (pointer == nullptr) {
+      pointer = ::operator new(n * sizeof(T));
+    }
+    return static_cast<T *>(pointer);
+  }
+
+  void deallocate(T * pointer, std::size_t) noexcept
+  {
+    if (pool_ && pool_->owns(pointer)) {
+      pool_->give_back(pointer);
+    } else {
+      ::operator delete(pointer);
+    }
+  }
+
+  /**
+   * @return The pool allocated from, or nullptr if only the heap is used.
+   */
+  const std::shared_ptr<MessagePool> & pool() const { return pool_; }
+
+private:
+  std::shared_ptr<MessagePool> pool_;
+};
+
+template<typename T, typename U>
+bool operator==(const PoolAllocator<T> & a, const PoolAllocator<U> & b)
+{
+  return a.pool() == b.pool();
+}
+
+template<typename T, typename U>
+bool operator!=(const PoolAllocator<T> & a, const PoolAllocator<U> & b)
+{
+  return !(a == b);
+}
+
+} // namespace rosplane
+
+#endif // MESSAGE_POOL_H
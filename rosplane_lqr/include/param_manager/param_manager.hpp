@@ -9,13 +9,23 @@
 #ifndef PARAM_MANAGER_H
 #define PARAM_MANAGER_H
 
-#include <variant>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 #include <rclcpp/rclcpp.hpp>
 
+#include "param_store.hpp"
+
 namespace rosplane
 {
 
+/**
+ * Binds a ParamStore to the ROS2 parameter system. Every parameter of the store is declared with the node, takes its
+ * value from the parameter file, and follows the updates made through ROS.
+ */
 class ParamManager
 {
 public:
@@ -26,83 +36,151 @@ public:
   */
   ParamManager(rclcpp::Node * node);
 
+  /**
+   * Binds the parameters of a store owned elsewhere, for example by the control core, to the node.
+   *
+   * @param node: the ROS2 node that has this parameter object. Used to poll the ROS2 parameters
+   * @param store: the store holding the values. It must outlive the ParamManager
+  */
+  ParamManager(rclcpp::Node * node, ParamStore & store);
+
+  ParamManager(const ParamManager &) = delete;
+  ParamManager & operator=(const ParamManager &) = delete;
+
   /**
    * Helper function to access parameter values of type double stored in param_manager object
    * @return Double value of the parameter
   */
-  double get_double(std::string param_name);
+  double get_double(const std::string & param_name);
 
   /**
    * Helper function to access parameter values of type bool stored in param_manager object
    * @return Bool value of the parameter
   */
-  bool get_bool(std::string param_name);
+  bool get_bool(const std::string & param_name);
 
   /**
    * Helper function to access parameter values of type integer stored in param_manager object
    * @return Integer value of the parameter
   */
-  int64_t get_int(std::string param_name);
+  int64_t get_int(const std::string & param_name);
 
   /**
    * Helper function to access parameter values of type string stored in param_manager object
    * @return String value of the parameter
   */
-  std::string get_string(std::string param_name);
+  std::string get_string(const std::string & param_name);
 
   /**
    * Helper function to declare parameters in the param_manager object
-   * Inserts a parameter into the parameter object and declares it with the ROS system
+   * Records the parameter and its default value. It is declared with the ROS system, and can be read, once commit
+   * is called. Declaring a name again with the same type returns the existing handle.
+   * @return Handle for reading the parameter without a string lookup
   */
-  void declare_double(std::string param_name, double value);
+  DoubleParam declare_double(const std::string & param_name, double value);
 
   /**
    * Helper function to declare parameters in the param_manager object
-   * Inserts a parameter into the parameter object and declares it with the ROS system
+   * Records the parameter and its default value. It is declared with the ROS system, and can be read, once commit
+   * is called. Declaring a name again with the same type returns the existing handle.
+   * @return Handle for reading the parameter without a string lookup
   */
-  void declare_bool(std::string param_name, bool value);
+  BoolParam declare_bool(const std::string & param_name, bool value);
 
   /**
    * Helper function to declare parameters in the param_manager object
-   * Inserts a parameter into the parameter object and declares it with the ROS system
+   * Records the parameter and its default value. It is declared with the ROS system, and can be read, once commit
+   * is called. Declaring a name again with the same type returns the existing handle.
+   * @return Handle for reading the parameter without a string lookup
   */
-  void declare_int(std::string param_name, int64_t value);
+  IntParam declare_int(const std::string & param_name, int64_t value);
 
   /**
    * Helper function to declare parameters in the param_manager object
-   * Inserts a parameter into the parameter object and declares it with the ROS system
+   * Records the parameter and its default value. It is declared with the ROS system, and can be read, once commit
+   * is called. Declaring a name again with the same type returns the existing handle.
+   * @return Handle for reading the parameter without a string lookup
+  */
+  StringParam declare_string(const std::string & param_name, const std::string & value);
+
+  /**
+   * Looks up the handle of a parameter declared elsewhere, for example in a base class. Use it once, outside of any
+   * loop, and keep the handle.
+   * @param param_name Name of the parameter
+   * @return Handle of the parameter
+   * @throws std::runtime_error if the parameter is not declared with type T
+  */
+  template<typename T>
+  ParamHandle<T> handle(const std::string & param_name) const
+  {
+    try {
+      return store_.template handle<T>(param_name);
+    } catch (std::runtime_error & e) {
+      RCLCPP_ERROR_STREAM(container_node_->get_logger(), "ERROR GETTING PARAMETER: " + param_name);
+      throw;
+    }
+  }
+
+  /**
+   * Gets the current parameter snapshot. Loops that read several parameters should get the snapshot once per
+   * iteration and read through it, so a parameter update in the middle of an iteration cannot mix old and new values.
+   * Takes a short lock, so the control loop uses store().control_snapshot() instead.
+   * @return The newest snapshot, which stays valid and unchanged while it is held
+  */
+  std::shared_ptr<const ParamSnapshot> snapshot() const { return store_.snapshot(); }
+
+  /**
+   * Reads a parameter through its handle from the current snapshot.
+   * @return Value of the parameter
   */
-  void declare_string(std::string param_name, std::string value);
+  double get(DoubleParam param) const { return snapshot()->get(param); }
+  bool get(BoolParam param) const { return snapshot()->get(param); }
+  int64_t get(IntParam param) const { return snapshot()->get(param); }
+  std::string get(StringParam param) const { return snapshot()->get(param); }
 
   /**
-   * This sets the parameters with the values in the params_ object from the supplied parameter file, or sets them to
-   * the default if no value is given for a parameter.
+   * Declares every parameter of the store not yet known to ROS with the ROS system, in one pass, and publishes their
+   * values in a single snapshot. Each parameter takes the value from the supplied parameter file, or its default if
+   * no value is given. Classes in a hierarchy only declare, and the class that needs the values commits, so every
+   * declaration of the hierarchy is resolved together. Parameters the store committed on its own are declared with
+   * their current values as defaults.
+   */
+  void commit();
+
+  /**
+   * Same as commit, kept for existing callers.
    */
   void set_parameters();
 
+  /**
+   * @return True while commit is declaring parameters with the ROS system. The parameter callbacks the declarations
+   * trigger carry the initial values, which commit stores itself, so containing nodes can skip reacting to them.
+   */
+  bool committing() const { return committing_; }
+
   /**
    * This function sets a previously declared parameter to a new value in both the parameter object
    * and the ROS system.
    */
-  void set_double(std::string param_name, double value);
+  void set_double(const std::string & param_name, double value);
 
   /**
    * This function sets a previously declared parameter to a new value in both the parameter object
    * and the ROS system.
    */
-  void set_bool(std::string param_name, bool value);
+  void set_bool(const std::string & param_name, bool value);
 
   /**
    * This function sets a previously declared parameter to a new value in both the parameter object
    * and the ROS system.
    */
-  void set_int(std::string param_name, int64_t value);
+  void set_int(const std::string & param_name, int64_t value);
 
   /**
    * This function sets a previously declared parameter to a new value in both the parameter object
    * and the ROS system.
    */
-  void set_string(std::string param_name, std::string value);
+  void set_string(const std::string & param_name, const std::string & value);
 
   /**
    * This function should be called in the parametersCallback function in a containing ROS node.
@@ -113,11 +191,41 @@ public:
   */
   bool set_parameters_callback(const std::vector<rclcpp::Parameter> & parameters);
 
+  /**
+   * @return The store holding the values of the parameters
+  */
+  ParamStore & store() { return store_; }
+
 private:
   /**
-   * Data structure to hold all of the parameters
+   * Sets a parameter in the store, logging the reason if it could not be set
+   * @return True if the parameter was set
+  */
+  bool set(const std::string & param_name, ParamValue value);
+
+  /**
+   * Converts between the values of the store and of the ROS2 parameter system
+   * @return False if the ROS2 parameter has a type the store does not support
+  */
+  static rclcpp::ParameterValue to_ros(const ParamValue & value);
+  static bool from_ros(const rclcpp::ParameterValue & ros_value, ParamValue & value);
+
+  /**
+   * The store of a ParamManager that is not bound to another store
+  */
+  std::unique_ptr<ParamStore> owned_store_;
+
+  /**
+   * The store holding the values of the parameters
   */
-  std::map<std::string, std::variant<double, bool, int64_t, std::string>> params_;
+  ParamStore & store_;
+
+  /**
+   * Number of the store's parameters, in declaration order, that are declared with the ROS system
+  */
+  std::size_t ros_declared_;
+  bool committing_;
+
   rclcpp::Node * container_node_;
 };
 
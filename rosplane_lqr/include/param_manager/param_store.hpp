@@ -0,0 +1,346 @@
+/**
+ * @file param_store.hpp
+ *
+ * Typed parameter storage with immutable snapshots, independent of ROS. The control core keeps its parameters in a
+ * store, and ParamManager binds a store to the ROS2 parameter system.
+*/
+
+#ifndef PARAM_STORE_H
+#define PARAM_STORE_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace rosplane
+{
+
+/**
+ * Typed handle to a declared parameter. It is the parameter's index in the array of values of its type, so a read
+ * through a handle is a single array load with no string lookup. Handles are returned by the declare functions, or
+ * looked up once with ParamStore::handle, and stay valid for the life of the ParamStore and in all of its snapshots.
+ */
+template<typename T>
+struct ParamHandle
+{
+  std::size_t index = 0;
+};
+
+using DoubleParam = ParamHandle<double>;
+using BoolParam = ParamHandle<bool>;
+using IntParam = ParamHandle<int64_t>;
+using StringParam = ParamHandle<std::string>;
+
+/**
+ * The value of a parameter of any of the supported types.
+ */
+using ParamValue = std::variant<double, bool, int64_t, std::string>;
+
+/**
+ * An immutable copy of every parameter value. Updates never change a snapshot, they publish a new one, so a thread that
+ * holds a snapshot sees a consistent set of values for as long as it keeps it, without locking.
+ */
+class ParamSnapshot
+{
+public:
+  /**
+   * Reads a parameter through its handle. This is an array load, cheap enough for the control loop.
+   * @return Value of the parameter
+  */
+  double get(DoubleParam param) const { return doubles_[param.index]; }
+  bool get(BoolParam param) const { return bools_[param.index]; }
+  int64_t get(IntParam param) const { return ints_[param.index]; }
+  const std::string & get(StringParam param) const { return strings_[param.index]; }
+
+  /**
+   * Gets a hash of the values of the parameters, computed when the snapshot was published. Parameters declared after
+   * ParamStore::close_hash are left out. The same values declared in the same order always hash the same, so a log can
+   * tell which parameters a tick ran with.
+   * @return The hash
+  */
+  uint64_t hash() const { return hash_; }
+
+private:
+  friend class ParamStore;
+
+  /**
+   * Values of all of the parameters, one array per type
+  */
+  std::vector<double> doubles_;
+  std::vector<bool> bools_;
+  std::vector<int64_t> ints_;
+  std::vector<std::string> strings_;
+
+  /**
+   * Hash of the values, see hash
+  */
+  uint64_t hash_;
+};
+
+class ParamStore
+{
+public:
+  ParamStore();
+
+  /**
+   * Frees every snapshot published for the control loop.
+   */
+  ~ParamStore();
+
+  ParamStore(const ParamStore &) = delete;
+  ParamStore & operator=(const ParamStore &) = delete;
+
+  /**
+   * Records a parameter and its default value. It can be read once commit is called. Declaring a name again with the
+   * same type returns the existing handle.
+   * @return Handle for reading the parameter without a string lookup
+  */
+  DoubleParam declare_double(const std::string & param_name, double value);
+  BoolParam declare_bool(const std::string & param_name, bool value);
+  IntParam declare_int(const std::string & param_name, int64_t value);
+  StringParam declare_string(const std::string & param_name, const std::string & value);
+
+  /**
+   * Publishes the default values of every parameter declared since the last commit, in a single snapshot.
+   */
+  void commit();
+
+  /**
+   * Looks up the handle of a parameter declared elsewhere, for example in a base class. Use it once, outside of any
+   * loop, and keep the handle.
+   * @param param_name Name of the parameter
+   * @return Handle of the parameter
+   * @throws std::runtime_error if the parameter is not declared with type T
+  */
+  template<typename T>
+  ParamHandle<T> handle(const std::string & param_name) const;
+
+  /**
+   * Gets the current parameter snapshot. Loops that read several parameters should get the snapshot once per
+   * iteration and read through it, so a parameter update in the middle of an iteration cannot mix old and new values.
+   * Takes a short lock and changes the reference count, so the control loop uses control_snapshot instead.
+   * @return The newest snapshot, which stays valid and unchanged while it is held
+  */
+  std::shared_ptr<const ParamSnapshot> snapshot() const;
+
+  /**
+   * Gets the current parameter snapshot for the control loop. Lock and allocation free: updates hand their snapshot
+   * over with an atomic pointer exchange, and the snapshots the control loop replaces are freed by the next update.
+   * Only one thread may call it at a time.
+   * @return The newest snapshot, valid and unchanged until the next call
+  */
+  const ParamSnapshot & control_snapshot();
+
+  /**
+   * Reads a parameter through its handle from the current snapshot.
+   * @return Value of the parameter
+  */
+  double get(DoubleParam param) const { return snapshot()->get(param); }
+  bool get(BoolParam param) const { return snapshot()->get(param); }
+  int64_t get(IntParam param) const { return snapshot()->get(param); }
+  std::string get(StringParam param) const { return snapshot()->get(param); }
+
+  /**
+   * Reads a parameter by name. A parameter read before it is committed is committed first, so it has a value.
+   * @return Value of the parameter
+   * @throws std::runtime_error if the parameter is not declared with the requested type
+  */
+  double get_double(const std::string & param_name);
+  bool get_bool(const std::string & param_name);
+  int64_t get_int(const std::string & param_name);
+  std::string get_string(const std::string & param_name);
+
+  /**
+   * Gets the value of a committed parameter, whatever its type.
+   * @param param_name Name of the parameter
+   * @param param_value Set to the value of the parameter
+   * @return False if the parameter is not committed
+  */
+  bool value(const std::string & param_name, ParamValue & param_value) const;
+
+  /**
+   * @return The names of the committed parameters, in the order they were declared
+  */
+  std::vector<std::string> names() const;
+
+  /**
+   * @return The number of committed parameters, so a caller can tell whether names has anything new without copying it
+  */
+  std::size_t committed_count() const { return committed_.size(); }
+
+  /**
+   * Leaves the parameters declared from now on out of the snapshot hash. An adapter that declares its own parameters
+   * in the store of a control law calls this first, so the hash only covers the values of the control law.
+  */
+  void close_hash();
+
+  /**
+   * Sets parameters to new values, all in one new snapshot. A parameter keeps the type it was declared with.
+   * @param values The names and new values of the parameters
+   * @param error Set to the reason if the values were not set
+   * @return False, with no value changed, if a parameter is not declared or a value has the wrong type
+  */
+  bool set(const std::vector<std::pair<std::string, ParamValue>> & values, std::string & error);
+
+private:
+  /**
+   * Types of the parameters, in the order of the alternatives of ParamValue
+  */
+  enum class ParamType
+  {
+    DOUBLE,
+    BOOL,
+    INT,
+    STRING
+  };
+
+  /**
+   * Where a parameter's value is stored
+  */
+  struct ParamSlot
+  {
+    ParamType type;
+    std::size_t index;
+  };
+
+  /**
+   * Finds a parameter by name and checks its type
+   * @return Slot of the parameter, or nullptr if it is not declared with the given type
+  */
+  const ParamSlot * find(const std::string & param_name, ParamType type) const;
+
+  /**
+   * A declaration recorded by the declare functions and not yet committed
+  */
+  struct PendingDeclaration
+  {
+    std::string name;
+    ParamSlot slot;
+    ParamValue default_value;
+  };
+
+  /**
+   * Records a declaration, assigning it the next slot of its type
+   * @return Index of the parameter's slot
+  */
+  std::size_t declare(const std::string & param_name, ParamValue default_value);
+
+  /**
+   * @return True if a snapshot has a value in the slot of a parameter, which is once the parameter is committed
+  */
+  static bool holds(const ParamSnapshot & values, const ParamSlot & slot);
+
+  /**
+   * Stores a value in the slot of a parameter. The value must have the type of the slot.
+  */
+  static void store(ParamSnapshot & values, const ParamSlot & slot, const ParamValue & value);
+
+  /**
+   * Copies the current snapshot, applies a change to the copy and publishes it. Updates are serialized with each other,
+   * but never with the control loop.
+   * @param change Function that modifies the copy, returning false to discard it
+   * @return The result of change
+  */
+  template<typename Change>
+  bool update(Change && change)
+  {
+    std::lock_guard<std::mutex> lock(update_mutex_);
+    auto next = std::make_shared<ParamSnapshot>(*snapshot_);
+    if (!change(*next)) {
+      return false;
+    }
+    next->hash_ = hash(*next);
+    publish(std::move(next));
+    return true;
+  }
+
+  /**
+   * Hashes the values of a snapshot, up to the counts in hashed_counts_, with 64 bit FNV-1a.
+   * @return The hash
+  */
+  uint64_t hash(const ParamSnapshot & values) const;
+
+  /**
+   * Makes a snapshot the current one, for snapshot and for the control loop. Only called with update_mutex_ held.
+   * @param next The new snapshot
+  */
+  void publish(std::shared_ptr<const ParamSnapshot> next);
+
+  /**
+   * A snapshot handed to the control loop. Blocks the control loop has replaced are chained together until the next
+   * update frees them, so the control loop never releases a snapshot itself.
+  */
+  struct ControlBlock
+  {
+    std::shared_ptr<const ParamSnapshot> snapshot;
+    ControlBlock * next;
+  };
+
+  /**
+   * Frees the blocks the control loop has replaced.
+  */
+  void free_retired();
+
+  /**
+   * Index from parameter name to the parameter's slot, only used at declaration and by the string API. Parameters are
+   * only declared while the owner is constructed, so it does not change once callbacks are running.
+  */
+  std::map<std::string, ParamSlot> slots_;
+
+  /**
+   * Names of the committed parameters, in declaration order
+  */
+  std::vector<std::string> committed_;
+
+  /**
+   * Declarations waiting for commit, and the number of slots of each type including them
+  */
+  std::vector<PendingDeclaration> pending_;
+  std::array<std::size_t, 4> declared_counts_;
+
+  /**
+   * The number of slots of each type covered by the snapshot hash, all of them until close_hash is called
+  */
+  std::array<std::size_t, 4> hashed_counts_;
+
+  /**
+   * The current values of all of the parameters. Only replaced by publish, with both mutexes held.
+  */
+  std::shared_ptr<const ParamSnapshot> snapshot_;
+
+  /**
+   * Serializes updates, so concurrent updates cannot lose each other's changes
+  */
+  std::mutex update_mutex_;
+
+  /**
+   * Guards snapshot_ for the readers of snapshot, so a reader never waits on a whole update
+  */
+  mutable std::mutex snapshot_mutex_;
+
+  /**
+   * The newest block published for the control loop and not yet picked up by it
+  */
+  std::atomic<ControlBlock *> control_ready_;
+
+  /**
+   * Blocks the control loop has replaced, waiting to be freed by the next update
+  */
+  std::atomic<ControlBlock *> control_retired_;
+
+  /**
+   * The block the control loop is using. Only touched by the control loop.
+  */
+  ControlBlock * control_active_;
+};
+
+} // namespace rosplane
+#endif // PARAM_STORE_H
@@ -0,0 +1,106 @@
+/**
+ * @file pipeline_latency.hpp
+ *
+ * Delay of each stage of the sensor to actuator pipeline, IMU sample to state estimate to control tick to actuator
+ * command, measured from message timestamps.
+ */
+
+#ifndef PIPELINE_LATENCY_H
+#define PIPELINE_LATENCY_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "latency_histogram.hpp"
+#include "seqlock.hpp"
+
+namespace rosplane
+{
+
+/**
+ * ROS time stamps of one pass through the pipeline (ns). Zero marks a stamp that is not known.
+ */
+struct PipelineStamps
+{
+  int64_t sensor_ns;         /**< stamp of the IMU sample the state was estimated from */
+  int64_t state_ns;          /**< stamp of the state estimate */
+  int64_t state_received_ns; /**< when the controller received the state */
+  int64_t tick_ns;           /**< start of the control tick that used the state */
+  int64_t command_ns;        /**< stamp of the published command */
+};
+
+/**
+ * Stages of the pipeline, each the delay between two of the stamps.
+ */
+enum PipelineStage : std::size_t
+{
+  ESTIMATION,      /**< sensor to state estimate */
+  STATE_TRANSPORT, /**< state estimate to its arrival at the controller */
+  STATE_QUEUE,     /**< state arrival to the start of the control tick that used it */
+  CONTROL,         /**< start of the control tick to the command */
+  END_TO_END,      /**< sensor to the command */
+  PIPELINE_STAGES
+};
+
+/**
+ * Percentiles of the stage delays over one summary window.
+ */
+struct PipelineLatencySummary
+{
+  /**
+   * Percentiles of one stage, accurate to the histogram buckets (us).
+   */
+  struct Stage
+  {
+    double p50_us;
+    double p99_us;
+    double max_us;
+  };
+
+  uint64_t samples;                           /**< passes recorded */
+  uint64_t invalid;                           /**< negative delays discarded, from unsynchronized clocks */
+  std::array<Stage, PIPELINE_STAGES> stages; /**< indexed by PipelineStage */
+};
+
+/**
+ * Records the stage delays of each pass through the pipeline into latency histograms, and summarizes them into rolling
+ * percentiles. Recording and summarizing need a single writer thread, the summary can be read from any thread.
+ */
+class PipelineLatency
+{
+public:
+  PipelineLatency();
+
+  /**
+   * Records the stage delays of one pass. Stages missing a stamp are skipped. Constant time and allocation free.
+   * @param stamps The stamps of the pass.
+   */
+  void record(const PipelineStamps & stamps);
+
+  /**
+   * Publishes the percentiles of the passes recorded since the last summary to summary(), and starts a new window.
+   */
+  void summarize();
+
+  /**
+   * Gets the latest summary. Lock free.
+   * @return The percentiles of the last summarized window.
+   */
+  PipelineLatencySummary summary() const { return summary_.load(); }
+
+private:
+  /**
+   * Records the delay between two stamps into a stage's histogram.
+   */
+  void record_stage(PipelineStage stage, int64_t from_ns, int64_t to_ns);
+
+  std::array<LatencyHistogram<24>, PIPELINE_STAGES> histograms_;
+  uint64_t samples_;
+  uint64_t invalid_;
+  Seqlock<PipelineLatencySummary> summary_;
+};
+
+} // namespace rosplane
+
+#endif // PIPELINE_LATENCY_H
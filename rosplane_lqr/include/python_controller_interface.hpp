@@ -1,82 +1,223 @@
 #ifndef CONTROLLER_PYTHON_H
 #define CONTROLLER_PYTHON_H
 
-#include "controller_state_machine.hpp"
+#include <array>
+#include <chrono>
+#include <memory>
+
+#include <Eigen/Core>
+
+#include "controller_base.hpp"
+#include "latency_histogram.hpp"
+#include "lqr_controller.hpp"
+#include <lqr_srvs/msg/lqr_call_stats.hpp>
+#include <lqr_srvs/msg/lqr_service_stats.hpp>
+#include <lqr_srvs/msg/mpc_solver_stats.hpp>
 #include <lqr_srvs/srv/lqr_control.hpp>
+#include <rosplane_msgs/msg/current_path.hpp>
 
 namespace rosplane
 {
 
-class PythonControllerInterface : public ControllerStateMachine
+/**
+ * The lqr_controller node. Runs an LqrController from the ROS2 topics, and provides the control law of its service
+ * backend by calling the lqr_controller_update service.
+ */
+class PythonControllerInterface : public ControllerBase, private LqrController::Service
 {
 public:
   /**
    * Constructor to initialize node.
+   * @param options Node options, passed in by a component container.
    */
-  PythonControllerInterface();
+  explicit PythonControllerInterface(const rclcpp::NodeOptions & options = rclcpp::NodeOptions());
 
 protected:
+  using Reference = LqrController::Reference;
+
   /**
-   * This function continually loops while the aircraft is in the take-off zone. The lateral and longitudinal control
-   * for the take-off zone is called in this function.
-   * @param input The command inputs to the controller such as course and airspeed.
-   * @param output The control efforts calculated and selected intermediate values.
+   * The control law run by the node, owned by ControllerBase.
    */
-  virtual void take_off(const Input & input, Output & output);
+  LqrController & lqr_;
 
   /**
-   * This function continually loops while the aircraft is in the climb zone. The lateral and longitudinal control
-   * for the climb zone is called in this function.
-   * @param input The command inputs to the controller such as course and airspeed.
-   * @param output The control efforts calculated and selected intermediate values.
+   * Publishes the linear MPC solve of this tick, if there was one, and summarizes the call latency and service
+   * pipeline about once a second.
+   */
+  void after_control() override;
+
+private:
+  /**
+   * Handles of the service parameters read every control tick, so the control loop reads them without a string lookup.
+   */
+  struct ServiceParams
+  {
+    DoubleParam lqr_service_deadline;
+    DoubleParam lqr_service_hold_tau;
+    DoubleParam lqr_service_drop_timeout;
+  };
+  ServiceParams service_params_;
+
+  /**
+   * Declares the parameters of the service backend, so that ROS2 can see them.
+   */
+  void declare_parameters();
+
+  /**
+   * Subscription to the path manager's current path segment.
+   */
+  rclcpp::Subscription<rosplane_msgs::msg::CurrentPath>::SharedPtr current_path_sub_;
+
+  /**
+   * Passes the path manager's current path segment to the control law.
+   * @param msg The current path segment.
+   */
+  void current_path_callback(const rosplane_msgs::msg::CurrentPath::ConstSharedPtr msg);
+
+  /**
+  * The client for the lqr_controller.
+  */
+  rclcpp::Client<lqr_srvs::srv::LqrControl>::SharedPtr lqr_controller_client;
+
+  /**
+   * The request sent to the lqr_controller, refilled every tick.
    */
-  virtual void climb(const Input & input, Output & output);
+  std::shared_ptr<lqr_srvs::srv::LqrControl::Request> service_request_;
 
   /**
-   * This function continually loops while the aircraft is in the altitude hold zone. The lateral and longitudinal 
-   * control for the altitude hold zone is called in this function.
+   * This publisher publishes the solve time and iteration count of every linear MPC tick.
+   */
+  LoanedPublisher<lqr_srvs::msg::MpcSolverStats> mpc_solver_stats_pub_;
+
+  /**
+   * Sends this tick's request to the lqr_controller_update service without waiting for it, and applies the newest
+   * response that met the deadline. If no fresh response is available the last valid command is held, decaying
+   * towards trim, and after the drop timeout the native law takes over.
    * @param input The command inputs to the controller such as course and airspeed.
+   * @param reference The reference point the state error is taken with respect to.
+   * @param gains The gains and trim inputs for the current zone and flight condition.
    * @param output The control efforts calculated and selected intermediate values.
+   * @return True if a service command was applied to the output.
+   */
+  bool evaluate(const Input & input, const Reference & reference, const LqrGains & gains,
+                Output & output) override;
+
+  /**
+   * Forgets the last service command when the service backend is selected.
+   */
+  void selected() override;
+
+  /**
+   * Handles a response from the lqr_controller_update service. Runs on the executor, never in the control tick.
+   * @param seq The sequence number of the request this response answers.
+   * @param sent The time the request was sent.
+   * @param future The completed future holding the response.
    */
-  virtual void altitude_hold(const Input & input, Output & output);
+  void service_response_callback(uint64_t seq, std::chrono::steady_clock::time_point sent,
+                                 rclcpp::Client<lqr_srvs::srv::LqrControl>::SharedFuture future);
 
   /**
-   * This function runs when the aircraft exits the take-off zone. Any changes to the controller that need to happen
-   * only once as the aircraft exits take-off mode should be placed here. This sets differentiators and integrators to 0.
+   * Sequence number of the next request sent to the service.
    */
-  virtual void take_off_exit();
+  uint64_t service_seq_;
 
   /**
-   * This function runs when the aircraft exits the climb zone. Any changes to the controller that need to happen
-   * only once as the aircraft exits climb mode should be placed here. This sets differentiators and integrators to 0.
+   * Sequence number of the newest response that was accepted.
    */
-  virtual void climb_exit();
+  uint64_t service_accepted_seq_;
 
   /**
-   * This function runs when the aircraft exits the altitude hold zone (usually a crash). Any changes to the controller that 
-   * need to happen only once as the aircraft exits altitude mode should be placed here. This sets differentiators and
-   * integrators to 0.
+   * Flag that indicates a response has been accepted since the service backend was selected.
    */
-  virtual void altitude_hold_exit();
+  bool service_command_valid_;
 
-  void lqr_control(const Input & input, Output & output);
+  /**
+   * The last accepted service command, ordered (delta_e, delta_a, delta_r, delta_t).
+   */
+  Eigen::Vector4f service_u_;
 
-  float sat(float value, float up_limit, float low_limit);
+  /**
+   * The time the request answered by the last accepted command was sent.
+   */
+  std::chrono::steady_clock::time_point service_command_time_;
 
-  float adjust_h_c(float h_c, float h, float max_diff);
+  /**
+   * Counters of the service pipeline over the current reporting window.
+   */
+  uint64_t service_sent_;
+  uint64_t service_received_;
+  uint64_t service_late_;
+  uint64_t service_stale_;
+  uint64_t service_dropped_;
+  uint64_t service_fallback_ticks_;
 
-private:
   /**
-   * Declares the parameters associated to this controller, controller_successive_loop, so that ROS2 can see them.
-   * Also declares default values before they are set to the values set in the launch script.
-  */
-  void declare_parameters();
+   * Round trip times of the service responses over the current reporting window.
+   */
+  LatencyHistogram<24> service_rtt_hist_;
 
   /**
-  * The client for the lqr_controller.
-  */
-  rclcpp::Client<lqr_srvs::srv::LqrControl>::SharedPtr lqr_controller_client;
-  
+   * This publisher publishes the health of the service pipeline.
+   */
+  rclcpp::Publisher<lqr_srvs::msg::LqrServiceStats>::SharedPtr lqr_service_stats_pub_;
+
+  /**
+   * This publisher publishes the latency of the control law calls, to compare the backends.
+   */
+  rclcpp::Publisher<lqr_srvs::msg::LqrCallStats>::SharedPtr lqr_call_stats_pub_;
+
+  /**
+   * Summary of the control law calls and the service pipeline over the last reporting window, about a second.
+   */
+  struct LqrStatsSummary
+  {
+    uint64_t window;                     /**< sequence number of the window */
+    LqrController::CallSummary call;     /**< latency of the control law calls */
+    LqrBackend backend;                  /**< backend at the end of the window */
+    uint64_t sent;                       /**< service requests sent */
+    uint64_t received;                   /**< service responses received */
+    uint64_t late;                       /**< responses that missed the deadline */
+    uint64_t stale;                      /**< responses older than the command in use */
+    uint64_t dropped;                    /**< requests forgotten without a response */
+    uint64_t fallback_ticks;             /**< ticks that held a command past the deadline */
+    double rtt_p50_us;                   /**< median round trip time */
+    double rtt_p99_us;                   /**< 99th percentile round trip time */
+    double rtt_max_us;                   /**< largest round trip time */
+    std::array<uint64_t, 24> rtt_counts; /**< responses in each round trip time bucket */
+  };
+
+  /**
+   * Start and sequence number of the current reporting window, kept by the control loop.
+   */
+  std::chrono::steady_clock::time_point lqr_stats_window_start_;
+  uint64_t lqr_stats_window_;
+
+  /**
+   * The last reporting window, handed from the control loop to lqr_call_stats_timer_ through a seqlock.
+   */
+  Seqlock<LqrStatsSummary> lqr_stats_summary_;
+
+  /**
+   * Window of the last published statistics, so each window is published once.
+   */
+  uint64_t published_lqr_stats_window_;
+
+  /**
+   * This timer publishes the call latency and service pipeline statistics. It is in the node's default callback
+   * group, so building the messages stays off the control loop's thread.
+   */
+  rclcpp::TimerBase::SharedPtr lqr_call_stats_timer_;
+
+  /**
+   * Summarizes the call latency and service pipeline counters into lqr_stats_summary_ once a second has passed, and
+   * starts a new window. Runs on the control loop's thread.
+   */
+  void summarize_lqr_stats();
+
+  /**
+   * Publishes the call latency and service pipeline statistics of the last window, if they are not published yet.
+   */
+  void publish_lqr_call_stats();
 };
 } // namespace rosplane
 
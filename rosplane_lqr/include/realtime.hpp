@@ -0,0 +1,64 @@
+/**
+ * @file realtime.hpp
+ *
+ * Helpers for running the control loop on a real-time thread on Linux, preferably with a PREEMPT_RT kernel.
+ */
+
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <cstddef>
+#include <string>
+
+namespace rosplane
+{
+
+/**
+ * Scheduling settings of the real-time control thread.
+ */
+struct RealtimeProfile
+{
+  int priority;     /**< SCHED_FIFO priority, 1 to 99 */
+  int cpu;          /**< CPU the thread is pinned to, or -1 to let it run on any CPU */
+  bool lock_memory; /**< lock all current and future pages of the process into RAM */
+};
+
+/**
+ * Locks all current and future pages of the process into RAM, so the control loop never waits on a page fault.
+ * Needs CAP_IPC_LOCK or a large enough memlock limit.
+ * @param error Set to the reason on failure.
+ * @return True on success.
+ */
+bool lock_process_memory(std::string & error);
+
+/**
+ * Gives the calling thread the SCHED_FIFO policy at the given priority and pins it to a CPU. Needs CAP_SYS_NICE or
+ * a large enough rtprio limit.
+ * @param profile The priority and CPU to use.
+ * @param error Set to the reason on failure.
+ * @return True if both settings were applied.
+ */
+bool make_thread_realtime(const RealtimeProfile & profile, std::string & error);
+
+/**
+ * Records that this process spins the real-time callback group of the controller on a dedicated thread, as the
+ * lqr_controller executable does. Call before the controller is constructed. Without it, for example in a component
+ * container, the controller ignores realtime_control, since nothing else would spin its control loop.
+ */
+void provide_realtime_executor();
+
+/**
+ * @return True if provide_realtime_executor has been called in this process.
+ */
+bool realtime_executor_provided();
+
+/**
+ * Touches the given amount of the calling thread's stack, so its pages are mapped (and, with locked memory, stay
+ * mapped) before the control loop starts.
+ * @param bytes Amount of stack to touch.
+ */
+void prefault_stack(std::size_t bytes);
+
+} // namespace rosplane
+
+#endif // REALTIME_H
@@ -0,0 +1,94 @@
+/**
+ * @file seqlock.hpp
+ *
+ * Sequence lock for handing small, trivially copyable snapshots from one writer thread to readers on other threads
+ * without a mutex.
+ */
+
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace rosplane
+{
+
+/**
+ * Holds a value of type T that one thread writes and any number of threads read. The writer never waits. A reader
+ * retries if a write overlapped its copy, so it always gets a complete, consistent value. The value is stored as
+ * relaxed atomic words, so a reader racing a writer is well defined.
+ *
+ * Writes must not overlap each other, so each seqlock needs a single writer, or writers that are serialized, such as
+ * callbacks in one mutually exclusive callback group.
+ */
+template<typename T>
+class Seqlock
+{
+  static_assert(std::is_trivially_copyable<T>::value, "Seqlock values must be trivially copyable.");
+
+public:
+  Seqlock()
+      : sequence_(0)
+  {
+    store(T{});
+  }
+
+  /**
+   * Publishes a new value. Wait free.
+   * @param value The value to publish.
+   */
+  void store(const T & value)
+  {
+    std::array<uint32_t, WORDS> words{};
+    std::memcpy(words.data(), &value, sizeof(T));
+
+    // An odd sequence marks a write in progress.
+    uint32_t sequence = sequence_.load(std::memory_order_relaxed);
+    sequence_.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for (std::size_t i = 0; i < WORDS; i++) {
+      words_[i].store(words[i], std::memory_order_relaxed);
+    }
+
+    sequence_.store(sequence + 2, std::memory_order_release);
+  }
+
+  /**
+   * Reads the newest complete value. Lock free, retries only while a write overlaps the read.
+   * @return The value.
+   */
+  T load() const
+  {
+    std::array<uint32_t, WORDS> words;
+    uint32_t before;
+    uint32_t after;
+
+    do {
+      before = sequence_.load(std::memory_order_acquire);
+      for (std::size_t i = 0; i < WORDS; i++) {
+        words[i] = words_[i].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      after = sequence_.load(std::memory_order_relaxed);
+    } while ((before & 1) != 0 || before != after);
+
+    T value;
+    std::memcpy(&value, words.data(), sizeof(T));
+    return value;
+  }
+
+private:
+  static constexpr std::size_t WORDS = (sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+
+  std::atomic<uint32_t> sequence_;
+  std::array<std::atomic<uint32_t>, WORDS> words_;
+};
+
+} // namespace rosplane
+
+#endif // SEQLOCK_H
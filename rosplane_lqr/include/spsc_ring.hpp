@@ -0,0 +1,78 @@
+/**
+ * @file spsc_ring.hpp
+ *
+ * Bounded single producer, single consumer ring buffer for handing fixed size records from the control loop to a
+ * background thread without locking.
+ */
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+
+namespace rosplane
+{
+
+/**
+ * Ring of N values of type T with one producer thread and one consumer thread. Both sides are wait free: push fails
+ * instead of waiting when the ring is full, and pop fails when it is empty. The head and tail are kept on separate
+ * cache lines, so the two threads do not contend on them.
+ */
+template<typename T, std::size_t N>
+class SpscRing
+{
+  static_assert(std::is_trivially_copyable<T>::value, "Ring values must be trivially copyable.");
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "The ring size must be a power of two.");
+
+public:
+  SpscRing()
+      : head_(0)
+      , tail_(0)
+  {}
+
+  /**
+   * Adds a value. Only call from the producer thread.
+   * @param value The value to add.
+   * @return False if the ring was full and the value was dropped.
+   */
+  bool push(const T & value)
+  {
+    std::size_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) == N) {
+      return false;
+    }
+
+    values_[head & (N - 1)] = value;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * Takes the oldest value. Only call from the consumer thread.
+   * @param value Set to the oldest value.
+   * @return False if the ring was empty.
+   */
+  bool pop(T & value)
+  {
+    std::size_t tail = tail_.load(std::memory_order_relaxed);
+    if (head_.load(std::memory_order_acquire) == tail) {
+      return false;
+    }
+
+    value = values_[tail & (N - 1)];
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  alignas(64) std::atomic<std::size_t> head_;
+  alignas(64) std::atomic<std::size_t> tail_;
+  alignas(64) std::array<T, N> values_;
+};
+
+} // namespace rosplane
+
+#endif // SPSC_RING_H
@@ -0,0 +1,39 @@
+/**
+ * @file tick_record.hpp
+ *
+ * The record of one control tick in the flight recorder log, shared by the controller node that writes the log and the
+ * tools that read it.
+ */
+
+#ifndef TICK_RECORD_H
+#define TICK_RECORD_H
+
+#include <cstdint>
+#include <vector>
+
+#include "controller_core.hpp"
+#include "flight_recorder.hpp"
+
+namespace rosplane
+{
+
+/**
+ * One control tick as logged by the flight recorder, the inputs and outputs of the control law.
+ */
+struct TickRecord
+{
+  int64_t tick_ns;               /**< ROS time of the tick (ns) */
+  uint64_t param_hash;           /**< hash of the control law parameters, see ParamSnapshot */
+  ControllerCore::Input input;   /**< inputs of the control law */
+  ControllerCore::Output output; /**< outputs of the control law, before the conversion to pwm */
+};
+
+/**
+ * Describes the fields of TickRecord for the flight recorder log.
+ * @return The fields, in record order.
+ */
+std::vector<RecordField> tick_record_schema();
+
+} // namespace rosplane
+
+#endif // TICK_RECORD_H
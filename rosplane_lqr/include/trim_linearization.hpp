@@ -0,0 +1,93 @@
+/**
+ * @file trim_linearization.hpp
+ *
+ * Numerical trim and linearization of the nonlinear aircraft model. The trim is found with a Levenberg-Marquardt
+ * solve, and the Jacobians of both the trim residual and the equations of motion are taken with complex-step
+ * differentiation, which is exact to machine precision. The linear models are reduced to the states of the LQR
+ * controller, so they can be used in place of the transfer function models of linear_model.hpp.
+ */
+
+#ifndef TRIM_LINEARIZATION_H
+#define TRIM_LINEARIZATION_H
+
+#include <string>
+#include <vector>
+
+#include "aircraft_model.hpp"
+#include "linear_model.hpp"
+
+namespace rosplane
+{
+
+/**
+ * A steady flight condition: level flight at a constant airspeed, altitude and turn rate.
+ */
+struct FlightCondition
+{
+  double va;        /**< airspeed (m/s) */
+  double h;         /**< altitude (m) */
+  double turn_rate; /**< heading rate, positive to the right (rad/s) */
+};
+
+/**
+ * A trim solution.
+ */
+struct TrimPoint
+{
+  double alpha;          /**< angle of attack (rad) */
+  double beta;           /**< sideslip angle (rad) */
+  double phi;            /**< roll angle (rad) */
+  double theta;          /**< pitch angle (rad) */
+  Eigen::Vector4d delta; /**< trim inputs, ordered (delta_e, delta_a, delta_r, delta_t) */
+  double residual;       /**< norm of the remaining state derivative error */
+  bool converged;        /**< true if the residual met the tolerance */
+};
+
+/**
+ * The trim and the reduced continuous linear models at a flight condition.
+ */
+struct TrimLinearization
+{
+  FlightCondition condition;
+  TrimPoint trim;
+  LinearModel longitudinal; /**< states (va, theta, q, h), inputs (delta_e, delta_t) */
+  LinearModel lateral;      /**< states (phi, chi, p, r), inputs (delta_a, delta_r) */
+};
+
+/**
+ * Finds the trim at a flight condition.
+ * @param params The aircraft parameters.
+ * @param condition The flight condition.
+ * @return The trim. Check converged before using it.
+ */
+TrimPoint find_trim(const AircraftParameters & params, const FlightCondition & condition);
+
+/**
+ * Linearizes the aircraft about a trim. The full model is written in the states (va, alpha, theta, q, h) and
+ * (beta, phi, chi, p, r), and the angle of attack and sideslip are residualized, since they settle much faster than
+ * the states the controller regulates.
+ * @param params The aircraft parameters.
+ * @param condition The flight condition.
+ * @param trim The trim at the flight condition.
+ * @return The trim and the continuous longitudinal and lateral models.
+ */
+TrimLinearization linearize(const AircraftParameters & params, const FlightCondition & condition,
+                            const TrimPoint & trim);
+
+/**
+ * Trims and linearizes a list of flight conditions in parallel. Each result is cached on disk under a name derived
+ * from the aircraft parameters and the flight condition, so repeated sweeps only solve the new conditions.
+ * @param params The aircraft parameters.
+ * @param conditions The flight conditions.
+ * @param cache_dir Directory of the cache, or empty to disable caching. Must already exist.
+ * @param threads Number of worker threads, or zero to use one per hardware thread.
+ * @return The results, in the order of the conditions.
+ */
+std::vector<TrimLinearization> sweep_trim_linearization(const AircraftParameters & params,
+                                                        const std::vector<FlightCondition> & conditions,
+                                                        const std::string & cache_dir,
+                                                        unsigned int threads);
+
+} // namespace rosplane
+
+#endif // TRIM_LINEARIZATION_H
@@ -0,0 +1,212 @@
+/**
+ * @file tvlqr.hpp
+ *
+ * Finite horizon, time-varying LQR for the lateral states while the aircraft rolls onto a new path segment, planned on
+ * a worker thread so the control loop never runs the Riccati recursion.
+ */
+
+#ifndef TVLQR_H
+#define TVLQR_H
+
+#include <semaphore.h>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#include "control_kernels.hpp"
+#include "linear_model.hpp"
+#include "seqlock.hpp"
+
+namespace rosplane
+{
+
+/**
+ * The model, weights and timing every plan is made with, set from the parameters.
+ */
+struct TvlqrDesign
+{
+  LinearModelCoefficients coefficients; /**< linear model coefficients at trim */
+  double Ts;                            /**< controller sample time (s) */
+  double roll_rate;                     /**< rate the roll reference moves at (rad/s) */
+  double horizon;                       /**< time a plan covers (s) */
+  Eigen::Vector4d q_lat;                /**< diagonal state weights for (phi, chi, p, r) */
+  Eigen::Vector2d r_lat;                /**< diagonal input weights for (delta_a, delta_r) */
+};
+
+/**
+ * Describes the roll transition onto a path segment. The roll reference moves from phi_start to the segment's steady
+ * roll at the roll rate, and the course dynamics are linearized about it. Trivially copyable, so the control loop can
+ * hand it over through a seqlock.
+ */
+struct TvlqrSegment
+{
+  uint64_t start_tick; /**< control tick the segment starts at */
+  float phi_start;     /**< roll angle when the segment starts (rad) */
+  float va;            /**< airspeed along the segment, zero for the trim airspeed (m/s) */
+  float rho;           /**< radius of an orbit, zero for lines (m) */
+  int lamda;           /**< direction of an orbit, 1 clockwise and -1 counter clockwise */
+};
+
+/**
+ * A lateral gain sequence K(t) over a horizon, from a backward Riccati recursion whose terminal cost is the steady
+ * state cost of the segment, along with the roll reference it was linearized about. The course reference stays the
+ * path follower's, so the aircraft still turns onto the segment and corrects its distance from it. The sequence is
+ * computed once per segment by plan, and indexed by control tick, so a plan that was finished after its segment
+ * started still lines up with the time since the segment started. Once the horizon has passed the aircraft holds the
+ * segment's steady roll, and the last (steady state) gain is used.
+ */
+class TvlqrGainTrajectory
+{
+public:
+  /**
+   * Most controller ticks a plan can cover. Longer horizons are cut to this many ticks.
+   */
+  static constexpr std::size_t MAX_STEPS = 1024;
+
+  /**
+   * One tick of the plan. The gain is applied to the lateral state error taken with respect to the roll reference and
+   * the commanded course.
+   */
+  struct Step
+  {
+    KernelMatrix<2, 4> gain; /**< rows (delta_a, delta_r), columns (phi, chi, p, r) */
+    float phi_ref;           /**< roll reference (rad) */
+  };
+
+  TvlqrGainTrajectory();
+
+  /**
+   * Runs the backward Riccati recursion for a segment. Not real time safe.
+   * @param design The model, weights and timing to plan with.
+   * @param segment The segment to plan for.
+   * @return True if the terminal cost could be computed.
+   */
+  bool plan(const TvlqrDesign & design, const TvlqrSegment & segment);
+
+  /**
+   * Gets the step of a control tick. Lock and allocation free.
+   * @param tick The control tick.
+   * @return The tick's step, or nullptr once the horizon has passed.
+   */
+  const Step * step(uint64_t tick) const;
+
+  /**
+   * @return The steady state gain of the segment, used once the horizon has passed.
+   */
+  const KernelMatrix<2, 4> & steady_gain() const { return steps_[length_ - 1].gain; }
+
+private:
+  std::array<Step, MAX_STEPS> steps_;
+  std::size_t length_;
+  uint64_t start_tick_;
+};
+
+/**
+ * Plans the time-varying gains on a worker thread. The control loop queues segments with request and picks up the
+ * finished plans with latest, and neither ever locks or allocates. Only the newest queued segment is planned. Plans
+ * are published with an atomic pointer exchange, as the LqrGainSolver publishes its gains.
+ */
+class TvlqrPlanner
+{
+public:
+  /**
+   * Starts the worker thread.
+   */
+  TvlqrPlanner();
+
+  /**
+   * Stops the worker thread and frees every published plan.
+   */
+  ~TvlqrPlanner();
+
+  TvlqrPlanner(const TvlqrPlanner &) = delete;
+  TvlqrPlanner & operator=(const TvlqrPlanner &) = delete;
+
+  /**
+   * Sets the design the following plans are made with. Must not be called from the control loop.
+   * @param design The model, weights and timing to plan with.
+   */
+  void configure(const TvlqrDesign & design);
+
+  /**
+   * Queues a segment to be planned, replacing any segment that has not been started yet. Must only be called from
+   * the control loop. Lock and allocation free.
+   * @param segment The segment to plan for.
+   */
+  void request(const TvlqrSegment & segment);
+
+  /**
+   * Gets the newest plan. Must only be called from the control loop. Lock and allocation free.
+   * @return The newest plan, or nullptr if no segment has been planned yet. Valid until the next call.
+   */
+  const TvlqrGainTrajectory * latest();
+
+private:
+  /**
+   * A queued segment, numbered so the worker can tell a new one from one it has planned.
+   */
+  struct Request
+  {
+    uint64_t id;
+    TvlqrSegment segment;
+  };
+
+  /**
+   * A published plan. Plans the control loop has replaced are chained together until the worker frees them.
+   */
+  struct Block
+  {
+    TvlqrGainTrajectory trajectory;
+    Block * next;
+  };
+
+  /**
+   * The worker thread loop. Waits for a segment, plans it and publishes the plan.
+   */
+  void run();
+
+  /**
+   * Frees the plans the control loop has replaced.
+   */
+  void free_retired();
+
+  std::thread worker_;
+  std::mutex mutex_;
+  TvlqrDesign design_;
+  bool have_design_;
+  std::atomic<bool> stop_;
+
+  /**
+   * Wakes the worker. Posting a semaphore neither locks nor allocates, so the control loop can do it.
+   */
+  sem_t wakeup_;
+
+  /**
+   * The newest queued segment, and the number of the last one queued, which only the control loop touches.
+   */
+  Seqlock<Request> request_;
+  uint64_t request_id_;
+
+  /**
+   * The newest plan published by the worker and not yet picked up by the control loop.
+   */
+  std::atomic<Block *> ready_;
+
+  /**
+   * Plans the control loop has replaced, waiting to be freed by the worker.
+   */
+  std::atomic<Block *> retired_;
+
+  /**
+   * The plan the control loop is using. Only touched by the control loop.
+   */
+  Block * active_;
+};
+
+} // namespace rosplane
+
+#endif // TVLQR_H
@@ -0,0 +1,44 @@
+import os
+import sys
+from launch import LaunchDescription
+from launch_ros.actions import ComposableNodeContainer
+from launch_ros.descriptions import ComposableNode
+from ament_index_python.packages import get_package_share_directory
+
+
+def generate_launch_description():
+    # Create the package directory
+    rosplane_lqr_dir = get_package_share_directory('rosplane_lqr')
+
+    aircraft = "anaconda" # Default aircraft
+
+    for arg in sys.argv:
+        if arg.startswith("aircraft:="):
+            aircraft = arg.split(":=")[1]
+
+    autopilot_params = os.path.join(
+        rosplane_lqr_dir,
+        'params',
+        aircraft + '_autopilot_params.yaml'
+    )
+
+    # The controller runs as a component, so other components loaded into this container (or added to it with
+    # `ros2 component load`) exchange messages with it through intra-process delivery instead of the middleware.
+    return LaunchDescription([
+        ComposableNodeContainer(
+            name='autopilot_container',
+            namespace='',
+            package='rclcpp_components',
+            executable='component_container_mt',
+            output='screen',
+            composable_node_descriptions=[
+                ComposableNode(
+                    package='rosplane_lqr',
+                    plugin='rosplane::PythonControllerInterface',
+                    name='autopilot',
+                    parameters=[autopilot_params],
+                    extra_arguments=[{'use_intra_process_comms': True}]
+                ),
+            ]
+        ),
+    ])
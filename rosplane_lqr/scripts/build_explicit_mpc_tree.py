@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+"""
+Builds the binary search tree used by the explicit_mpc backend of the lqr_controller.
+
+The input is the piecewise affine law of an explicit MPC, as exported from a multi-parametric QP tool (for example
+MPT3), in JSON:
+
+    {"regions": [{"H": [[...], ...], "k": [...], "F": [[...], [...]], "g": [...]}, ...]}
+
+Region i is {x : H x <= k} and its law is u = F x + g, with x the four states relative to the design point and u the
+two inputs relative to trim, in the state and input ordering of the controller.
+
+The tree is built as in Tondel, Johansen and Bemporad, "Evaluation of piecewise affine control via binary search
+tree", Automatica, 2003. Each node splits on the region facet that best balances the regions on either side, so the
+online search visits O(log regions) nodes.
+
+Usage: build_explicit_mpc_tree.py regions.json tree.bin
+"""
+
+import json
+import struct
+import sys
+
+import numpy as np
+from scipy.optimize import linprog
+
+TOLERANCE = 1e-7
+
+
+def intersects(regions, indices, constraints):
+    """Returns the regions, of those given, that intersect the polytope {x : A x <= b}."""
+    A, b = constraints
+    hit = []
+    for i in indices:
+        H, k, _, _ = regions[i]
+        A_ub = np.vstack([H, A]) if len(A) else H
+        b_ub = np.concatenate([k, b]) if len(b) else k
+        # Chebyshev ball radius of the intersection. A positive radius means the intersection has an interior.
+        norms = np.linalg.norm(A_ub, axis=1)
+        result = linprog(np.r_[np.zeros(H.shape[1]), -1.0], A_ub=np.c_[A_ub, norms], b_ub=b_ub,
+                         bounds=[(None, None)] * H.shape[1] + [(0, 1e3)], method="highs")
+        if result.status == 0 and -result.fun > TOLERANCE:
+            hit.append(i)
+    return hit
+
+
+def same_law(regions, indices):
+    _, _, F0, g0 = regions[indices[0]]
+    return all(np.allclose(regions[i][2], F0) and np.allclose(regions[i][3], g0) for i in indices)
+
+
+def build(regions, hyperplanes):
+    nodes = []
+    leaves = []
+
+    def leaf(index):
+        leaves.append(regions[index][2:])
+        return -len(leaves)
+
+    def split(indices, constraints):
+        if len(indices) == 1 or same_law(regions, indices):
+            return leaf(indices[0])
+
+        best = None
+        A, b = constraints
+        for a, c in hyperplanes:
+            left = intersects(regions, indices, (np.vstack([A, a]) if len(A) else a[None, :], np.r_[b, c]))
+            right = intersects(regions, indices, (np.vstack([A, -a]) if len(A) else -a[None, :], np.r_[b, -c]))
+            if len(left) == len(indices) and len(right) == len(indices):
+                continue
+            score = max(len(left), len(right))
+            if best is None or score < best[0]:
+                best = (score, a, c, left, right)
+
+        if best is None:
+            # No facet separates the regions, which only happens with overlapping regions.
+            return leaf(indices[0])
+
+        _, a, c, left, right = best
+        index = len(nodes)
+        nodes.append([a, c, 0, 0])
+        nodes[index][2] = split(left, (np.vstack([A, a]) if len(A) else a[None, :], np.r_[b, c])) \
+            if left else leaf(indices[0])
+        nodes[index][3] = split(right, (np.vstack([A, -a]) if len(A) else -a[None, :], np.r_[b, -c])) \
+            if right else leaf(indices[0])
+        return index
+
+    root = split(list(range(len(regions))), (np.empty((0, 4)), np.empty(0)))
+    assert root in (0, -1)
+    return nodes, leaves
+
+
+def main():
+    if len(sys.argv) != 3:
+        print(__doc__)
+        sys.exit(1)
+
+    with open(sys.argv[1]) as f:
+        data = json.load(f)
+
+    regions = []
+    for region in data["regions"]:
+        H = np.array(region["H"], dtype=float)
+        k = np.array(region["k"], dtype=float)
+        F = np.array(region["F"], dtype=float)
+        g = np.array(region["g"], dtype=float)
+        if H.shape[1] != 4 or F.shape != (2, 4) or g.shape != (2,):
+            raise ValueError("Regions must be over four states with two inputs.")
+        regions.append((H, k, F, g))
+
+    # Candidate split planes are the normalized, de-duplicated region facets.
+    hyperplanes = []
+    for H, k, _, _ in regions:
+        for a, c in zip(H, k):
+            scale = np.linalg.norm(a)
+            a, c = a / scale, c / scale
+            if not any(np.allclose(a, a2) and np.isclose(c, c2) for a2, c2 in hyperplanes):
+                hyperplanes.append((a, c))
+
+    nodes, leaves = build(regions, hyperplanes)
+
+    with open(sys.argv[2], "wb") as f:
+        f.write(b"RPEMPC1\0")
+        f.write(struct.pack("<4I", 4, 2, len(nodes), len(leaves)))
+        for a, c, left, right in nodes:
+            f.write(struct.pack("<5f2i", *a, c, left, right))
+        for F, g in leaves:
+            f.write(struct.pack("<10f", *F.flatten(), *g))
+
+    print(f"{len(regions)} regions, {len(nodes)} nodes, {len(leaves)} leaves")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+"""
+Converts a flight recorder log of the lqr_controller to CSV, or to Parquet if the output ends in .parquet (needs
+pyarrow).
+
+The log is the binary file written when recorder_enabled is set, one record per control tick. Its header holds the
+schema of the records, see include/flight_recorder.hpp, so the columns follow whatever the controller recorded.
+
+Usage: convert_flight_log.py controller.rlog output.csv
+"""
+
+import csv
+import struct
+import sys
+
+import numpy as np
+
+MAGIC = b"RPLQRLOG"
+FIELDS_OFFSET = 32
+FIELD_SIZE = 56
+FIELD_NAME_SIZE = 48
+FIELD_TYPES = {0: "<f4", 1: "<f8", 2: "<i4", 3: "<i8"}
+
+
+def read_log(path):
+    """Returns the records of a log as a numpy structured array."""
+    with open(path, "rb") as f:
+        data = f.read()
+
+    if data[:8] != MAGIC:
+        raise ValueError(f"{path} is not a flight recorder log.")
+    version, record_size, field_count, data_offset = struct.unpack_from("<4I", data, 8)
+    (record_count,) = struct.unpack_from("<Q", data, 24)
+    if version != 1:
+        raise ValueError(f"{path} has unsupported log version {version}.")
+
+    names, formats, offsets = [], [], []
+    for i in range(field_count):
+        base = FIELDS_OFFSET + i * FIELD_SIZE
+        names.append(data[base:base + FIELD_NAME_SIZE].split(b"\0", 1)[0].decode())
+        field_type, offset = struct.unpack_from("<2I", data, base + FIELD_NAME_SIZE)
+        formats.append(FIELD_TYPES[field_type])
+        offsets.append(offset)
+
+    # A log that was not closed may be shorter than its last count, or longer with an unused tail.
+    record_count = min(record_count, (len(data) - data_offset) // record_size)
+
+    dtype = np.dtype({"names": names, "formats": formats, "offsets": offsets, "itemsize": record_size})
+    return np.frombuffer(data, dtype=dtype, count=record_count, offset=data_offset)
+
+
+def main():
+    if len(sys.argv) != 3:
+        print(__doc__)
+        sys.exit(1)
+
+    records = read_log(sys.argv[1])
+    names = records.dtype.names
+
+    if sys.argv[2].endswith(".parquet"):
+        import pyarrow as pa
+        import pyarrow.parquet as pq
+
+        pq.write_table(pa.table({name: records[name] for name in names}), sys.argv[2])
+    else:
+        with open(sys.argv[2], "w", newline="") as f:
+            writer = csv.writer(f)
+            writer.writerow(names)
+            writer.writerows(zip(*(records[name].tolist() for name in names)))
+
+    print(f"{len(records)} records, {len(names)} fields")
+
+
+if __name__ == "__main__":
+    main()
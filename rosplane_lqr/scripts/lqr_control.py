@@ -0,0 +1,38 @@
+"""
+Example control law for the embedded Python backend of the lqr_controller.
+
+Select it with the parameters lqr_backend: embedded_python, python_lqr_module: lqr_control and python_lqr_path set to
+the directory holding this file. The controller calls control(x, u) every tick. x is a read-only numpy view of the
+controller inputs and u is a numpy view of the outputs that must be filled in place. Neither array may be kept or
+resized, since they view memory owned by the controller.
+
+x layout: Ts, h, va, phi, theta, chi, p, q, r, va_c, h_c, chi_c, phi_ff, va_ref, theta_ref, h_ref, phi_ref, chi_ref
+u layout: delta_e, delta_a, delta_r, delta_t
+
+Ts is the nominal controller period, 1 / controller_output_frequency (s).
+"""
+
+import numpy as np
+
+# Gains matching the default lqr_* parameters of the controller.
+K_LON = np.array([[0.0, -0.5, -0.095, -0.05],   # delta_e from (va, theta, q, h) errors
+                  [0.05, 0.0, 0.0, 0.0]])        # delta_t
+K_LAT = np.array([[0.75, 2.25, 0.1, 0.0],        # delta_a from (phi, chi, p, r) errors
+                  [0.0, 0.0, 0.0, 0.0]])         # delta_r
+U_TRIM = np.array([0.02, 0.0, 0.0, 0.5])         # delta_e, delta_a, delta_r, delta_t
+
+
+def control(x, u):
+    chi_err = x[5] - x[17]
+    chi_err = (chi_err + np.pi) % (2.0 * np.pi) - np.pi
+
+    x_lon = np.array([x[2] - x[13], x[4] - x[14], x[7], x[1] - x[15]])
+    x_lat = np.array([x[3] - x[16], chi_err, x[6], x[8]])
+
+    u_lon = -K_LON @ x_lon
+    u_lat = -K_LAT @ x_lat
+
+    u[0] = U_TRIM[0] + u_lon[0]
+    u[1] = U_TRIM[1] + u_lat[0]
+    u[2] = U_TRIM[2] + u_lat[1]
+    u[3] = U_TRIM[3] + u_lon[1]
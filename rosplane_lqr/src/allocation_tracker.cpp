@@ -0,0 +1,105 @@
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+
+#include "allocation_tracker.hpp"
+
+// The hook forwards to the glibc allocator, so it is only built there.
+#if defined(ROSPLANE_LQR_TRACK_ALLOCATIONS) && defined(__GLIBC__)
+#define ROSPLANE_LQR_ALLOCATION_HOOK
+#endif
+
+#ifdef ROSPLANE_LQR_ALLOCATION_HOOK
+
+namespace
+{
+
+// Initial exec, so reading the counter from inside malloc never has to allocate thread local storage.
+__attribute__((tls_model("initial-exec"))) thread_local uint64_t thread_allocations = 0;
+
+} // namespace
+
+extern "C" {
+
+// The glibc allocator entry points the replacements forward to.
+void * __libc_malloc(std::size_t size) noexcept;
+void * __libc_calloc(std::size_t count, std::size_t size) noexcept;
+void * __libc_realloc(void * ptr, std::size_t size) noexcept;
+void * __libc_memalign(std::size_t alignment, std::size_t size) noexcept;
+
+// operator new allocates through malloc, so these count C++ allocations too.
+void * malloc(std::size_t size) noexcept
+{
+  thread_allocations++;
+  return __libc_malloc(size);
+}
+
+void * calloc(std::size_t count, std::size_t size) noexcept
+{
+  thread_allocations++;
+  return __libc_calloc(count, size);
+}
+
+void * realloc(void * ptr, std::size_t size) noexcept
+{
+  thread_allocations++;
+  return __libc_realloc(ptr, size);
+}
+
+// The aligned operator new allocates through one of these, depending on how the C++ library was built.
+void * memalign(std::size_t alignment, std::size_t size) noexcept
+{
+  thread_allocations++;
+  return __libc_memalign(alignment, size);
+}
+
+void * aligned_alloc(std::size_t alignment, std::size_t size) noexcept
+{
+  thread_allocations++;
+  return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void ** ptr, std::size_t alignment, std::size_t size) noexcept
+{
+  // glibc exports no entry point for posix_memalign, so its checks are repeated here.
+  if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0 || alignment == 0) {
+    return EINVAL;
+  }
+
+  thread_allocations++;
+  void * result = __libc_memalign(alignment, size);
+  if (result == nullptr) {
+    return ENOMEM;
+  }
+  *ptr = result;
+  return 0;
+}
+
+} // extern "C"
+
+#endif
+
+namespace rosplane
+{
+
+uint64_t thread_allocation_count()
+{
+#ifdef ROSPLANE_LQR_ALLOCATION_HOOK
+  return thread_allocations;
+#else
+  return 0;
+#endif
+}
+
+bool allocation_tracking_active()
+{
+  uint64_t before = thread_allocation_count();
+
+  // Volatile, so the compiler cannot elide the allocation.
+  void * volatile probe = std::malloc(1);
+  std::free(probe);
+
+  return thread_allocation_count() != before;
+}
+
+} // namespace rosplane
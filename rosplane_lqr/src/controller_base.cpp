@@ -1,145 +1,436 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <ctime>
 #include <functional>
-
-#include "python_controller_interface.hpp"
+#include <memory>
+#include <utility>
 
 #include "controller_base.hpp"
 
 namespace rosplane
 {
 
-ControllerBase::ControllerBase()
-    : Node("controller_base")
-    , params_(this)
+ControllerBase::ControllerBase(std::unique_ptr<ControllerCore> core,
+                               const rclcpp::NodeOptions & options)
+    : Node("controller_base", options)
+    , core_(std::move(core))
+    , params_(this, core_->params())
+    , param_snapshot_(nullptr)
+    , sensor_stamp_next_(0)
     , params_initialized_(false)
+    , state_triggered_(false)
+    , realtime_(false)
+    , period_jitter_hist_(1.0, 100'000.0)
+    , control_hist_(0.1, 10'000.0)
+    , convert_to_pwm_hist_(0.1, 10'000.0)
+    , publish_hist_(0.1, 10'000.0)
+    , tick_hist_(0.1, 10'000.0)
+    , state_age_hist_(10.0, 1'000'000.0)
+    , timing_ticks_(0)
+    , missed_deadlines_(0)
+    , timing_window_(0)
+    , published_timing_window_(0)
+    , control_ticks_(0)
+    , control_allocations_(0)
+    , publish_allocations_(0)
 {
 
-  // Advertise published topics.
-  actuators_pub_ = this->create_publisher<rosflight_msgs::msg::Command>("command", 10);
-  controller_internals_pub_ =
-    this->create_publisher<rosplane_msgs::msg::ControllerInternals>("controller_internals", 10);
+  // The parameters declared from here on belong to the adapter, so the parameter hash in the flight recorder log only
+  // covers the parameters of the control law, as a replay of the log sets them up.
+  core_->params().close_hash();
 
-  // Advertise subscribed topics and set bound callbacks.
-  controller_commands_sub_ = this->create_subscription<rosplane_msgs::msg::ControllerCommands>(
-    "controller_command", 10, std::bind(&ControllerBase::controller_commands_callback, this, _1));
-  vehicle_state_sub_ = this->create_subscription<rosplane_msgs::msg::State>(
-    "estimated_state", 10, std::bind(&ControllerBase::vehicle_state_callback, this, _1));
+  // Log the messages of the control law through ROS.
+  core_->set_log_handler([logger = this->get_logger()](LogLevel level, const char * message) {
+    switch (level) {
+      case LogLevel::INFO:
+        RCLCPP_INFO(logger, "%s", message);
+        break;
+      case LogLevel::WARN:
+        RCLCPP_WARN(logger, "%s", message);
+        break;
+      case LogLevel::ERROR:
+        RCLCPP_ERROR(logger, "%s", message);
+        break;
+    }
+  });
+
+  // Advertise published topics. With intra-process comms the outputs are handed to the subscribers without a copy.
+  actuators_pub_ = LoanedPublisher<rosflight_msgs::msg::Command>(*this, "command", 10);
+  controller_internals_pub_ =
+    LoanedPublisher<rosplane_msgs::msg::ControllerInternals>(*this, "controller_internals", 10);
+  if (actuators_pub_.loaning()) {
+    RCLCPP_INFO(this->get_logger(), "Publishing commands in middleware loaned messages.");
+  }
 
   // This flag indicates whether the first set of commands have been received.
   command_recieved_ = false;
 
+  // No state has been received, so there is no airspeed rate yet.
+  previous_state_stamp_ns_ = 0;
+  previous_va_ = 0.0f;
+
   // Set the parameter callback, for when parameters are changed.
   parameter_callback_handle_ = this->add_on_set_parameters_callback(
     std::bind(&ControllerBase::parametersCallback, this, std::placeholders::_1));
 
   // Declare the parameters for ROS2 param system.
   declare_parameters();
-  // Set the values for the parameters, from the param file or use the deafault value.
-  params_.set_parameters();
+  // Set the values for the parameters, from the param file or use the deafault value. They are needed below to set up
+  // the subscriptions and timer, so they are committed now. This also declares the parameters of the core with ROS2.
+  // Children commit their own declarations.
+  params_.commit();
+  // The core was set up with its default values. It prepares the values from the launch now and applies them at its
+  // first tick.
+  core_->notify_parameters_changed();
 
   params_initialized_ = true;
 
+  std::string control_trigger = params_.get_string("control_trigger");
+  state_triggered_ = control_trigger == "state";
+  if (!state_triggered_ && control_trigger != "timer") {
+    RCLCPP_ERROR(this->get_logger(), "Unknown control_trigger %s, using the timer.",
+                 control_trigger.c_str());
+  }
+
+  // The flight recorder thread is started before the control loop can run.
+  if (params_.get_bool("recorder_enabled")) {
+    start_recorder();
+  }
+
+  // The control loop has its own callback group. With the real-time profile it is left out of the node's executor, and
+  // the lqr_controller executable spins it on a real-time thread, while parameters and logging stay on the executor.
+  // Anywhere else, such as a component container, nothing would spin the group, so the profile is not used.
+  realtime_ = params_.get_bool("realtime_control");
+  if (realtime_ && !realtime_executor_provided()) {
+    RCLCPP_ERROR(this->get_logger(),
+                 "realtime_control is set, but this process has no real-time executor for the "
+                 "control loop. Run the lqr_controller executable for the real-time profile. The "
+                 "control loop runs on the node's executor instead.");
+    realtime_ = false;
+  }
+  control_callback_group_ =
+    this->create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive, !realtime_);
+
+  // Advertise subscribed topics and set bound callbacks. The subscriptions only write the snapshots, so they get their
+  // own callback group and can run alongside the control loop on a multithreaded executor. When the state triggers
+  // the control loop, its subscription is in the control group so the control loop remains serialized with the other
+  // callbacks of the controller.
+  subscription_callback_group_ =
+    this->create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+  rclcpp::SubscriptionOptions control_subscription_options;
+  control_subscription_options.callback_group = control_callback_group_;
+  rclcpp::SubscriptionOptions subscription_options;
+  subscription_options.callback_group = subscription_callback_group_;
+
+  controller_commands_sub_ = this->create_subscription<rosplane_msgs::msg::ControllerCommands>(
+    "controller_command", 10, std::bind(&ControllerBase::controller_commands_callback, this, _1),
+    subscription_options);
+  vehicle_state_sub_ = this->create_subscription<rosplane_msgs::msg::State>(
+    "estimated_state", 10, std::bind(&ControllerBase::vehicle_state_callback, this, _1),
+    state_triggered_ ? control_subscription_options : subscription_options);
+  for (auto & sensor_stamp : sensor_stamps_) {
+    sensor_stamp.store(0, std::memory_order_relaxed);
+  }
+  imu_sub_ = this->create_subscription<sensor_msgs::msg::Imu>(
+    "imu/data", 10, std::bind(&ControllerBase::imu_callback, this, _1), subscription_options);
+
   set_timer();
+
+  // Debug builds count the heap allocations of the control loop, which must stop once it has warmed up.
+#ifdef ROSPLANE_LQR_TRACK_ALLOCATIONS
+  if (allocation_tracking_active()) {
+    RCLCPP_INFO(this->get_logger(), "Counting heap allocations in the control loop.");
+  } else {
+    RCLCPP_WARN(this->get_logger(),
+                "Allocation tracking is built in, but the allocator hook is not active in this "
+                "process. Run the lqr_controller executable to count allocations.");
+  }
+#endif
+
+  report_timer_ =
+    this->create_wall_timer(10s, std::bind(&ControllerBase::report_control_loop, this));
+
+  // The control loop summarizes its timing about once a second, and this timer publishes each summary off the control
+  // loop's thread. It polls faster than the summaries are made, so none are skipped.
+  timing_pub_ = this->create_publisher<lqr_srvs::msg::ControlLoopTiming>("control_loop_timing", 10);
+  latency_pub_ = this->create_publisher<lqr_srvs::msg::PipelineLatency>("pipeline_latency", 10);
+  timing_timer_ =
+    this->create_wall_timer(250ms, std::bind(&ControllerBase::publish_timing, this));
 }
 
 void ControllerBase::declare_parameters()
 {
   // Declare default parameters associated with this controller, controller_base
-  params_.declare_double("pwm_rad_e", 1.0);
-  params_.declare_double("pwm_rad_a", 1.0);
-  params_.declare_double("pwm_rad_r", 1.0);
-  params_.declare_double("controller_output_frequency", 100.0);
+  pwm_rad_e_param_ = params_.declare_double("pwm_rad_e", 1.0);
+  pwm_rad_a_param_ = params_.declare_double("pwm_rad_a", 1.0);
+  pwm_rad_r_param_ = params_.declare_double("pwm_rad_r", 1.0);
+  // The controller frequency is declared by the core, since the control laws integrate with it.
+  controller_output_frequency_param_ = params_.handle<double>("controller_output_frequency");
+
+  // Either "timer", to run the control loop at controller_output_frequency, or "state", to run it as soon as a new
+  // estimated state arrives. In the state mode the loop runs at most once per min_control_interval (s), and the
+  // watchdog runs it if no state arrives for control_watchdog_timeout (s). The trigger is only read at startup.
+  params_.declare_string("control_trigger", "timer");
+  min_control_interval_param_ = params_.declare_double("min_control_interval", 0.0);
+  control_watchdog_timeout_param_ = params_.declare_double("control_watchdog_timeout", 0.05);
+
+  // When true, the control loop runs on its own thread with the SCHED_FIFO policy at realtime_priority, pinned to
+  // realtime_cpu (-1 for any CPU), and with all memory locked if realtime_lock_memory is set. The thread is started by
+  // the lqr_controller executable, so in a component container it is ignored with an error. Only read at startup.
+  params_.declare_bool("realtime_control", false);
+  params_.declare_int("realtime_priority", 80);
+  params_.declare_int("realtime_cpu", -1);
+  params_.declare_bool("realtime_lock_memory", true);
+
+  // When true, the state is propagated from its stamp to the expected actuation time, the tick time plus
+  // state_prediction_lead (s), before the control law runs. This makes up for the estimator period and the transport
+  // delay. The propagation is capped at state_prediction_max_age (s), so a stale state is not extrapolated far.
+  state_prediction_param_ = params_.declare_bool("state_prediction", false);
+  state_prediction_lead_param_ = params_.declare_double("state_prediction_lead", 0.0);
+  state_prediction_max_age_param_ = params_.declare_double("state_prediction_max_age", 0.1);
+
+  // When true, the inputs and outputs of the control law are logged every tick to a binary file in
+  // recorder_directory, see flight_recorder.hpp. Only read at startup.
+  params_.declare_bool("recorder_enabled", false);
+  params_.declare_string("recorder_directory", ".");
 }
 
-void ControllerBase::controller_commands_callback(
-  const rosplane_msgs::msg::ControllerCommands::SharedPtr msg)
+rclcpp::CallbackGroup::SharedPtr ControllerBase::realtime_callback_group()
 {
+  return realtime_ ? control_callback_group_ : nullptr;
+}
 
-  // Set the flag that a command has been received.
-  command_recieved_ = true;
+RealtimeProfile ControllerBase::realtime_profile()
+{
+  RealtimeProfile profile;
+  profile.priority = static_cast<int>(params_.get_int("realtime_priority"));
+  profile.cpu = static_cast<int>(params_.get_int("realtime_cpu"));
+  profile.lock_memory = params_.get_bool("realtime_lock_memory");
+  return profile;
+}
+
+void ControllerBase::controller_commands_callback(
+  const rosplane_msgs::msg::ControllerCommands::ConstSharedPtr msg)
+{
 
   // Save the message to use in calculations.
-  controller_commands_ = *msg;
+  CommandSnapshot commands;
+  commands.va_c = msg->va_c;
+  commands.h_c = msg->h_c;
+  commands.chi_c = msg->chi_c;
+  commands.phi_ff = msg->phi_ff;
+  commands.phi_c = msg->phi_c;
+  commands.theta_c = msg->theta_c;
+  controller_commands_.store(commands);
+
+  // Set the flag that a command has been received, after the command is visible to the control loop.
+  command_recieved_.store(true, std::memory_order_release);
 }
 
-void ControllerBase::vehicle_state_callback(const rosplane_msgs::msg::State::SharedPtr msg)
+void ControllerBase::vehicle_state_callback(const rosplane_msgs::msg::State::ConstSharedPtr msg)
 {
 
   // Save the message to use in calculations.
-  vehicle_state_ = *msg;
+  StateSnapshot state;
+  state.received_ns =
+    std::chrono::steady_clock::now().time_since_epoch() / std::chrono::nanoseconds(1);
+
+  // Keep the stamps, to trace the latency from the IMU sample the state came from to the command.
+  state.stamp_ns = rclcpp::Time(msg->header.stamp).nanoseconds();
+  state.sensor_stamp_ns = sensor_stamp_before(state.stamp_ns);
+  state.received_ros_ns = this->get_clock()->now().nanoseconds();
+
+  // The State message has no airspeed rate, so it is taken between consecutive states for the state prediction.
+  state.alpha = msg->alpha;
+  state.va_rate = 0.0f;
+  if (previous_state_stamp_ns_ != 0 && state.stamp_ns > previous_state_stamp_ns_) {
+    float dt = (state.stamp_ns - previous_state_stamp_ns_) * 1e-9f;
+    state.va_rate = (msg->va - previous_va_) / dt;
+  }
+  previous_state_stamp_ns_ = state.stamp_ns;
+  previous_va_ = msg->va;
+  state.h = -msg->position[2];
+  state.va = msg->va;
+  state.phi = msg->phi;
+  state.theta = msg->theta;
+  state.chi = msg->chi;
+  state.p = msg->p;
+  state.q = msg->q;
+  state.r = msg->r;
+  vehicle_state_.store(state);
+
+  // Run the control loop on the fresh state, unless it ran too recently. This callback shares the control group with
+  // the tick, so it reads the control loop's snapshot without locking.
+  if (state_triggered_) {
+    std::chrono::duration<double> min_interval(
+      params_.store().control_snapshot().get(min_control_interval_param_));
+    if (std::chrono::steady_clock::now() - last_control_time_ >= min_interval) {
+      actuator_controls_publish();
+    }
+  }
 }
 
-void ControllerBase::actuator_controls_publish()
+void ControllerBase::imu_callback(const sensor_msgs::msg::Imu::ConstSharedPtr msg)
 {
+  sensor_stamps_[sensor_stamp_next_ % SENSOR_STAMPS].store(
+    rclcpp::Time(msg->header.stamp).nanoseconds(), std::memory_order_relaxed);
+  sensor_stamp_next_++;
+}
+
+int64_t ControllerBase::sensor_stamp_before(int64_t stamp_ns) const
+{
+  // The ring may be written while it is searched, but every entry is a complete stamp of a recent sample.
+  int64_t newest = 0;
+  for (const auto & sensor_stamp : sensor_stamps_) {
+    int64_t sensor_ns = sensor_stamp.load(std::memory_order_relaxed);
+    if (sensor_ns <= stamp_ns && sensor_ns > newest) {
+      newest = sensor_ns;
+    }
+  }
+  return newest;
+}
+
+void ControllerBase::watchdog_callback()
+{
+  // The watchdog runs in the control group, so it reads the control loop's snapshot without locking.
+  std::chrono::duration<double> timeout(
+    params_.store().control_snapshot().get(control_watchdog_timeout_param_));
+  if (std::chrono::steady_clock::now() - last_control_time_ >= timeout) {
+    actuator_controls_publish();
+  }
+}
 
-  // Assemble inputs for the control algorithm.
-  Input input;
-  input.h = -vehicle_state_.position[2];
-  input.va = vehicle_state_.va;
-  input.phi = vehicle_state_.phi;
-  input.theta = vehicle_state_.theta;
-  input.chi = vehicle_state_.chi;
-  input.p = vehicle_state_.p;
-  input.q = vehicle_state_.q;
-  input.r = vehicle_state_.r;
-  input.va_c = controller_commands_.va_c;
-  input.h_c = controller_commands_.h_c;
-  input.chi_c = controller_commands_.chi_c;
-  input.phi_ff = controller_commands_.phi_ff;
+void ControllerBase::actuator_controls_publish()
+{
+  TickTimes times;
+  times.start = std::chrono::steady_clock::now();
+  times.previous_start = last_control_time_;
+  times.controlled = false;
+  PipelineStamps stamps;
+  stamps.tick_ns = this->get_clock()->now().nanoseconds();
+  param_snapshot_ = &params_.store().control_snapshot();
+  last_control_time_ = times.start;
+
+  // Take consistent snapshots of the latest state and commands.
+  StateSnapshot state = vehicle_state_.load();
+  CommandSnapshot commands = controller_commands_.load();
+  times.state_received =
+    std::chrono::steady_clock::time_point(std::chrono::nanoseconds(state.received_ns));
+  stamps.sensor_ns = state.sensor_stamp_ns;
+  stamps.state_ns = state.stamp_ns;
+  stamps.state_received_ns = state.received_ros_ns;
+
+  // Assemble inputs for the control algorithm. The time step is the nominal period, the step the laws integrate with.
+  // The inputs and outputs are value initialized, so the records the flight recorder writes have no undefined bytes.
+  Input input{};
+  input.Ts = 1.0 / param_snapshot_->get(controller_output_frequency_param_);
+  input.h = state.h;
+  input.va = state.va;
+  input.phi = state.phi;
+  input.theta = state.theta;
+  input.chi = state.chi;
+  input.p = state.p;
+  input.q = state.q;
+  input.r = state.r;
+  input.va_c = commands.va_c;
+  input.h_c = commands.h_c;
+  input.chi_c = commands.chi_c;
+  input.phi_ff = commands.phi_ff;
+  input.state_stamp_ns = state.stamp_ns;
+  input.sensor_stamp_ns = state.sensor_stamp_ns;
+
+  if (param_snapshot_->get(state_prediction_param_)) {
+    predict_state(state, stamps.tick_ns, input);
+  }
 
-  Output output;
+  Output output{};
 
   // If a command was received, begin control.
-  if (command_recieved_ == true) {
+  if (command_recieved_.load(std::memory_order_acquire)) {
 
-    // Control based off of inputs and parameters.
-    control(input, output);
+    // Count the heap allocations of the control law and of publishing its outputs separately, since the middleware
+    // may allocate where the controller does not.
+    uint64_t control_start = thread_allocation_count();
+    times.control_start = std::chrono::steady_clock::now();
+
+    // Control based off of inputs and parameters. The core reads the same snapshot, and applies any parameter changes
+    // on this thread first, so its cached values never change during a tick.
+    core_->update(input, output, *param_snapshot_);
+    times.control_end = std::chrono::steady_clock::now();
+
+    // The recorder logs the outputs of the law, before they are converted to pwm.
+    Output law_output = output;
 
     // Convert control outputs to pwm.
     convert_to_pwm(output);
+    times.pwm_end = std::chrono::steady_clock::now();
 
-    rosflight_msgs::msg::Command actuators;
+    uint64_t publish_start = thread_allocation_count();
 
     // Find the current time, and save as a timestamp.
     rclcpp::Time now = this->get_clock()->now();
 
-    // Attach the timestamp.
-    actuators.header.stamp = now;
+    // Publish actuators. The message is filled in middleware loaned memory when the middleware supports it.
+    actuators_pub_.publish([&](rosflight_msgs::msg::Command & actuators) {
+      // Attach the timestamp.
+      actuators.header.stamp = now;
 
-    // Do not ignore any of the actuators.
-    actuators.ignore = 0;
+      // Do not ignore any of the actuators.
+      actuators.ignore = 0;
 
-    // Indicate that commands are for the actuators directly.
-    actuators.mode = rosflight_msgs::msg::Command::MODE_PASS_THROUGH;
+      // Indicate that commands are for the actuators directly.
+      actuators.mode = rosflight_msgs::msg::Command::MODE_PASS_THROUGH;
 
-    // Package control efforts. If the output is infinite replace with 0.
-    actuators.x = (std::isfinite(output.delta_a)) ? output.delta_a : 0.0f;
-    actuators.y = (std::isfinite(output.delta_e)) ? output.delta_e : 0.0f;
-    actuators.z = (std::isfinite(output.delta_r)) ? output.delta_r : 0.0f;
-    actuators.f = (std::isfinite(output.delta_t)) ? output.delta_t : 0.0f;
-
-    // Publish actuators.
-    actuators_pub_->publish(actuators);
+      // Package control efforts. If the output is infinite replace with 0.
+      actuators.x = (std::isfinite(output.delta_a)) ? output.delta_a : 0.0f;
+      actuators.y = (std::isfinite(output.delta_e)) ? output.delta_e : 0.0f;
+      actuators.z = (std::isfinite(output.delta_r)) ? output.delta_r : 0.0f;
+      actuators.f = (std::isfinite(output.delta_t)) ? output.delta_t : 0.0f;
+    });
 
     // Publish the current control values
-    rosplane_msgs::msg::ControllerInternals controller_internals;
-    controller_internals.header.stamp = now;
-    controller_internals.phi_c = output.phi_c;
-    controller_internals.theta_c = output.theta_c;
-    switch (output.current_zone) {
-      case AltZones::TAKE_OFF:
-        controller_internals.alt_zone = controller_internals.ZONE_TAKE_OFF;
-        break;
-      case AltZones::CLIMB:
-        controller_internals.alt_zone = controller_internals.ZONE_CLIMB;
-        break;
-      case AltZones::ALTITUDE_HOLD:
-        controller_internals.alt_zone = controller_internals.ZONE_ALTITUDE_HOLD;
-        break;
-      default:
-        break;
+    controller_internals_pub_.publish(
+      [&](rosplane_msgs::msg::ControllerInternals & controller_internals) {
+        controller_internals.header.stamp = now;
+        controller_internals.phi_c = output.phi_c;
+        controller_internals.theta_c = output.theta_c;
+        switch (output.current_zone) {
+          case AltZones::TAKE_OFF:
+            controller_internals.alt_zone = controller_internals.ZONE_TAKE_OFF;
+            break;
+          case AltZones::CLIMB:
+            controller_internals.alt_zone = controller_internals.ZONE_CLIMB;
+            break;
+          case AltZones::ALTITUDE_HOLD:
+            controller_internals.alt_zone = controller_internals.ZONE_ALTITUDE_HOLD;
+            break;
+          default:
+            break;
+        }
+      });
+
+    after_control();
+
+    times.publish_end = std::chrono::steady_clock::now();
+    times.controlled = true;
+
+    stamps.command_ns = now.nanoseconds();
+    pipeline_latency_.record(stamps);
+
+    if (recorder_) {
+      TickRecord record{};
+      record.tick_ns = stamps.tick_ns;
+      record.param_hash = param_snapshot_->hash();
+      record.input = input;
+      record.output = law_output;
+      recorder_->record(record);
     }
-    controller_internals_pub_->publish(controller_internals);
+
+    record_allocations(publish_start - control_start, thread_allocation_count() - publish_start);
   }
+
+  record_timing(times);
 }
 
 rcl_interfaces::msg::SetParametersResult
@@ -155,9 +446,12 @@ ControllerBase::parametersCallback(const std::vector<rclcpp::Parameter> & parame
     result.reason = "success";
   }
 
-  if (params_initialized_ && success) {
-    std::chrono::microseconds curr_period = std::chrono::microseconds(
-      static_cast<long long>(1.0 / params_.get_double("controller_output_frequency") * 1'000'000));
+  // The callbacks triggered by a commit's declarations do not change any values.
+  if (params_initialized_ && success && !params_.committing()) {
+    // Let the core refresh any cached parameter values, at the start of the next tick.
+    core_->notify_parameters_changed();
+
+    std::chrono::microseconds curr_period = control_timer_period();
     if (timer_period_ != curr_period) {
       timer_->cancel();
       set_timer();
@@ -167,24 +461,267 @@ ControllerBase::parametersCallback(const std::vector<rclcpp::Parameter> & parame
   return result;
 }
 
-void ControllerBase::set_timer()
+std::chrono::microseconds ControllerBase::control_timer_period()
 {
+  double period = state_triggered_ ? params_.get_double("control_watchdog_timeout")
+                                   : 1.0 / params_.get_double("controller_output_frequency");
+  return std::chrono::microseconds(static_cast<long long>(period * 1'000'000));
+}
+
+void ControllerBase::start_recorder()
+{
+  // For readability, declare parameters here that will be used in this function
+  std::string directory = params_.get_string("recorder_directory");
+
+  // Name the log after the wall clock time, so every run gets its own.
+  std::time_t wall_time = std::time(nullptr);
+  std::tm local_time;
+  localtime_r(&wall_time, &local_time);
+  char name[64];
+  std::strftime(name, sizeof(name), "controller_%Y%m%d_%H%M%S.rlog", &local_time);
+  std::string path = directory + "/" + name;
+
+  auto recorder = std::make_unique<TickRecorder>();
+  std::string error;
+  if (!recorder->start(path, tick_record_schema(), error)) {
+    RCLCPP_ERROR(this->get_logger(), "Flight recorder disabled: %s", error.c_str());
+    return;
+  }
+
+  recorder_ = std::move(recorder);
+  RCLCPP_INFO(this->get_logger(), "Recording control ticks to %s.", path.c_str());
+}
+
+void ControllerBase::predict_state(const StateSnapshot & state, int64_t tick_ns, Input & input)
+{
+  // For readability, declare parameters here that will be used in this function
+  double lead = param_snapshot_->get(state_prediction_lead_param_);
+  double max_age = param_snapshot_->get(state_prediction_max_age_param_);
+
+  if (state.stamp_ns == 0) {
+    return;
+  }
+
+  float dt = static_cast<float>(std::clamp((tick_ns - state.stamp_ns) * 1e-9 + lead, 0.0, max_age));
+
+  // Attitude kinematics with the body rates held. The horizon is a few estimator periods, short enough for one Euler
+  // step. The course turns with the heading, which holds while the wind is steady.
+  float sin_phi = std::sin(input.phi);
+  float cos_phi = std::cos(input.phi);
+  float cos_theta = std::cos(input.theta);
+  float turn = input.q * sin_phi + input.r * cos_phi;
+  float phi_dot = input.p + turn * std::tan(input.theta);
+  float theta_dot = input.q * cos_phi - input.r * sin_phi;
+  float chi_dot = turn / cos_theta;
+
+  // Climb rate from the air relative body velocity (va cos(alpha), 0, va sin(alpha)), neglecting sideslip.
+  float h_dot = input.va
+    * (std::cos(state.alpha) * std::sin(input.theta)
+       - std::sin(state.alpha) * cos_theta * cos_phi);
+
+  input.phi += phi_dot * dt;
+  input.theta += theta_dot * dt;
+  input.chi += chi_dot * dt;
+  input.h += h_dot * dt;
+  input.va += state.va_rate * dt;
+}
+
+void ControllerBase::record_timing(const TickTimes & times)
+{
+  using us = std::chrono::duration<double, std::micro>;
+
+  double nominal_us = 1'000'000.0 / param_snapshot_->get(controller_output_frequency_param_);
+  bool missed = false;
+
+  // The period is only fixed when the timer runs the control loop.
+  if (!state_triggered_ && times.previous_start != std::chrono::steady_clock::time_point()) {
+    double period_us = us(times.start - times.previous_start).count();
+    period_jitter_hist_.record(std::abs(period_us - nominal_us));
+
+    // Starting a whole period late means a tick was skipped.
+    missed = period_us > 2.0 * nominal_us;
+  }
+
+  if (times.controlled) {
+    double tick_us = us(times.publish_end - times.start).count();
+    control_hist_.record(us(times.control_end - times.control_start).count());
+    convert_to_pwm_hist_.record(us(times.pwm_end - times.control_end).count());
+    publish_hist_.record(us(times.publish_end - times.pwm_end).count());
+    tick_hist_.record(tick_us);
+    missed = missed || tick_us > nominal_us;
+  }
+
+  if (times.state_received != std::chrono::steady_clock::time_point()) {
+    state_age_hist_.record(us(times.start - times.state_received).count());
+  }
+
+  timing_ticks_++;
+  if (missed) {
+    missed_deadlines_++;
+  }
+
+  // Summarize about once a second.
+  if (timing_window_start_ == std::chrono::steady_clock::time_point()) {
+    timing_window_start_ = times.start;
+  }
+  if (times.start - timing_window_start_ < 1s) {
+    return;
+  }
+
+  auto summarize = [](LatencyHistogram<24> & histogram) {
+    StageSummary stage;
+    stage.p50_us = histogram.percentile(0.5);
+    stage.p99_us = histogram.percentile(0.99);
+    stage.max_us = histogram.max();
+    histogram.reset();
+    return stage;
+  };
+
+  TimingSummary summary;
+  summary.window = ++timing_window_;
+  summary.ticks = timing_ticks_;
+  summary.missed_deadlines = missed_deadlines_;
+  summary.period_jitter = summarize(period_jitter_hist_);
+  summary.control = summarize(control_hist_);
+  summary.convert_to_pwm = summarize(convert_to_pwm_hist_);
+  summary.publish = summarize(publish_hist_);
+  summary.tick = summarize(tick_hist_);
+  summary.state_age = summarize(state_age_hist_);
+
+  // The pipeline latency is stored first, so it is ready when the timer sees the new timing window.
+  pipeline_latency_.summarize();
+  timing_summary_.store(summary);
+
+  timing_ticks_ = 0;
+  missed_deadlines_ = 0;
+  timing_window_start_ = times.start;
+}
+
+void ControllerBase::publish_timing()
+{
+  TimingSummary summary = timing_summary_.load();
+  if (summary.window == published_timing_window_) {
+    return;
+  }
+  published_timing_window_ = summary.window;
+
+  auto stage = [](const StageSummary & summary) {
+    lqr_srvs::msg::LatencySummary latency;
+    latency.p50_us = summary.p50_us;
+    latency.p99_us = summary.p99_us;
+    latency.max_us = summary.max_us;
+    return latency;
+  };
+
+  lqr_srvs::msg::ControlLoopTiming timing;
+  timing.header.stamp = this->get_clock()->now();
+  timing.ticks = summary.ticks;
+  timing.missed_deadlines = summary.missed_deadlines;
+  timing.period_jitter = stage(summary.period_jitter);
+  timing.control = stage(summary.control);
+  timing.convert_to_pwm = stage(summary.convert_to_pwm);
+  timing.publish = stage(summary.publish);
+  timing.tick = stage(summary.tick);
+  timing.state_age = stage(summary.state_age);
+  timing_pub_->publish(timing);
+
+  PipelineLatencySummary latency_summary = pipeline_latency_.summary();
+  auto pipeline_stage = [&](PipelineStage index) {
+    lqr_srvs::msg::LatencySummary latency;
+    latency.p50_us = latency_summary.stages[index].p50_us;
+    latency.p99_us = latency_summary.stages[index].p99_us;
+    latency.max_us = latency_summary.stages[index].max_us;
+    return latency;
+  };
+
+  lqr_srvs::msg::PipelineLatency latency;
+  latency.header.stamp = timing.header.stamp;
+  latency.samples = latency_summary.samples;
+  latency.invalid = latency_summary.invalid;
+  latency.estimation = pipeline_stage(ESTIMATION);
+  latency.state_transport = pipeline_stage(STATE_TRANSPORT);
+  latency.state_queue = pipeline_stage(STATE_QUEUE);
+  latency.control = pipeline_stage(CONTROL);
+  latency.end_to_end = pipeline_stage(END_TO_END);
+  latency_pub_->publish(latency);
+}
+
+void ControllerBase::record_allocations(uint64_t control, uint64_t publish)
+{
+  // The first ticks may allocate, while the controller fills its caches.
+  if (control_ticks_ < ALLOCATION_WARMUP_TICKS) {
+    control_ticks_++;
+    return;
+  }
+
+  if (control != 0) {
+    control_allocations_.fetch_add(control, std::memory_order_relaxed);
+  }
+  if (publish != 0) {
+    publish_allocations_.fetch_add(publish, std::memory_order_relaxed);
+  }
+}
+
+void ControllerBase::report_control_loop()
+{
+  uint64_t control_allocations = control_allocations_.exchange(0, std::memory_order_relaxed);
+  if (control_allocations != 0) {
+    RCLCPP_ERROR(this->get_logger(),
+                 "The control law made %lu heap allocations since the last report, it must not "
+                 "allocate once warmed up.",
+                 static_cast<unsigned long>(control_allocations));
+  }
+
+  uint64_t publish_allocations = publish_allocations_.exchange(0, std::memory_order_relaxed);
+  if (publish_allocations != 0) {
+    RCLCPP_WARN(this->get_logger(),
+                "Publishing the control outputs made %lu heap allocations since the last report.",
+                static_cast<unsigned long>(publish_allocations));
+  }
 
-  double frequency = params_.get_double("controller_output_frequency");
-  timer_period_ = std::chrono::microseconds(static_cast<long long>(1.0 / frequency * 1'000'000));
+  uint64_t dropped_records = recorder_ ? recorder_->take_dropped() : 0;
+  if (dropped_records != 0) {
+    RCLCPP_WARN(this->get_logger(),
+                "The flight recorder dropped %lu records since the last report.",
+                static_cast<unsigned long>(dropped_records));
+  }
+
+  TimingSummary summary = timing_summary_.load();
+  if (state_triggered_ || summary.ticks == 0) {
+    return;
+  }
 
-  // Set timer to trigger bound callback (actuator_controls_publish) at the given periodicity.
-  timer_ = this->create_wall_timer(timer_period_,
-                                   std::bind(&ControllerBase::actuator_controls_publish, this));
+  RCLCPP_INFO(this->get_logger(),
+              "Control period jitter over %lu ticks: p50 %.1f us, p99 %.1f us, max %.1f us.",
+              static_cast<unsigned long>(summary.ticks), summary.period_jitter.p50_us,
+              summary.period_jitter.p99_us, summary.period_jitter.max_us);
+}
+
+void ControllerBase::set_timer()
+{
+
+  timer_period_ = control_timer_period();
+
+  // Set timer to trigger bound callback (actuator_controls_publish) at the given periodicity. In the state triggered
+  // mode the timer is only the watchdog.
+  if (state_triggered_) {
+    timer_ = this->create_wall_timer(
+      timer_period_, std::bind(&ControllerBase::watchdog_callback, this), control_callback_group_);
+  } else {
+    timer_ =
+      this->create_wall_timer(timer_period_,
+                              std::bind(&ControllerBase::actuator_controls_publish, this),
+                              control_callback_group_);
+  }
 }
 
 void ControllerBase::convert_to_pwm(Output & output)
 {
 
   // Assign parameters from parameters object
-  double pwm_rad_e = params_.get_double("pwm_rad_e");
-  double pwm_rad_a = params_.get_double("pwm_rad_a");
-  double pwm_rad_r = params_.get_double("pwm_rad_r");
+  double pwm_rad_e = param_snapshot_->get(pwm_rad_e_param_);
+  double pwm_rad_a = param_snapshot_->get(pwm_rad_a_param_);
+  double pwm_rad_r = param_snapshot_->get(pwm_rad_r_param_);
 
   // Multiply each control effort (in radians) by a scaling factor to a pwm.
   // TODO investigate why this is named "pwm". The actual scaling to pwm happens in rosflight_io.
@@ -194,16 +731,3 @@ void ControllerBase::convert_to_pwm(Output & output)
 }
 
 } // namespace rosplane
-
-int main(int argc, char * argv[])
-{
-
-  // Initialize ROS2 and then begin to spin control node.
-  rclcpp::init(argc, argv);
-
-  auto node = std::make_shared<rosplane::PythonControllerInterface>();
-  RCLCPP_INFO_STREAM(node->get_logger(), "Invalid control type, using default control.");
-  rclcpp::spin(node);
-
-  return 0;
-}
@@ -0,0 +1,145 @@
+#include <iostream>
+
+#include <yaml-cpp/yaml.h>
+
+#include "controller_core.hpp"
+
+namespace rosplane
+{
+
+namespace
+{
+
+/**
+ * Converts a YAML parameter value to the type of the parameter it sets.
+ * @param node The YAML value.
+ * @param type_of A value of the type of the parameter.
+ * @return The converted value.
+ * @throws YAML::Exception if the value cannot be converted.
+ */
+ParamValue yaml_value(const YAML::Node & node, const ParamValue & type_of)
+{
+  switch (type_of.index()) {
+    case 0:
+      return node.as<double>();
+    case 1:
+      return node.as<bool>();
+    case 2:
+      return node.as<int64_t>();
+    default:
+      return node.as<std::string>();
+  }
+}
+
+/**
+ * Collects the values of the parameters the store has declared from a ros__parameters map. Nested maps are flattened
+ * into dotted names, as ROS2 does.
+ * @param node The map.
+ * @param prefix Name of the map, empty at the top.
+ * @param store The store the values are for.
+ * @param values The names and values collected.
+ */
+void collect_parameters(const YAML::Node & node, const std::string & prefix,
+                        const ParamStore & store,
+                        std::vector<std::pair<std::string, ParamValue>> & values)
+{
+  for (const auto & entry : node) {
+    std::string name = prefix + entry.first.as<std::string>();
+    if (entry.second.IsMap()) {
+      collect_parameters(entry.second, name + ".", store, values);
+      continue;
+    }
+
+    ParamValue current;
+    if (store.value(name, current)) {
+      values.emplace_back(name, yaml_value(entry.second, current));
+    }
+  }
+}
+
+} // namespace
+
+ControllerCore::ControllerCore()
+    : param_snapshot_(nullptr)
+    , parameters_changed_pending_(false)
+{
+  // Declare param and set the default value. Every law runs once per tick at this rate.
+  controller_output_frequency_param_ = params_.declare_double("controller_output_frequency", 100.0);
+  params_.commit();
+}
+
+void ControllerCore::update(const Input & input, Output & output)
+{
+  update(input, output, params_.control_snapshot());
+}
+
+void ControllerCore::update(const Input & input, Output & output, const ParamSnapshot & snapshot)
+{
+  param_snapshot_ = &snapshot;
+
+  // Apply parameter changes on this thread, so the cached values of the laws never change during a tick.
+  if (parameters_changed_pending_.exchange(false, std::memory_order_acquire)) {
+    parameters_changed();
+  }
+
+  control(input, output);
+}
+
+bool ControllerCore::set_parameters(const std::vector<std::pair<std::string, ParamValue>> & values,
+                                    std::string & error)
+{
+  if (!params_.set(values, error)) {
+    return false;
+  }
+  notify_parameters_changed();
+  return true;
+}
+
+bool ControllerCore::load_parameters(const std::string & path, std::string & error)
+{
+  std::vector<std::pair<std::string, ParamValue>> values;
+  try {
+    YAML::Node file = YAML::LoadFile(path);
+    for (const auto & node : file) {
+      if (node.second["ros__parameters"]) {
+        collect_parameters(node.second["ros__parameters"], "", params_, values);
+      }
+    }
+  } catch (YAML::Exception & e) {
+    error = "Unable to read parameters from " + path + ": " + e.what();
+    return false;
+  }
+
+  return set_parameters(values, error);
+}
+
+void ControllerCore::notify_parameters_changed()
+{
+  std::lock_guard<std::mutex> lock(prepare_mutex_);
+  prepare_parameters();
+  parameters_changed_pending_.store(true, std::memory_order_release);
+}
+
+void ControllerCore::apply_parameters()
+{
+  {
+    std::lock_guard<std::mutex> lock(prepare_mutex_);
+    prepare_parameters();
+  }
+  parameters_changed_pending_.store(false, std::memory_order_relaxed);
+  param_snapshot_ = &params_.control_snapshot();
+  parameters_changed();
+}
+
+void ControllerCore::set_log_handler(LogHandler handler) { log_handler_ = std::move(handler); }
+
+void ControllerCore::log(LogLevel level, const char * message) const
+{
+  if (log_handler_) {
+    log_handler_(level, message);
+  } else if (level != LogLevel::INFO) {
+    std::cerr << message << std::endl;
+  }
+}
+
+} // namespace rosplane
@@ -9,19 +9,17 @@ ControllerStateMachine::ControllerStateMachine()
   // Initialize controller in take_off zone.
   current_zone_ = AltZones::TAKE_OFF;
 
-  // Declare parameters associated with this controller, controller_state_machine
+  // Declare parameters associated with this controller, controller_state_machine. They are not needed until the
+  // control loop runs, so they are committed together with the child's parameters.
   declare_parameters();
-
-  // Set parameters according to the parameters in the launch file, otherwise use the default values
-  params_.set_parameters();
 }
 
 void ControllerStateMachine::control(const Input & input, Output & output)
 {
 
   // For readability, declare parameters that will be used in this controller
-  double alt_toz = params_.get_double("alt_toz");
-  double alt_hz = params_.get_double("alt_hz");
+  double alt_toz = param_snapshot_->get(alt_toz_param_);
+  double alt_hz = param_snapshot_->get(alt_hz_param_);
 
   // This state machine changes the controls used based on the zone of flight path the aircraft is currently on.
   switch (current_zone_) {
@@ -37,7 +35,7 @@ void ControllerStateMachine::control(const Input & input, Output & output)
         take_off_exit();
 
         // Set zone to climb.
-        RCLCPP_INFO(this->get_logger(), "climb");
+        log(LogLevel::INFO, "climb");
         current_zone_ = AltZones::CLIMB;
       }
       break;
@@ -53,7 +51,7 @@ void ControllerStateMachine::control(const Input & input, Output & output)
         climb_exit();
 
         // Set the zone to altitude hold if we have enough altitude and reset errors, integrators and derivatives.
-        RCLCPP_INFO(this->get_logger(), "hold");
+        log(LogLevel::INFO, "hold");
         current_zone_ = AltZones::ALTITUDE_HOLD;
 
       } else if (input.h <= alt_toz) {
@@ -62,7 +60,7 @@ void ControllerStateMachine::control(const Input & input, Output & output)
         climb_exit();
 
         // Set to take off if too close to the ground.
-        RCLCPP_INFO(this->get_logger(), "takeoff");
+        log(LogLevel::INFO, "takeoff");
         current_zone_ = AltZones::TAKE_OFF;
       }
       break;
@@ -78,7 +76,7 @@ void ControllerStateMachine::control(const Input & input, Output & output)
         altitude_hold_exit();
 
         // Set the control zone back to take off to regain altitude. and reset integral for course.
-        RCLCPP_INFO(this->get_logger(), "take off");
+        log(LogLevel::INFO, "take off");
         current_zone_ = AltZones::TAKE_OFF;
       }
       break;
@@ -92,9 +90,9 @@ void ControllerStateMachine::control(const Input & input, Output & output)
 
 void ControllerStateMachine::declare_parameters()
 {
-  // Declare param with ROS2 and set the default value.
-  params_.declare_double("alt_toz", 5.0);
-  params_.declare_double("alt_hz", 10.0);
+  // Declare param and set the default value.
+  alt_toz_param_ = params_.declare_double("alt_toz", 5.0);
+  alt_hz_param_ = params_.declare_double("alt_hz", 10.0);
 }
 
 } // namespace rosplane
\ No newline at end of file
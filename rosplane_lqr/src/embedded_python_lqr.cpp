@@ -0,0 +1,48 @@
+#include "embedded_python_lqr.hpp"
+
+namespace py = pybind11;
+
+namespace rosplane
+{
+
+EmbeddedPythonLqr::EmbeddedPythonLqr(const std::string & module_name,
+                                     const std::string & function_name,
+                                     const std::string & module_path)
+{
+  input_.fill(0.0f);
+  output_.fill(0.0f);
+
+  interpreter_ = std::make_unique<py::scoped_interpreter>();
+
+  if (!module_path.empty()) {
+    py::module_::import("sys").attr("path").attr("insert")(0, module_path);
+  }
+
+  function_ = py::module_::import(module_name.c_str()).attr(function_name.c_str());
+
+  // The capsules do not own the memory, they only tie the arrays to this object so numpy does not copy the data.
+  py::capsule no_free(this, [](void *) {});
+  input_view_ = py::array_t<float>({INPUT_SIZE}, {sizeof(float)}, input_.data(), no_free);
+  output_view_ = py::array_t<float>({OUTPUT_SIZE}, {sizeof(float)}, output_.data(), no_free);
+
+  // The control law should not be able to change the inputs.
+  input_view_.attr("setflags")(py::arg("write") = false);
+
+  gil_release_ = std::make_unique<py::gil_scoped_release>();
+}
+
+bool EmbeddedPythonLqr::evaluate(std::string & error)
+{
+  py::gil_scoped_acquire gil;
+
+  try {
+    function_(input_view_, output_view_);
+  } catch (py::error_already_set & e) {
+    error = e.what();
+    return false;
+  }
+
+  return true;
+}
+
+} // namespace rosplane
@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "explicit_mpc.hpp"
+
+namespace rosplane
+{
+
+namespace
+{
+
+template<typename T>
+T read_value(std::ifstream & file)
+{
+  T value;
+  if (!file.read(reinterpret_cast<char *>(&value), sizeof(T))) {
+    throw std::runtime_error("Explicit MPC tree file is truncated.");
+  }
+  return value;
+}
+
+template<typename Derived>
+void read_row_major(std::ifstream & file, Eigen::MatrixBase<Derived> & matrix)
+{
+  for (Eigen::Index i = 0; i < matrix.rows(); i++) {
+    for (Eigen::Index j = 0; j < matrix.cols(); j++) {
+      matrix(i, j) = read_value<float>(file);
+    }
+  }
+}
+
+} // namespace
+
+ExplicitMpc::ExplicitMpc()
+    : depth_(0)
+{}
+
+void ExplicitMpc::load(const std::string & filename)
+{
+  std::ifstream file(filename, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error("Unable to open explicit MPC tree file " + filename);
+  }
+
+  char magic[8];
+  if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, "RPEMPC1", 8) != 0) {
+    throw std::runtime_error(filename + " is not an explicit MPC tree file.");
+  }
+
+  uint32_t states = read_value<uint32_t>(file);
+  uint32_t inputs = read_value<uint32_t>(file);
+  uint32_t node_count = read_value<uint32_t>(file);
+  uint32_t leaf_count = read_value<uint32_t>(file);
+
+  if (states != 4 || inputs != 2) {
+    throw std::runtime_error(filename + " is not a four state, two input explicit MPC law.");
+  }
+  if (leaf_count == 0) {
+    throw std::runtime_error(filename + " has no regions.");
+  }
+
+  std::vector<Node> nodes(node_count);
+  for (uint32_t i = 0; i < node_count; i++) {
+    read_row_major(file, nodes[i].a);
+    nodes[i].b = read_value<float>(file);
+    nodes[i].left = read_value<int32_t>(file);
+    nodes[i].right = read_value<int32_t>(file);
+
+    for (int32_t child : {nodes[i].left, nodes[i].right}) {
+      bool valid_node = child >= 0 && static_cast<uint32_t>(child) > i && static_cast<uint32_t>(child) < node_count;
+      bool valid_leaf = child < 0 && static_cast<uint32_t>(-(child + 1)) < leaf_count;
+      if (!valid_node && !valid_leaf) {
+        throw std::runtime_error(filename + " has an invalid child index in node " + std::to_string(i));
+      }
+    }
+  }
+
+  std::vector<Leaf> leaves(leaf_count);
+  for (uint32_t i = 0; i < leaf_count; i++) {
+    read_row_major(file, leaves[i].F);
+    read_row_major(file, leaves[i].g);
+  }
+
+  // Children come after their parents, so one forward pass finds the depth of every node.
+  std::vector<uint32_t> node_depth(node_count, 0);
+  uint32_t depth = 0;
+  if (node_count > 0) {
+    node_depth[0] = 1;
+  }
+  for (uint32_t i = 0; i < node_count; i++) {
+    depth = std::max(depth, node_depth[i]);
+    for (int32_t child : {nodes[i].left, nodes[i].right}) {
+      if (child >= 0) {
+        node_depth[child] = std::max(node_depth[child], node_depth[i] + 1);
+      }
+    }
+  }
+
+  nodes_ = std::move(nodes);
+  leaves_ = std::move(leaves);
+  depth_ = depth;
+}
+
+Eigen::Vector2f ExplicitMpc::evaluate(const Eigen::Vector4f & x) const
+{
+  // A tree with a single region has no nodes.
+  int32_t index = nodes_.empty() ? -1 : 0;
+
+  while (index >= 0) {
+    const Node & node = nodes_[index];
+    index = node.a.dot(x) <= node.b ? node.left : node.right;
+  }
+
+  const Leaf & leaf = leaves_[-(index + 1)];
+  return leaf.F * x + leaf.g;
+}
+
+} // namespace rosplane
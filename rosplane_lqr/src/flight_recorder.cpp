@@ -0,0 +1,233 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "flight_recorder.hpp"
+
+namespace rosplane
+{
+
+namespace
+{
+
+constexpr char MAGIC[8] = {'R', 'P', 'L', 'Q', 'R', 'L', 'O', 'G'};
+constexpr uint32_t VERSION = 1;
+
+// The header fills the first page, so the data chunks are page aligned.
+constexpr std::size_t HEADER_SIZE = 4096;
+constexpr std::size_t FIELDS_OFFSET = 32;
+constexpr std::size_t FIELD_SIZE = 56;
+constexpr std::size_t FIELD_NAME_SIZE = 48;
+constexpr std::size_t RECORD_COUNT_OFFSET = 24;
+
+// The file grows a chunk at a time, so it is only resized every few seconds at kilohertz rates.
+constexpr std::size_t CHUNK_SIZE = 16 * 1024 * 1024;
+
+template<typename T>
+void put(uint8_t * destination, T value)
+{
+  std::memcpy(destination, &value, sizeof(T));
+}
+
+template<typename T>
+T get(const uint8_t * source)
+{
+  T value;
+  std::memcpy(&value, source, sizeof(T));
+  return value;
+}
+
+} // namespace
+
+RecordLog::RecordLog()
+    : fd_(-1)
+    , header_(nullptr)
+    , chunk_(nullptr)
+    , chunk_index_(0)
+    , chunk_used_(0)
+    , record_size_(0)
+    , record_count_(0)
+{}
+
+RecordLog::~RecordLog() { close(); }
+
+bool RecordLog::open(const std::string & path, const std::vector<RecordField> & schema,
+                     std::size_t record_size, std::string & error)
+{
+  if (FIELDS_OFFSET + schema.size() * FIELD_SIZE > HEADER_SIZE) {
+    error = "The record schema has too many fields for the log header.";
+    return false;
+  }
+
+  fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd_ < 0) {
+    error = "Unable to create " + path + ": " + std::strerror(errno);
+    return false;
+  }
+
+  if (::ftruncate(fd_, HEADER_SIZE) != 0) {
+    error = "Unable to size " + path + ": " + std::strerror(errno);
+    close();
+    return false;
+  }
+
+  void * header = ::mmap(nullptr, HEADER_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (header == MAP_FAILED) {
+    error = "Unable to map " + path + ": " + std::strerror(errno);
+    close();
+    return false;
+  }
+  header_ = static_cast<uint8_t *>(header);
+
+  std::memcpy(header_, MAGIC, sizeof(MAGIC));
+  put<uint32_t>(header_ + 8, VERSION);
+  put<uint32_t>(header_ + 12, static_cast<uint32_t>(record_size));
+  put<uint32_t>(header_ + 16, static_cast<uint32_t>(schema.size()));
+  put<uint32_t>(header_ + 20, static_cast<uint32_t>(HEADER_SIZE));
+  put<uint64_t>(header_ + RECORD_COUNT_OFFSET, 0);
+
+  for (std::size_t i = 0; i < schema.size(); i++) {
+    uint8_t * field = header_ + FIELDS_OFFSET + i * FIELD_SIZE;
+    std::size_t name_size = std::min(schema[i].name.size(), FIELD_NAME_SIZE - 1);
+    std::memcpy(field, schema[i].name.data(), name_size);
+    put<uint32_t>(field + FIELD_NAME_SIZE, static_cast<uint32_t>(schema[i].type));
+    put<uint32_t>(field + FIELD_NAME_SIZE + 4, schema[i].offset);
+  }
+
+  record_size_ = record_size;
+  record_count_ = 0;
+  chunk_index_ = 0;
+  chunk_used_ = 0;
+  if (!map_next_chunk()) {
+    error = "Unable to map the data of " + path + ": " + std::strerror(errno);
+    close();
+    return false;
+  }
+  return true;
+}
+
+bool RecordLog::map_next_chunk()
+{
+  if (chunk_ != nullptr) {
+    ::munmap(chunk_, CHUNK_SIZE);
+    chunk_ = nullptr;
+    chunk_index_++;
+  }
+
+  off_t offset = static_cast<off_t>(HEADER_SIZE + chunk_index_ * CHUNK_SIZE);
+  if (::ftruncate(fd_, offset + static_cast<off_t>(CHUNK_SIZE)) != 0) {
+    return false;
+  }
+
+  void * chunk = ::mmap(nullptr, CHUNK_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, offset);
+  if (chunk == MAP_FAILED) {
+    return false;
+  }
+
+  chunk_ = static_cast<uint8_t *>(chunk);
+  chunk_used_ = 0;
+  return true;
+}
+
+bool RecordLog::append(const void * records, std::size_t count)
+{
+  const uint8_t * bytes = static_cast<const uint8_t *>(records);
+  std::size_t remaining = count * record_size_;
+
+  // Records may straddle two chunks.
+  while (remaining > 0) {
+    if (chunk_used_ == CHUNK_SIZE && !map_next_chunk()) {
+      close();
+      return false;
+    }
+
+    std::size_t size = std::min(remaining, CHUNK_SIZE - chunk_used_);
+    std::memcpy(chunk_ + chunk_used_, bytes, size);
+    chunk_used_ += size;
+    bytes += size;
+    remaining -= size;
+  }
+
+  // The count is written after the records, so a reader never sees a count past the records.
+  record_count_ += count;
+  put<uint64_t>(header_ + RECORD_COUNT_OFFSET, record_count_);
+  return true;
+}
+
+void RecordLog::close()
+{
+  if (fd_ < 0) {
+    return;
+  }
+
+  if (chunk_ != nullptr) {
+    ::munmap(chunk_, CHUNK_SIZE);
+    chunk_ = nullptr;
+  }
+  if (header_ != nullptr) {
+    ::munmap(header_, HEADER_SIZE);
+    header_ = nullptr;
+
+    // Trim the unused end of the last chunk.
+    if (::ftruncate(fd_, static_cast<off_t>(HEADER_SIZE + record_count_ * record_size_)) != 0) {
+      // The log is still readable, its record count bounds the records.
+    }
+  }
+
+  ::close(fd_);
+  fd_ = -1;
+}
+
+bool read_record_log(const std::string & path, std::vector<RecordField> & schema,
+                     std::size_t & record_size, std::vector<uint8_t> & records, std::string & error)
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    error = "Unable to open " + path + ".";
+    return false;
+  }
+  std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)),
+                            std::istreambuf_iterator<char>());
+
+  if (data.size() < HEADER_SIZE || std::memcmp(data.data(), MAGIC, sizeof(MAGIC)) != 0) {
+    error = path + " is not a flight recorder log.";
+    return false;
+  }
+  if (get<uint32_t>(&data[8]) != VERSION) {
+    error = path + " has an unsupported log version.";
+    return false;
+  }
+
+  record_size = get<uint32_t>(&data[12]);
+  uint32_t field_count = get<uint32_t>(&data[16]);
+  std::size_t data_offset = get<uint32_t>(&data[20]);
+  uint64_t record_count = get<uint64_t>(&data[RECORD_COUNT_OFFSET]);
+  if (record_size == 0 || data_offset > data.size()
+      || FIELDS_OFFSET + field_count * FIELD_SIZE > data_offset) {
+    error = path + " has a corrupt header.";
+    return false;
+  }
+
+  schema.clear();
+  for (std::size_t i = 0; i < field_count; i++) {
+    const uint8_t * field = &data[FIELDS_OFFSET + i * FIELD_SIZE];
+    const char * name = reinterpret_cast<const char *>(field);
+    schema.push_back({std::string(name, strnlen(name, FIELD_NAME_SIZE)),
+                      static_cast<RecordFieldType>(get<uint32_t>(field + FIELD_NAME_SIZE)),
+                      get<uint32_t>(field + FIELD_NAME_SIZE + 4)});
+  }
+
+  // A log that was not closed may be shorter than its last count, or longer with an unused tail.
+  record_count = std::min<uint64_t>(record_count, (data.size() - data_offset) / record_size);
+  records.assign(data.begin() + data_offset,
+                 data.begin() + data_offset + record_count * record_size);
+  return true;
+}
+
+} // namespace rosplane
@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include <yaml-cpp/yaml.h>
+
+#include "gain_schedule.hpp"
+
+namespace rosplane
+{
+
+namespace
+{
+
+std::vector<float> read_breakpoints(const YAML::Node & node, const std::string & name)
+{
+  std::vector<float> breakpoints = node[name].as<std::vector<float>>();
+
+  if (breakpoints.empty()) {
+    throw std::runtime_error("Gain schedule has no " + name + " breakpoints.");
+  }
+  for (std::size_t i = 1; i < breakpoints.size(); i++) {
+    if (breakpoints[i] <= breakpoints[i - 1]) {
+      throw std::runtime_error("Gain schedule " + name + " breakpoints are not increasing.");
+    }
+  }
+
+  return breakpoints;
+}
+
+template<typename Derived>
+void read_row_major(const YAML::Node & node, const std::string & name,
+                    Eigen::MatrixBase<Derived> & matrix)
+{
+  std::vector<float> values = node[name].as<std::vector<float>>();
+
+  if (values.size() != static_cast<std::size_t>(matrix.size())) {
+    throw std::runtime_error("Gain schedule " + name + " has " + std::to_string(values.size())
+                             + " values, expected " + std::to_string(matrix.size()) + ".");
+  }
+
+  for (Eigen::Index i = 0; i < matrix.rows(); i++) {
+    for (Eigen::Index j = 0; j < matrix.cols(); j++) {
+      matrix(i, j) = values[i * matrix.cols() + j];
+    }
+  }
+}
+
+} // namespace
+
+void GainSchedule::load(const std::string & filename)
+{
+  YAML::Node schedule;
+  std::vector<float> va;
+  std::vector<float> h;
+  std::vector<LqrGains> blocks;
+
+  try {
+    schedule = YAML::LoadFile(filename);
+
+    va = read_breakpoints(schedule, "va");
+    h = read_breakpoints(schedule, "h");
+
+    const YAML::Node & points = schedule["points"];
+    if (!points.IsSequence() || points.size() != va.size() * h.size()) {
+      throw std::runtime_error("Gain schedule must have one point for each (va, h) pair.");
+    }
+
+    blocks.resize(points.size());
+    for (std::size_t i = 0; i < points.size(); i++) {
+      read_row_major(points[i], "k_lon", blocks[i].k_lon);
+      read_row_major(points[i], "k_lat", blocks[i].k_lat);
+      read_row_major(points[i], "u_trim", blocks[i].u_trim);
+    }
+  } catch (YAML::Exception & e) {
+    throw std::runtime_error("Unable to read gain schedule " + filename + ": " + e.what());
+  }
+
+  va_ = std::move(va);
+  h_ = std::move(h);
+  blocks_ = std::move(blocks);
+}
+
+void GainSchedule::clear()
+{
+  va_.clear();
+  h_.clear();
+  blocks_.clear();
+}
+
+void GainSchedule::interpolate(float va, float h, LqrGains & gains) const
+{
+  std::size_t i;
+  std::size_t j;
+  float s;
+  float t;
+  locate(va_, va, i, s);
+  locate(h_, h, j, t);
+
+  // A single breakpoint in a dimension collapses the cell to that breakpoint.
+  std::size_t i1 = std::min(i + 1, va_.size() - 1);
+  std::size_t j1 = std::min(j + 1, h_.size() - 1);
+
+  const LqrGains & g00 = blocks_[i * h_.size() + j];
+  const LqrGains & g01 = blocks_[i * h_.size() + j1];
+  const LqrGains & g10 = blocks_[i1 * h_.size() + j];
+  const LqrGains & g11 = blocks_[i1 * h_.size() + j1];
+
+  float w00 = (1.0f - s) * (1.0f - t);
+  float w01 = (1.0f - s) * t;
+  float w10 = s * (1.0f - t);
+  float w11 = s * t;
+
+  gains.k_lon = w00 * g00.k_lon + w01 * g01.k_lon + w10 * g10.k_lon + w11 * g11.k_lon;
+  gains.k_lat = w00 * g00.k_lat + w01 * g01.k_lat + w10 * g10.k_lat + w11 * g11.k_lat;
+  gains.u_trim = w00 * g00.u_trim + w01 * g01.u_trim + w10 * g10.u_trim + w11 * g11.u_trim;
+}
+
+void GainSchedule::locate(const std::vector<float> & breakpoints, float value, std::size_t & index,
+                          float & fraction)
+{
+  // A non-finite value, such as a NaN state before the first estimate, fails every comparison, so it is clamped to the
+  // first breakpoint before the search can run off the end.
+  if (breakpoints.size() == 1 || !std::isfinite(value) || value <= breakpoints.front()) {
+    index = 0;
+    fraction = 0.0f;
+    return;
+  }
+  if (value >= breakpoints.back()) {
+    index = breakpoints.size() - 2;
+    fraction = 1.0f;
+    return;
+  }
+
+  // Index of the last breakpoint that is not above the value.
+  index = std::upper_bound(breakpoints.begin(), breakpoints.end(), value) - breakpoints.begin() - 1;
+  fraction = (value - breakpoints[index]) / (breakpoints[index + 1] - breakpoints[index]);
+}
+
+} // namespace rosplane
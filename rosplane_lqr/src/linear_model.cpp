@@ -0,0 +1,60 @@
+#include <unsupported/Eigen/MatrixFunctions>
+
+#include "linear_model.hpp"
+
+namespace rosplane
+{
+
+LinearModel longitudinal_model(const LinearModelCoefficients & coefficients)
+{
+  LinearModel model;
+
+  // States (va, theta, q, h), inputs (delta_e, delta_t).
+  model.A << -coefficients.a_v1, -coefficients.a_v3, 0.0, 0.0,
+    0.0, 0.0, 1.0, 0.0,
+    0.0, -coefficients.a_theta2, -coefficients.a_theta1, 0.0,
+    0.0, coefficients.va_trim, 0.0, 0.0;
+
+  model.B << 0.0, coefficients.a_v2,
+    0.0, 0.0,
+    coefficients.a_theta3, 0.0,
+    0.0, 0.0;
+
+  return model;
+}
+
+LinearModel lateral_model(const LinearModelCoefficients & coefficients)
+{
+  LinearModel model;
+
+  // States (phi, chi, p, r), inputs (delta_a, delta_r). The course follows the roll angle through a coordinated turn.
+  model.A << 0.0, 0.0, 1.0, 0.0,
+    coefficients.gravity / coefficients.va_trim, 0.0, 0.0, 0.0,
+    0.0, 0.0, -coefficients.a_phi1, 0.0,
+    0.0, 0.0, 0.0, -coefficients.a_r1;
+
+  model.B << 0.0, 0.0,
+    0.0, 0.0,
+    coefficients.a_phi2, 0.0,
+    0.0, coefficients.a_r2;
+
+  return model;
+}
+
+LinearModel discretize(const LinearModel & model, double Ts)
+{
+  // The exponential of [A B; 0 0] Ts holds the zero order hold discretization in its top block row.
+  Eigen::Matrix<double, 6, 6> augmented = Eigen::Matrix<double, 6, 6>::Zero();
+  augmented.topLeftCorner<4, 4>() = model.A * Ts;
+  augmented.topRightCorner<4, 2>() = model.B * Ts;
+
+  Eigen::Matrix<double, 6, 6> exponential = augmented.exp();
+
+  LinearModel discrete;
+  discrete.A = exponential.topLeftCorner<4, 4>();
+  discrete.B = exponential.topRightCorner<4, 2>();
+
+  return discrete;
+}
+
+} // namespace rosplane
@@ -0,0 +1,876 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+#include "lqr_controller.hpp"
+
+namespace rosplane
+{
+
+double wrap_within_180(double fixed_heading, double wrapped_heading)
+{
+  // wrapped_heading - number_of_times_to_wrap * 2pi
+  return wrapped_heading - floor((wrapped_heading - fixed_heading) / (2 * M_PI) + 0.5) * 2 * M_PI;
+}
+
+const char * lqr_backend_name(LqrBackend backend)
+{
+  switch (backend) {
+    case LqrBackend::NATIVE:
+      return "native";
+    case LqrBackend::EMBEDDED_PYTHON:
+      return "embedded_python";
+    case LqrBackend::SERVICE:
+      return "service";
+    case LqrBackend::EXPLICIT_MPC:
+      return "explicit_mpc";
+    case LqrBackend::LINEAR_MPC:
+      return "linear_mpc";
+  }
+  return "unknown";
+}
+
+LqrController::LqrController()
+    : config_(nullptr)
+    , tvlqr_(nullptr)
+    , tvlqr_tick_(0)
+    , tvlqr_step_(nullptr)
+    , have_path_(false)
+    , last_phi_(0.0)
+    , lqr_backend_(LqrBackend::NATIVE)
+    , config_ready_(nullptr)
+    , config_retired_(nullptr)
+    , service_(nullptr)
+    , sat_warned_(false)
+    , mpc_summary_{}
+    , mpc_summary_ready_(false)
+    , lqr_calls_(0)
+    , lqr_window_calls_(0)
+    , lqr_window_sum_us_(0.0)
+    , lqr_window_max_us_(0.0)
+    , lqr_last_call_us_(0.0)
+{
+  // Declare parameters associated with this controller, controller_state_machine
+  declare_parameters();
+  // Publish the default values. This also commits the declarations of controller_state_machine.
+  params_.commit();
+  // Parameters declared by the base classes are read every tick too.
+  tick_params_.alt_hz = params_.handle<double>("alt_hz");
+
+  // Cache the gains so the control loop does not need to look them up every tick.
+  apply_parameters();
+}
+
+LqrController::~LqrController()
+{
+  free_retired_configurations();
+  delete config_ready_.exchange(nullptr);
+  delete config_;
+}
+
+void LqrController::control(const Input & input, Output & output)
+{
+  // The plans are indexed by control tick, so the tick is counted in every zone.
+  tvlqr_ = config_->lqr_tracking ? tvlqr_planner_->latest() : nullptr;
+  tvlqr_step_ = tvlqr_ != nullptr ? tvlqr_->step(tvlqr_tick_) : nullptr;
+  tvlqr_tick_++;
+
+  ControllerStateMachine::control(input, output);
+}
+
+void LqrController::take_off(const Input & input, Output & output)
+{
+  // For readability, declare parameters here that will be used in this function
+  double cmd_takeoff_pitch = param_snapshot_->get(tick_params_.cmd_takeoff_pitch);
+  double max_takeoff_throttle = param_snapshot_->get(tick_params_.max_takeoff_throttle);
+  double max_t = param_snapshot_->get(tick_params_.max_t);
+
+  // Hold wings level and the take-off pitch. Altitude, airspeed and course errors are not regulated.
+  Reference reference;
+  reference.va = input.va;
+  reference.theta = cmd_takeoff_pitch * M_PI / 180.0;
+  reference.h = input.h;
+  reference.phi = 0.0;
+  reference.chi = input.chi;
+
+  // Run lateral and longitudinal controls.
+  lqr_control(input, reference, select_gains(config_->take_off_schedule, input), output);
+
+  output.delta_t = sat(max_takeoff_throttle, max_t, 0);
+}
+
+void LqrController::take_off_exit()
+{
+  // Put any code that should run as the airplane exits take off mode.
+  lon_integrator_.reset();
+  lat_integrator_.reset();
+}
+
+void LqrController::climb(const Input & input, Output & output)
+{
+  // For readability, declare parameters here that will be used in this function
+  double alt_hz = param_snapshot_->get(tick_params_.alt_hz);
+
+  // Climb to the commanded altitude at the commanded airspeed while keeping the wings level.
+  Reference reference;
+  reference.va = input.va_c;
+  reference.theta = 0.0;
+  reference.h = adjust_h_c(input.h_c, input.h, alt_hz);
+  reference.phi = 0.0;
+  reference.chi = input.chi;
+
+  // Run lateral and longitudinal controls.
+  lqr_control(input, reference, select_gains(config_->climb_schedule, input), output);
+}
+
+void LqrController::climb_exit()
+{
+  // Put any code that should run as the airplane exits take off mode.
+  lon_integrator_.reset();
+  lat_integrator_.reset();
+}
+
+void LqrController::altitude_hold(const Input & input, Output & output)
+{
+  // For readability, declare parameters here that will be used in this function
+  double alt_hz = param_snapshot_->get(tick_params_.alt_hz);
+
+  // Hold the commanded altitude, airspeed and course, using the feed forward roll for orbits. While rolling onto a new
+  // segment, track the roll the time-varying gains were planned about.
+  Reference reference;
+  reference.va = input.va_c;
+  reference.theta = 0.0;
+  reference.h = adjust_h_c(input.h_c, input.h, alt_hz);
+  reference.phi = tvlqr_step_ != nullptr ? tvlqr_step_->phi_ref : input.phi_ff;
+  reference.chi = input.chi_c;
+
+  // Run lateral and longitudinal controls.
+  const LqrGains & gains = select_gains(config_->altitude_hold_schedule, input);
+  lqr_control(input, reference, tracking_gains(gains), output);
+}
+
+void LqrController::altitude_hold_exit()
+{
+  lon_integrator_.reset();
+  lat_integrator_.reset();
+}
+
+void LqrController::lqr_control(const Input & input, const Reference & reference,
+                                const LqrGains & gains, Output & output)
+{
+  // For readability, declare parameters here that will be used in this function
+  double frequency = param_snapshot_->get(controller_output_frequency_param_);
+  KernelVector<4> max_rate(param_snapshot_->get(tick_params_.max_rate_e),
+                           param_snapshot_->get(tick_params_.max_rate_a),
+                           param_snapshot_->get(tick_params_.max_rate_r),
+                           param_snapshot_->get(tick_params_.max_rate_t));
+
+  last_phi_ = input.phi;
+
+  auto start = std::chrono::steady_clock::now();
+
+  bool computed = false;
+#ifdef ROSPLANE_LQR_EMBEDDED_PYTHON
+  if (lqr_backend_ == LqrBackend::EMBEDDED_PYTHON) {
+    computed = python_lqr_control(input, reference, output);
+  }
+#endif
+  if (lqr_backend_ == LqrBackend::SERVICE) {
+    computed = service_->evaluate(input, reference, gains, output);
+  }
+  if (lqr_backend_ == LqrBackend::EXPLICIT_MPC) {
+    explicit_mpc_control(input, reference, gains, output);
+    computed = true;
+  }
+  if (lqr_backend_ == LqrBackend::LINEAR_MPC) {
+    linear_mpc_control(input, reference, gains, output);
+    computed = true;
+  }
+
+  // Fall back on the native law if the selected backend could not produce an output, so the aircraft keeps flying.
+  if (!computed) {
+    native_lqr_control(input, reference, gains, output);
+  }
+
+  record_lqr_call(start);
+
+  KernelVector<4> lower;
+  KernelVector<4> upper;
+  actuator_limits(lower, upper);
+
+  KernelVector<4> u(output.delta_e, output.delta_a, output.delta_r, output.delta_t);
+  u = rate_limiter_.limit(saturate<4>(u, lower, upper), max_rate, 1.0 / frequency);
+
+  output.delta_e = u(0);
+  output.delta_a = u(1);
+  output.delta_r = u(2);
+  output.delta_t = u(3);
+
+  // Report the attitude the regulator is driving to as the commanded values.
+  output.theta_c = reference.theta;
+  output.phi_c = reference.phi;
+}
+
+void LqrController::state_errors(const Input & input, const Reference & reference,
+                                 Eigen::Vector4f & x_lon, Eigen::Vector4f & x_lat)
+{
+  x_lon << input.va - reference.va, input.theta - reference.theta, input.q, input.h - reference.h;
+  x_lat << input.phi - reference.phi, input.chi - wrap_within_180(input.chi, reference.chi),
+    input.p, input.r;
+}
+
+void LqrController::native_lqr_control(const Input & input, const Reference & reference,
+                                       const LqrGains & gains, Output & output)
+{
+  // For readability, declare parameters here that will be used in this function
+  double frequency = param_snapshot_->get(controller_output_frequency_param_);
+
+  Eigen::Vector4f x_lon;
+  Eigen::Vector4f x_lat;
+  state_errors(input, reference, x_lon, x_lat);
+
+  // u = u_trim - K (x - x_ref) - Ki z
+  KernelVector<2> trim_lon(gains.u_trim(0), gains.u_trim(3));
+  KernelVector<2> trim_lat(gains.u_trim(1), gains.u_trim(2));
+  KernelVector<2> u_lon =
+    lqr_feedback<4, 2>(gains.k_lon, x_lon, trim_lon) + lon_integrator_.feedback(config_->ki_lon);
+  KernelVector<2> u_lat =
+    lqr_feedback<4, 2>(gains.k_lat, x_lat, trim_lat) + lat_integrator_.feedback(config_->ki_lat);
+
+  output.delta_e = u_lon(0);
+  output.delta_a = u_lat(0);
+  output.delta_r = u_lat(1);
+  output.delta_t = u_lon(1);
+
+  // Hold each integrator while its inputs are saturated.
+  KernelVector<4> lower;
+  KernelVector<4> upper;
+  actuator_limits(lower, upper);
+  KernelVector<4> u(u_lon(0), u_lat(0), u_lat(1), u_lon(1));
+  Eigen::Array<bool, 4, 1> saturated =
+    (u.array() < lower.array()) || (u.array() > upper.array());
+
+  KernelMatrix<1, 4> integrate_h;
+  integrate_h << 0.0f, 0.0f, 0.0f, 1.0f;
+  KernelMatrix<1, 4> integrate_chi;
+  integrate_chi << 0.0f, 1.0f, 0.0f, 0.0f;
+
+  lon_integrator_.update(integrate_h, x_lon, 1.0 / frequency, saturated(0) || saturated(3));
+  lat_integrator_.update(integrate_chi, x_lat, 1.0 / frequency, saturated(1) || saturated(2));
+}
+
+void LqrController::actuator_limits(KernelVector<4> & lower, KernelVector<4> & upper)
+{
+  // For readability, declare parameters here that will be used in this function
+  double max_e = param_snapshot_->get(tick_params_.max_e);
+  double max_a = param_snapshot_->get(tick_params_.max_a);
+  double max_r = param_snapshot_->get(tick_params_.max_r);
+  double max_t = param_snapshot_->get(tick_params_.max_t);
+
+  lower << -max_e, -max_a, -max_r, 0.0;
+  upper << max_e, max_a, max_r, max_t;
+}
+
+void LqrController::explicit_mpc_control(const Input & input, const Reference & reference,
+                                         const LqrGains & gains, Output & output)
+{
+  Eigen::Vector4f x_lon;
+  Eigen::Vector4f x_lat;
+  state_errors(input, reference, x_lon, x_lat);
+
+  Eigen::Vector2f u_lon = config_->explicit_mpc_lon.evaluate(x_lon);
+  Eigen::Vector2f u_lat = config_->explicit_mpc_lat.evaluate(x_lat);
+
+  output.delta_e = gains.u_trim(0) + u_lon(0);
+  output.delta_a = gains.u_trim(1) + u_lat(0);
+  output.delta_r = gains.u_trim(2) + u_lat(1);
+  output.delta_t = gains.u_trim(3) + u_lon(1);
+}
+
+void LqrController::linear_mpc_control(const Input & input, const Reference & reference,
+                                       const LqrGains & gains, Output & output)
+{
+  // For readability, declare parameters here that will be used in this function
+  int64_t max_iterations = param_snapshot_->get(tick_params_.mpc_max_iterations);
+  double budget_fraction = param_snapshot_->get(tick_params_.mpc_budget_fraction);
+  double frequency = param_snapshot_->get(controller_output_frequency_param_);
+
+  Eigen::Vector4f x_lon;
+  Eigen::Vector4f x_lat;
+  state_errors(input, reference, x_lon, x_lat);
+
+  // Give each solve half of the budget, so a slow longitudinal solve cannot starve the lateral one.
+  auto start = std::chrono::steady_clock::now();
+  std::chrono::duration<double> budget(budget_fraction / frequency);
+  auto half_budget = std::chrono::duration_cast<std::chrono::steady_clock::duration>(budget / 2.0);
+
+  auto & lon_mpc = config_->linear_mpc_lon;
+  auto & lat_mpc = config_->linear_mpc_lat;
+  auto lon_stats =
+    lon_mpc.solve(x_lon.cast<double>(), static_cast<int>(max_iterations), start + half_budget);
+  auto lat_stats = lat_mpc.solve(x_lat.cast<double>(), static_cast<int>(max_iterations),
+                                 std::chrono::steady_clock::now() + half_budget);
+
+  double solve_us =
+    std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+  mpc_summary_.max_solve_time_us = std::max(mpc_summary_.max_solve_time_us, solve_us);
+
+  Eigen::Vector2d u_lon = lon_mpc.first_input();
+  Eigen::Vector2d u_lat = lat_mpc.first_input();
+
+  output.delta_e = gains.u_trim(0) + u_lon(0);
+  output.delta_a = gains.u_trim(1) + u_lat(0);
+  output.delta_r = gains.u_trim(2) + u_lat(1);
+  output.delta_t = gains.u_trim(3) + u_lon(1);
+
+  mpc_summary_.solve_time_us = solve_us;
+  mpc_summary_.budget_us = budget.count() * 1'000'000.0;
+  mpc_summary_.lon_iterations = lon_stats.iterations;
+  mpc_summary_.lat_iterations = lat_stats.iterations;
+  mpc_summary_.iteration_cap_hit = lon_stats.iteration_cap_hit || lat_stats.iteration_cap_hit;
+  mpc_summary_ready_ = true;
+}
+
+bool LqrController::setup_linear_mpc(Configuration & config)
+{
+  // For readability, declare parameters here that will be used in this function
+  double max_e = params_.get_double("max_e");
+  double max_a = params_.get_double("max_a");
+  double max_r = params_.get_double("max_r");
+  double max_t = params_.get_double("max_t");
+
+  LqrDesign design = lqr_design();
+  LinearModel lon = discretize(longitudinal_model(design.coefficients), design.Ts);
+  LinearModel lat = discretize(lateral_model(design.coefficients), design.Ts);
+
+  // The inputs are deviations from trim, so the limits are shifted by the trim.
+  Eigen::Vector4d u_trim = design.u_trim.cast<double>();
+  Eigen::Vector2d lon_min(-max_e - u_trim(0), -u_trim(3));
+  Eigen::Vector2d lon_max(max_e - u_trim(0), max_t - u_trim(3));
+  Eigen::Vector2d lat_min(-max_a - u_trim(1), -max_r - u_trim(2));
+  Eigen::Vector2d lat_max(max_a - u_trim(1), max_r - u_trim(2));
+
+  bool lon_ok =
+    config.linear_mpc_lon.setup(lon.A, lon.B, design.q_lon.asDiagonal().toDenseMatrix(),
+                                design.r_lon.asDiagonal().toDenseMatrix(), lon_min, lon_max);
+  bool lat_ok =
+    config.linear_mpc_lat.setup(lat.A, lat.B, design.q_lat.asDiagonal().toDenseMatrix(),
+                                design.r_lat.asDiagonal().toDenseMatrix(), lat_min, lat_max);
+
+  if (!lon_ok || !lat_ok) {
+    log(LogLevel::ERROR, "Could not compute the linear MPC terminal cost.");
+  }
+  return config.linear_mpc_lon.ready() && config.linear_mpc_lat.ready();
+}
+
+bool LqrController::load_explicit_mpc(Configuration & config)
+{
+  try {
+    config.explicit_mpc_lon.load(params_.get_string("explicit_mpc_lon_file"));
+    config.explicit_mpc_lat.load(params_.get_string("explicit_mpc_lat_file"));
+  } catch (std::runtime_error & e) {
+    log(LogLevel::ERROR, e.what());
+    return false;
+  }
+
+  // The search depth bounds the worst case evaluation time.
+  log(LogLevel::INFO, ("Loaded explicit MPC: longitudinal "
+                       + std::to_string(config.explicit_mpc_lon.regions()) + " regions, depth "
+                       + std::to_string(config.explicit_mpc_lon.depth()) + "; lateral "
+                       + std::to_string(config.explicit_mpc_lat.regions()) + " regions, depth "
+                       + std::to_string(config.explicit_mpc_lat.depth()) + ".")
+                        .c_str());
+  return true;
+}
+
+#ifdef ROSPLANE_LQR_EMBEDDED_PYTHON
+bool LqrController::python_lqr_control(const Input & input, const Reference & reference,
+                                       Output & output)
+{
+  // The Python law sees the float fields of Input, which end with phi_ff, before the stamps.
+  constexpr std::size_t input_floats = offsetof(Input, phi_ff) / sizeof(float) + 1;
+  static_assert((input_floats * sizeof(float) + sizeof(Reference))
+                  == EmbeddedPythonLqr::INPUT_SIZE * sizeof(float),
+                "The Python input buffer must match the Input and Reference structs.");
+
+  // Place the inputs in the buffer the Python input array views.
+  float * buffer = python_lqr_->input().data();
+  std::memcpy(buffer, &input, input_floats * sizeof(float));
+  std::memcpy(buffer + input_floats, &reference, sizeof(Reference));
+
+  std::string error;
+  if (!python_lqr_->evaluate(error)) {
+    // Log at most once a second, the law runs every tick.
+    auto now = std::chrono::steady_clock::now();
+    if (now - python_error_time_ >= std::chrono::seconds(1)) {
+      log(LogLevel::ERROR,
+          ("Python LQR control law failed, using the native law: " + error).c_str());
+      python_error_time_ = now;
+    }
+    return false;
+  }
+
+  const auto & u = python_lqr_->output();
+  output.delta_e = u[0];
+  output.delta_a = u[1];
+  output.delta_r = u[2];
+  output.delta_t = u[3];
+
+  return true;
+}
+#endif
+
+void LqrController::configure_lqr_backend(Configuration & config)
+{
+  std::string backend = params_.get_string("lqr_backend");
+
+  if (backend == "native") {
+    config.backend = LqrBackend::NATIVE;
+  } else if (backend == "service") {
+    // Whether a service is attached is checked when the control loop picks up the configuration.
+    config.backend = LqrBackend::SERVICE;
+  } else if (backend == "linear_mpc") {
+    if (setup_linear_mpc(config)) {
+      config.backend = LqrBackend::LINEAR_MPC;
+    } else {
+      log(LogLevel::ERROR, "Using the native LQR backend instead of linear MPC.");
+      config.backend = LqrBackend::NATIVE;
+    }
+  } else if (backend == "explicit_mpc") {
+    if (load_explicit_mpc(config)) {
+      config.backend = LqrBackend::EXPLICIT_MPC;
+    } else {
+      log(LogLevel::ERROR, "Using the native LQR backend instead of explicit MPC.");
+      config.backend = LqrBackend::NATIVE;
+    }
+  } else if (backend == "embedded_python") {
+#ifdef ROSPLANE_LQR_EMBEDDED_PYTHON
+    if (!python_lqr_) {
+      try {
+        python_lqr_ = std::make_unique<EmbeddedPythonLqr>(params_.get_string("python_lqr_module"),
+                                                          params_.get_string("python_lqr_function"),
+                                                          params_.get_string("python_lqr_path"));
+      } catch (std::exception & e) {
+        log(LogLevel::ERROR,
+            (std::string("Unable to load the Python LQR control law: ") + e.what()).c_str());
+      }
+    }
+    config.backend = python_lqr_ ? LqrBackend::EMBEDDED_PYTHON : LqrBackend::NATIVE;
+#else
+    log(LogLevel::ERROR,
+        "The controller was built without pybind11, using the native LQR backend.");
+    config.backend = LqrBackend::NATIVE;
+#endif
+  } else {
+    log(LogLevel::ERROR,
+        ("Unknown LQR backend " + backend + ", using the native LQR backend.").c_str());
+    config.backend = LqrBackend::NATIVE;
+  }
+}
+
+void LqrController::record_lqr_call(std::chrono::steady_clock::time_point start)
+{
+  double call_us =
+    std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+  lqr_calls_++;
+  lqr_window_calls_++;
+  lqr_window_sum_us_ += call_us;
+  lqr_window_max_us_ = std::max(lqr_window_max_us_, call_us);
+  lqr_last_call_us_ = call_us;
+}
+
+LqrController::CallSummary LqrController::take_call_summary()
+{
+  CallSummary summary;
+  summary.calls = lqr_calls_;
+  summary.window_calls = lqr_window_calls_;
+  summary.last_call_us = lqr_last_call_us_;
+  summary.mean_call_us = lqr_window_calls_ > 0 ? lqr_window_sum_us_ / lqr_window_calls_ : 0.0;
+  summary.max_call_us = lqr_window_max_us_;
+
+  // Start a new reporting window.
+  lqr_window_calls_ = 0;
+  lqr_window_sum_us_ = 0.0;
+  lqr_window_max_us_ = 0.0;
+
+  return summary;
+}
+
+bool LqrController::take_mpc_summary(MpcSolveSummary & summary)
+{
+  if (!mpc_summary_ready_) {
+    return false;
+  }
+
+  summary = mpc_summary_;
+  mpc_summary_ready_ = false;
+  return true;
+}
+
+void LqrController::set_service(Service * service) { service_ = service; }
+
+void LqrController::load_lqr_gains(Configuration & config)
+{
+  config.gains.k_lon << params_.get_double("lqr_e_va"), params_.get_double("lqr_e_theta"),
+    params_.get_double("lqr_e_q"), params_.get_double("lqr_e_h"), params_.get_double("lqr_t_va"),
+    params_.get_double("lqr_t_theta"), params_.get_double("lqr_t_q"), params_.get_double("lqr_t_h");
+
+  config.gains.k_lat << params_.get_double("lqr_a_phi"), params_.get_double("lqr_a_chi"),
+    params_.get_double("lqr_a_p"), params_.get_double("lqr_a_r"), params_.get_double("lqr_r_phi"),
+    params_.get_double("lqr_r_chi"), params_.get_double("lqr_r_p"), params_.get_double("lqr_r_r");
+
+  config.gains.u_trim << params_.get_double("trim_e"), params_.get_double("trim_a"),
+    params_.get_double("trim_r"), params_.get_double("trim_t");
+
+  config.ki_lon << params_.get_double("lqr_e_int_h"), params_.get_double("lqr_t_int_h");
+  config.ki_lat << params_.get_double("lqr_a_int_chi"), params_.get_double("lqr_r_int_chi");
+
+  config.online_dare = params_.get_bool("lqr_online_dare");
+  config.lqr_tracking = params_.get_bool("lqr_tracking");
+}
+
+LqrDesign LqrController::lqr_design()
+{
+  LqrDesign design;
+  design.coefficients.va_trim = params_.get_double("lqr_va_trim");
+  design.coefficients.gravity = params_.get_double("gravity");
+  design.coefficients.a_phi1 = params_.get_double("a_phi1");
+  design.coefficients.a_phi2 = params_.get_double("a_phi2");
+  design.coefficients.a_r1 = params_.get_double("a_r1");
+  design.coefficients.a_r2 = params_.get_double("a_r2");
+  design.coefficients.a_theta1 = params_.get_double("a_theta1");
+  design.coefficients.a_theta2 = params_.get_double("a_theta2");
+  design.coefficients.a_theta3 = params_.get_double("a_theta3");
+  design.coefficients.a_v1 = params_.get_double("a_v1");
+  design.coefficients.a_v2 = params_.get_double("a_v2");
+  design.coefficients.a_v3 = params_.get_double("a_v3");
+
+  design.Ts = 1.0 / params_.get(controller_output_frequency_param_);
+
+  design.q_lon << params_.get_double("q_va"), params_.get_double("q_theta"),
+    params_.get_double("q_q"), params_.get_double("q_h");
+  design.r_lon << params_.get_double("r_e"), params_.get_double("r_t");
+  design.q_lat << params_.get_double("q_phi"), params_.get_double("q_chi"),
+    params_.get_double("q_p"), params_.get_double("q_r");
+  design.r_lat << params_.get_double("r_a"), params_.get_double("r_r");
+
+  design.u_trim << params_.get_double("trim_e"), params_.get_double("trim_a"),
+    params_.get_double("trim_r"), params_.get_double("trim_t");
+
+  return design;
+}
+
+void LqrController::request_lqr_design(const Configuration & config)
+{
+  if (!config.online_dare) {
+    return;
+  }
+
+  LqrDesign design = lqr_design();
+
+  if (!gain_solver_) {
+    gain_solver_ = std::make_unique<LqrGainSolver>();
+  }
+  gain_solver_->request(design);
+}
+
+void LqrController::configure_tvlqr(const Configuration & config)
+{
+  if (!config.lqr_tracking) {
+    return;
+  }
+
+  LqrDesign lqr = lqr_design();
+
+  TvlqrDesign design;
+  design.coefficients = lqr.coefficients;
+  design.Ts = lqr.Ts;
+  design.roll_rate = params_.get_double("tvlqr_roll_rate");
+  design.horizon = params_.get_double("tvlqr_horizon");
+  design.q_lat = lqr.q_lat;
+  design.r_lat = lqr.r_lat;
+
+  if (!tvlqr_planner_) {
+    tvlqr_planner_ = std::make_unique<TvlqrPlanner>();
+  }
+  tvlqr_planner_->configure(design);
+}
+
+void LqrController::set_path(const PathSegment & path)
+{
+  if (!config_->lqr_tracking) {
+    return;
+  }
+
+  bool same_segment = have_path_ && path.orbit == last_path_.orbit && path.va_d == last_path_.va_d
+    && path.r == last_path_.r && path.q == last_path_.q && path.c == last_path_.c
+    && path.rho == last_path_.rho && path.lamda == last_path_.lamda;
+  last_path_ = path;
+  have_path_ = true;
+  if (same_segment) {
+    return;
+  }
+
+  // The segment starts at the next tick, from the roll of the last one.
+  TvlqrSegment segment;
+  segment.start_tick = tvlqr_tick_;
+  segment.phi_start = last_phi_;
+  segment.va = path.va_d;
+  segment.rho = path.orbit ? path.rho : 0.0f;
+  segment.lamda = path.lamda;
+  tvlqr_planner_->request(segment);
+}
+
+const LqrGains & LqrController::tracking_gains(const LqrGains & gains)
+{
+  if (tvlqr_ == nullptr) {
+    return gains;
+  }
+
+  tracking_gains_ = gains;
+  tracking_gains_.k_lat = tvlqr_step_ != nullptr ? tvlqr_step_->gain : tvlqr_->steady_gain();
+  return tracking_gains_;
+}
+
+void LqrController::load_gain_schedules(Configuration & config)
+{
+  load_gain_schedule("take_off_gain_schedule", config.take_off_schedule);
+  load_gain_schedule("climb_gain_schedule", config.climb_schedule);
+  load_gain_schedule("altitude_hold_gain_schedule", config.altitude_hold_schedule);
+}
+
+void LqrController::load_gain_schedule(const std::string & param_name, GainSchedule & schedule)
+{
+  std::string filename = params_.get_string(param_name);
+
+  if (filename.empty()) {
+    schedule.clear();
+    return;
+  }
+
+  try {
+    schedule.load(filename);
+  } catch (std::runtime_error & e) {
+    log(LogLevel::ERROR, (std::string(e.what()) + " Using the fixed gains instead.").c_str());
+    schedule.clear();
+  }
+}
+
+const LqrGains & LqrController::select_gains(const GainSchedule & schedule, const Input & input)
+{
+  if (schedule.empty()) {
+    const LqrGains * solved = config_->online_dare ? gain_solver_->latest() : nullptr;
+    return solved != nullptr ? *solved : config_->gains;
+  }
+
+  schedule.interpolate(input.va, input.h, scheduled_gains_);
+  return scheduled_gains_;
+}
+
+void LqrController::prepare_parameters()
+{
+  free_retired_configurations();
+
+  Configuration * config = new Configuration;
+  config->next = nullptr;
+  load_lqr_gains(*config);
+  load_gain_schedules(*config);
+  request_lqr_design(*config);
+  configure_tvlqr(*config);
+  configure_lqr_backend(*config);
+
+  // Publish the configuration. One the control loop never picked up can be freed right away.
+  delete config_ready_.exchange(config, std::memory_order_acq_rel);
+}
+
+void LqrController::parameters_changed()
+{
+  Configuration * fresh = config_ready_.exchange(nullptr, std::memory_order_acquire);
+  if (fresh == nullptr) {
+    return;
+  }
+
+  // Hand the configuration being replaced back to be freed off the control loop, so the control loop never
+  // deallocates.
+  if (config_ != nullptr) {
+    config_->next = config_retired_.load(std::memory_order_relaxed);
+    while (!config_retired_.compare_exchange_weak(config_->next, config_, std::memory_order_release,
+                                                  std::memory_order_relaxed)) {
+    }
+  }
+  config_ = fresh;
+
+  if (config_->backend != LqrBackend::SERVICE) {
+    lqr_backend_ = config_->backend;
+  } else if (service_ == nullptr) {
+    log(LogLevel::ERROR, "No LQR service is attached, using the native LQR backend.");
+    lqr_backend_ = LqrBackend::NATIVE;
+  } else {
+    // Do not reuse a command from before the backend was selected.
+    if (lqr_backend_ != LqrBackend::SERVICE) {
+      service_->selected();
+    }
+    lqr_backend_ = LqrBackend::SERVICE;
+  }
+}
+
+void LqrController::free_retired_configurations()
+{
+  Configuration * config = config_retired_.exchange(nullptr, std::memory_order_acquire);
+  while (config != nullptr) {
+    Configuration * next = config->next;
+    delete config;
+    config = next;
+  }
+}
+
+float LqrController::sat(float value, float up_limit, float low_limit)
+{
+  // Set to upper limit if larger than that limit.
+  // Set to lower limit if smaller than that limit.
+  // Otherwise, do not change the value.
+
+  if (up_limit < 0.0 && !sat_warned_) {
+    log(LogLevel::WARN, "WARNING: Upper limit in saturation function is negative.");
+    sat_warned_ = true;
+  }
+
+  float rVal;
+  if (value > up_limit)
+    rVal = up_limit;
+  else if (value < low_limit)
+    rVal = low_limit;
+  else
+    rVal = value;
+
+  // Return the saturated value.
+  return rVal;
+}
+
+float LqrController::adjust_h_c(float h_c, float h, float max_diff)
+{
+  double adjusted_h_c;
+
+  // If the error in altitude is larger than the max altitude, adjust it to the max with the correct sign.
+  // Otherwise, proceed as normal.
+  if (abs(h_c - h) > max_diff) {
+    adjusted_h_c = h + copysign(max_diff, h_c - h);
+  } else {
+    adjusted_h_c = h_c;
+  }
+
+  return adjusted_h_c;
+}
+
+void LqrController::declare_parameters()
+{
+  // Declare param and set the default value.
+  // Where the control law is evaluated, either "native", "embedded_python", "service", "explicit_mpc" or
+  // "linear_mpc". The Python module and function are only read the first time the embedded interpreter is started.
+  params_.declare_string("lqr_backend", "native");
+  params_.declare_string("python_lqr_module", "lqr_control");
+  params_.declare_string("python_lqr_function", "control");
+  params_.declare_string("python_lqr_path", "");
+
+  // Region tree files for the explicit MPC backend, built with scripts/build_explicit_mpc_tree.py.
+  params_.declare_string("explicit_mpc_lon_file", "");
+  params_.declare_string("explicit_mpc_lat_file", "");
+
+  // The linear MPC iterates until it converges, hits the iteration cap, or uses up this fraction of the controller
+  // period. It uses the model and weights of the online DARE design.
+  tick_params_.mpc_max_iterations = params_.declare_int("mpc_max_iterations", 50);
+  tick_params_.mpc_budget_fraction = params_.declare_double("mpc_budget_fraction", 0.5);
+
+  tick_params_.max_takeoff_throttle = params_.declare_double("max_takeoff_throttle", 0.55);
+  tick_params_.cmd_takeoff_pitch = params_.declare_double("cmd_takeoff_pitch", 5.0);
+
+  params_.declare_double("trim_e", 0.02);
+  params_.declare_double("trim_a", 0.0);
+  params_.declare_double("trim_r", 0.0);
+  params_.declare_double("trim_t", 0.5);
+
+  tick_params_.max_e = params_.declare_double("max_e", .15);
+  tick_params_.max_a = params_.declare_double("max_a", .15);
+  tick_params_.max_r = params_.declare_double("max_r", 1.0);
+  tick_params_.max_t = params_.declare_double("max_t", 1.0);
+
+  // Longitudinal LQR gains, from the (va, theta, q, h) errors to delta_e and delta_t.
+  params_.declare_double("lqr_e_va", 0.0);
+  params_.declare_double("lqr_e_theta", -0.5);
+  params_.declare_double("lqr_e_q", -0.095);
+  params_.declare_double("lqr_e_h", -0.05);
+  params_.declare_double("lqr_t_va", 0.05);
+  params_.declare_double("lqr_t_theta", 0.0);
+  params_.declare_double("lqr_t_q", 0.0);
+  params_.declare_double("lqr_t_h", 0.0);
+
+  // Lateral LQR gains, from the (phi, chi, p, r) errors to delta_a and delta_r.
+  params_.declare_double("lqr_a_phi", 0.75);
+  params_.declare_double("lqr_a_chi", 2.25);
+  params_.declare_double("lqr_a_p", 0.1);
+  params_.declare_double("lqr_a_r", 0.0);
+  params_.declare_double("lqr_r_phi", 0.0);
+  params_.declare_double("lqr_r_chi", 0.0);
+  params_.declare_double("lqr_r_p", 0.0);
+  params_.declare_double("lqr_r_r", 0.0);
+
+  // Integral gains on the altitude error to delta_e and delta_t, and on the course error to delta_a and delta_r.
+  params_.declare_double("lqr_e_int_h", 0.0);
+  params_.declare_double("lqr_t_int_h", 0.0);
+  params_.declare_double("lqr_a_int_chi", 0.0);
+  params_.declare_double("lqr_r_int_chi", 0.0);
+
+  // Largest change per second of each actuator command. Zero leaves the actuator unlimited.
+  tick_params_.max_rate_e = params_.declare_double("max_rate_e", 0.0);
+  tick_params_.max_rate_a = params_.declare_double("max_rate_a", 0.0);
+  tick_params_.max_rate_r = params_.declare_double("max_rate_r", 0.0);
+  tick_params_.max_rate_t = params_.declare_double("max_rate_t", 0.0);
+
+  // When true, the fixed gains are replaced by gains solved online from the linear model below, on a background
+  // thread, whenever any parameter changes.
+  params_.declare_bool("lqr_online_dare", false);
+
+  // When true, altitude hold uses lateral gains from a finite horizon LQR planned whenever the path segment changes,
+  // with the roll reference moving onto the new segment at tvlqr_roll_rate (rad/s) for tvlqr_horizon (s). The course
+  // reference stays the path follower's. Uses the model and weights below.
+  params_.declare_bool("lqr_tracking", false);
+  params_.declare_double("tvlqr_roll_rate", 0.5);
+  params_.declare_double("tvlqr_horizon", 2.5);
+  params_.declare_double("lqr_va_trim", 25.0);
+  params_.declare_double("gravity", 9.8);
+
+  // Linear model coefficients, see linear_model.hpp.
+  params_.declare_double("a_phi1", 22.6);
+  params_.declare_double("a_phi2", 130.9);
+  params_.declare_double("a_r1", 0.8);
+  params_.declare_double("a_r2", -1.0);
+  params_.declare_double("a_theta1", 5.3);
+  params_.declare_double("a_theta2", 99.7);
+  params_.declare_double("a_theta3", -36.1);
+  params_.declare_double("a_v1", 0.05);
+  params_.declare_double("a_v2", 12.0);
+  params_.declare_double("a_v3", 9.8);
+
+  // Diagonal LQR state and input weights.
+  params_.declare_double("q_va", 1.0);
+  params_.declare_double("q_theta", 10.0);
+  params_.declare_double("q_q", 1.0);
+  params_.declare_double("q_h", 0.1);
+  params_.declare_double("r_e", 10.0);
+  params_.declare_double("r_t", 10.0);
+  params_.declare_double("q_phi", 1.0);
+  params_.declare_double("q_chi", 1.0);
+  params_.declare_double("q_p", 1.0);
+  params_.declare_double("q_r", 1.0);
+  params_.declare_double("r_a", 10.0);
+  params_.declare_double("r_r", 10.0);
+
+  // Gain schedule files for each zone, interpolated by airspeed and altitude. Leave empty to use the fixed gains.
+  params_.declare_string("take_off_gain_schedule", "");
+  params_.declare_string("climb_gain_schedule", "");
+  params_.declare_string("altitude_hold_gain_schedule", "");
+}
+
+} // namespace rosplane
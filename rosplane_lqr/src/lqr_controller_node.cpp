@@ -0,0 +1,66 @@
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "python_controller_interface.hpp"
+#include "realtime.hpp"
+
+namespace
+{
+
+/**
+ * Stack touched by the real-time control thread before it starts, so the control loop never faults in a stack page.
+ */
+constexpr std::size_t CONTROL_STACK_PREFAULT_BYTES = 512 * 1024;
+
+} // namespace
+
+int main(int argc, char * argv[])
+{
+
+  // Initialize ROS2 and then begin to spin control node.
+  rclcpp::init(argc, argv);
+
+  // This executable spins the control loop on its own thread when the real-time profile is enabled.
+  rosplane::provide_realtime_executor();
+
+  auto node = std::make_shared<rosplane::PythonControllerInterface>();
+  RCLCPP_INFO_STREAM(node->get_logger(), "Invalid control type, using default control.");
+
+  // The subscriptions run on their own thread, so a burst of messages never delays the control loop.
+  rclcpp::executors::MultiThreadedExecutor executor(rclcpp::ExecutorOptions(), 2);
+  executor.add_node(node);
+
+  // With the real-time profile the control loop gets its own executor on a SCHED_FIFO thread, and the executor above
+  // only handles the subscriptions, parameters and logging.
+  rclcpp::executors::SingleThreadedExecutor control_executor;
+  std::thread control_thread;
+  rclcpp::CallbackGroup::SharedPtr control_group = node->realtime_callback_group();
+  if (control_group != nullptr) {
+    rosplane::RealtimeProfile profile = node->realtime_profile();
+
+    std::string error;
+    if (profile.lock_memory && !rosplane::lock_process_memory(error)) {
+      RCLCPP_WARN(node->get_logger(), "%s", error.c_str());
+    }
+
+    control_executor.add_callback_group(control_group, node->get_node_base_interface());
+    control_thread = std::thread([&control_executor, node, profile]() {
+      std::string error;
+      if (!rosplane::make_thread_realtime(profile, error)) {
+        RCLCPP_WARN(node->get_logger(), "Control thread is not real-time. %s", error.c_str());
+      }
+      rosplane::prefault_stack(CONTROL_STACK_PREFAULT_BYTES);
+      control_executor.spin();
+    });
+  }
+
+  executor.spin();
+
+  if (control_thread.joinable()) {
+    control_executor.cancel();
+    control_thread.join();
+  }
+
+  return 0;
+}
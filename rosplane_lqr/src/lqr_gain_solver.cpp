@@ -0,0 +1,119 @@
+#include <pthread.h>
+#include <sched.h>
+
+#include "lqr_gain_solver.hpp"
+
+namespace rosplane
+{
+
+LqrGainSolver::LqrGainSolver()
+    : design_pending_(false)
+    , stop_(false)
+    , ready_(nullptr)
+    , retired_(nullptr)
+    , active_(nullptr)
+{
+  worker_ = std::thread(&LqrGainSolver::run, this);
+}
+
+LqrGainSolver::~LqrGainSolver()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  condition_.notify_one();
+  worker_.join();
+
+  free_retired();
+  delete ready_.exchange(nullptr);
+  delete active_;
+}
+
+void LqrGainSolver::request(const LqrDesign & design)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    design_ = design;
+    design_pending_ = true;
+  }
+  condition_.notify_one();
+}
+
+const LqrGains * LqrGainSolver::latest()
+{
+  Block * fresh = ready_.exchange(nullptr, std::memory_order_acquire);
+
+  if (fresh != nullptr) {
+    // Hand the block being replaced back to the worker to free, so the control loop never deallocates.
+    if (active_ != nullptr) {
+      active_->next = retired_.load(std::memory_order_relaxed);
+      while (!retired_.compare_exchange_weak(active_->next, active_, std::memory_order_release,
+                                             std::memory_order_relaxed)) {
+      }
+    }
+    active_ = fresh;
+  }
+
+  return active_ != nullptr ? &active_->gains : nullptr;
+}
+
+void LqrGainSolver::run()
+{
+  // Only run when nothing else wants the CPU, so solves never delay the control loop.
+  sched_param param{};
+  pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+
+  while (true) {
+    LqrDesign design;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      condition_.wait(lock, [this] { return design_pending_ || stop_; });
+      if (stop_) {
+        return;
+      }
+      design = design_;
+      design_pending_ = false;
+    }
+
+    free_retired();
+
+    Block * block = new Block;
+    if (!solve(design, block->gains)) {
+      delete block;
+      continue;
+    }
+
+    // Publish the block. A block the control loop never picked up can be freed right away.
+    delete ready_.exchange(block, std::memory_order_acq_rel);
+  }
+}
+
+bool LqrGainSolver::solve(const LqrDesign & design, LqrGains & gains)
+{
+  LinearModel lon = discretize(longitudinal_model(design.coefficients), design.Ts);
+  LinearModel lat = discretize(lateral_model(design.coefficients), design.Ts);
+
+  if (!lon_solver_.solve(lon.A, lon.B, design.q_lon.asDiagonal(), design.r_lon.asDiagonal())
+      || !lat_solver_.solve(lat.A, lat.B, design.q_lat.asDiagonal(), design.r_lat.asDiagonal())) {
+    return false;
+  }
+
+  gains.k_lon = lon_solver_.gain().cast<float>();
+  gains.k_lat = lat_solver_.gain().cast<float>();
+  gains.u_trim = design.u_trim;
+
+  return true;
+}
+
+void LqrGainSolver::free_retired()
+{
+  Block * block = retired_.exchange(nullptr, std::memory_order_acquire);
+  while (block != nullptr) {
+    Block * next = block->next;
+    delete block;
+    block = next;
+  }
+}
+
+} // namespace rosplane
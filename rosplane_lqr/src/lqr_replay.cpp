@@ -0,0 +1,224 @@
+/**
+ * Replays a flight recorder log through the control law of the lqr_controller as fast as the CPU allows, and compares
+ * the new outputs with the recorded ones.
+ *
+ * Usage: lqr_replay <controller.rlog> [tolerance] [--params-file <params.yaml>]
+ *
+ * The log is written by the controller when recorder_enabled is set, see include/flight_recorder.hpp. The control law
+ * is an LqrController from the control core, set up with the given ROS2 parameter file without a ROS context: the
+ * inputs of every record go straight into update(), in order, so the altitude state machine follows the recorded
+ * flight. Exits with 1 if any output differs from the recorded one by more than the tolerance (default 1e-4).
+ *
+ * Every record holds a hash of the parameters of its tick. Once a tick was recorded with parameters other than the ones
+ * given, for example after a parameter was changed in flight, the integrators of the replayed controller no longer follow
+ * the recorded flight, so the replay stops comparing there and reports the ticks it left out.
+ *
+ * The service backend, online DARE gains and TV-LQR path tracking are refused: their gains or commands depend on events
+ * the log does not hold.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "flight_recorder.hpp"
+#include "lqr_controller.hpp"
+#include "tick_record.hpp"
+
+namespace
+{
+
+/**
+ * Checks that a log holds records of the controller's TickRecord.
+ * @param schema The fields of the log.
+ * @param record_size Size of each record of the log (bytes).
+ * @return True if the log matches.
+ */
+bool matches(const std::vector<rosplane::RecordField> & schema, std::size_t record_size)
+{
+  std::vector<rosplane::RecordField> expected = rosplane::tick_record_schema();
+  if (record_size != sizeof(rosplane::TickRecord) || schema.size() != expected.size()) {
+    return false;
+  }
+  for (std::size_t i = 0; i < schema.size(); i++) {
+    if (schema[i].name != expected[i].name || schema[i].type != expected[i].type
+        || schema[i].offset != expected[i].offset) {
+      return false;
+    }
+  }
+  return true;
+}
+
+using Output = rosplane::LqrController::Output;
+
+/**
+ * The outputs compared against the recording, with the largest difference seen.
+ */
+struct OutputDiff
+{
+  const char * name;
+  float Output::*field;
+  double max_diff;
+};
+
+} // namespace
+
+int main(int argc, char * argv[])
+{
+  // The controller can be given the parameter file of the recorded flight.
+  std::vector<std::string> args;
+  std::string params_file;
+  for (int i = 0; i < argc; i++) {
+    if (std::string(argv[i]) == "--params-file" && i + 1 < argc) {
+      params_file = argv[++i];
+    } else {
+      args.emplace_back(argv[i]);
+    }
+  }
+  if (args.size() != 2 && args.size() != 3) {
+    std::cerr << "Usage: lqr_replay <controller.rlog> [tolerance] [--params-file <params.yaml>]"
+              << std::endl;
+    return 1;
+  }
+  double tolerance = args.size() == 3 ? std::stod(args[2]) : 1e-4;
+
+  std::vector<rosplane::RecordField> schema;
+  std::size_t record_size;
+  std::vector<uint8_t> records;
+  std::string error;
+  if (!rosplane::read_record_log(args[1], schema, record_size, records, error)) {
+    std::cerr << error << std::endl;
+    return 1;
+  }
+  if (!matches(schema, record_size)) {
+    std::cerr << args[1] << " was recorded by a controller with a different record layout."
+              << std::endl;
+    return 1;
+  }
+
+  rosplane::LqrController controller;
+  if (!params_file.empty()) {
+    if (!controller.load_parameters(params_file, error)) {
+      std::cerr << error << std::endl;
+      return 1;
+    }
+    controller.apply_parameters();
+  }
+  if (controller.params().get_string("lqr_backend") == "service") {
+    std::cerr << "The service backend cannot be replayed, its commands arrive asynchronously."
+              << std::endl;
+    return 1;
+  }
+  if (controller.params().get_bool("lqr_online_dare")) {
+    std::cerr << "Online DARE gains cannot be replayed, they are picked up whenever the background "
+                 "solver finishes."
+              << std::endl;
+    return 1;
+  }
+  if (controller.params().get_bool("lqr_tracking")) {
+    std::cerr << "TV-LQR path tracking cannot be replayed, the log does not hold the path segments "
+                 "its gains are planned for."
+              << std::endl;
+    return 1;
+  }
+  uint64_t param_hash = controller.params().snapshot()->hash();
+
+  OutputDiff diffs[] = {
+    {"theta_c", &Output::theta_c, 0.0}, {"phi_c", &Output::phi_c, 0.0},
+    {"delta_e", &Output::delta_e, 0.0}, {"delta_a", &Output::delta_a, 0.0},
+    {"delta_r", &Output::delta_r, 0.0}, {"delta_t", &Output::delta_t, 0.0},
+  };
+  std::size_t count = records.size() / record_size;
+  std::size_t mismatches = 0;
+  std::size_t zone_mismatches = 0;
+  std::size_t first_mismatch = count;
+  std::size_t first_param_mismatch = count;
+  std::size_t param_changes = 0;
+  uint64_t last_param_hash = 0;
+  int64_t first_tick_ns = 0;
+  int64_t last_tick_ns = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < count; i++) {
+    // The records are not aligned in the buffer, so each one is copied out.
+    rosplane::TickRecord record;
+    std::memcpy(&record, &records[i * record_size], sizeof(record));
+
+    if (i == 0) {
+      first_tick_ns = record.tick_ns;
+    } else {
+      param_changes += record.param_hash != last_param_hash;
+    }
+    last_tick_ns = record.tick_ns;
+    last_param_hash = record.param_hash;
+
+    // A tick recorded with other parameters is not expected to match, and every tick after it was flown from a state
+    // the replayed controller did not reach, so only the parameter changes are still counted.
+    if (first_param_mismatch == count && record.param_hash != param_hash) {
+      first_param_mismatch = i;
+    }
+    if (first_param_mismatch < count) {
+      continue;
+    }
+
+    Output output;
+    controller.update(record.input, output);
+
+    bool mismatch = output.current_zone != record.output.current_zone;
+    zone_mismatches += mismatch;
+    for (OutputDiff & diff : diffs) {
+      double difference = std::abs(output.*diff.field - record.output.*diff.field);
+
+      // NaN outputs match when both are NaN.
+      if (std::isnan(difference)) {
+        difference = std::isnan(output.*diff.field) == std::isnan(record.output.*diff.field)
+          ? 0.0 : INFINITY;
+      }
+      diff.max_diff = std::max(diff.max_diff, difference);
+      mismatch = mismatch || difference > tolerance;
+    }
+
+    if (mismatch) {
+      mismatches++;
+      first_mismatch = std::min(first_mismatch, i);
+    }
+  }
+  double replay_s =
+    std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  double flight_s = (last_tick_ns - first_tick_ns) / 1e9;
+
+  std::cout << "Replayed " << first_param_mismatch << " of " << count << " ticks (" << flight_s
+            << " s of flight) in " << replay_s << " s." << std::endl;
+  for (const OutputDiff & diff : diffs) {
+    std::cout << "  " << diff.name << " max difference " << diff.max_diff << std::endl;
+  }
+  std::cout << "  current_zone differences " << zone_mismatches << std::endl;
+
+  if (param_changes > 0) {
+    std::cout << "The parameters were changed " << param_changes << " times during the flight."
+              << std::endl;
+  }
+  if (first_param_mismatch < count) {
+    std::cout << "Tick " << first_param_mismatch
+              << " was recorded with other parameters, so the last " << count - first_param_mismatch
+              << " ticks were not compared." << std::endl;
+  }
+  if (first_param_mismatch == 0) {
+    std::cout << "The flight did not start with these parameters, pass the parameter file of the "
+              << "flight with --params-file." << std::endl;
+    return 1;
+  }
+
+  if (mismatches > 0) {
+    std::cout << mismatches << " ticks differ by more than " << tolerance << ", the first is tick "
+              << first_mismatch << "." << std::endl;
+    return 1;
+  }
+  return 0;
+}
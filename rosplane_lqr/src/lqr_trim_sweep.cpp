@@ -0,0 +1,239 @@
+/**
+ * Trims and linearizes the aircraft over a grid of airspeeds and altitudes, designs the LQR gains at every grid point
+ * and writes them as a gain schedule the lqr_controller can load.
+ *
+ * Usage: lqr_trim_sweep <sweep.yaml> <schedule.yaml>
+ *
+ * The sweep file is YAML:
+ *
+ *   aircraft:                      # optional, overrides the Aerosonde defaults by name, see aircraft_model.hpp
+ *     mass: 4.5
+ *   va: [15.0, 20.0, 25.0, 30.0]   # increasing airspeed breakpoints (m/s)
+ *   h: [0.0, 100.0]                # increasing altitude breakpoints (m)
+ *   turn_rate: 0.0                 # optional, heading rate of the trim (rad/s)
+ *   controller_output_frequency: 100.0
+ *   q_lon: [1.0, 10.0, 1.0, 0.1]   # diagonal weights of (va, theta, q, h)
+ *   r_lon: [10.0, 10.0]            # diagonal weights of (delta_e, delta_t)
+ *   q_lat: [1.0, 1.0, 1.0, 1.0]    # diagonal weights of (phi, chi, p, r)
+ *   r_lat: [10.0, 10.0]            # diagonal weights of (delta_a, delta_r)
+ *   cache_dir: ""                  # optional, directory to cache trim results in
+ *   threads: 0                     # optional, worker threads, zero for one per hardware thread
+ */
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <yaml-cpp/yaml.h>
+
+#include "dare_solver.hpp"
+#include "lqr_gains.hpp"
+#include "trim_linearization.hpp"
+
+namespace
+{
+
+using rosplane::AircraftParameters;
+
+const std::pair<const char *, double AircraftParameters::*> AIRCRAFT_FIELDS[] = {
+  {"mass", &AircraftParameters::mass},
+  {"Jx", &AircraftParameters::Jx},
+  {"Jy", &AircraftParameters::Jy},
+  {"Jz", &AircraftParameters::Jz},
+  {"Jxz", &AircraftParameters::Jxz},
+  {"gravity", &AircraftParameters::gravity},
+  {"rho", &AircraftParameters::rho},
+  {"S_wing", &AircraftParameters::S_wing},
+  {"b", &AircraftParameters::b},
+  {"c", &AircraftParameters::c},
+  {"e", &AircraftParameters::e},
+  {"S_prop", &AircraftParameters::S_prop},
+  {"C_prop", &AircraftParameters::C_prop},
+  {"k_motor", &AircraftParameters::k_motor},
+  {"k_T_p", &AircraftParameters::k_T_p},
+  {"k_Omega", &AircraftParameters::k_Omega},
+  {"M", &AircraftParameters::M},
+  {"alpha0", &AircraftParameters::alpha0},
+  {"C_L_0", &AircraftParameters::C_L_0},
+  {"C_L_alpha", &AircraftParameters::C_L_alpha},
+  {"C_L_q", &AircraftParameters::C_L_q},
+  {"C_L_delta_e", &AircraftParameters::C_L_delta_e},
+  {"C_D_p", &AircraftParameters::C_D_p},
+  {"C_D_q", &AircraftParameters::C_D_q},
+  {"C_D_delta_e", &AircraftParameters::C_D_delta_e},
+  {"C_m_0", &AircraftParameters::C_m_0},
+  {"C_m_alpha", &AircraftParameters::C_m_alpha},
+  {"C_m_q", &AircraftParameters::C_m_q},
+  {"C_m_delta_e", &AircraftParameters::C_m_delta_e},
+  {"C_Y_0", &AircraftParameters::C_Y_0},
+  {"C_Y_beta", &AircraftParameters::C_Y_beta},
+  {"C_Y_p", &AircraftParameters::C_Y_p},
+  {"C_Y_r", &AircraftParameters::C_Y_r},
+  {"C_Y_delta_a", &AircraftParameters::C_Y_delta_a},
+  {"C_Y_delta_r", &AircraftParameters::C_Y_delta_r},
+  {"C_ell_0", &AircraftParameters::C_ell_0},
+  {"C_ell_beta", &AircraftParameters::C_ell_beta},
+  {"C_ell_p", &AircraftParameters::C_ell_p},
+  {"C_ell_r", &AircraftParameters::C_ell_r},
+  {"C_ell_delta_a", &AircraftParameters::C_ell_delta_a},
+  {"C_ell_delta_r", &AircraftParameters::C_ell_delta_r},
+  {"C_n_0", &AircraftParameters::C_n_0},
+  {"C_n_beta", &AircraftParameters::C_n_beta},
+  {"C_n_p", &AircraftParameters::C_n_p},
+  {"C_n_r", &AircraftParameters::C_n_r},
+  {"C_n_delta_a", &AircraftParameters::C_n_delta_a},
+  {"C_n_delta_r", &AircraftParameters::C_n_delta_r},
+};
+
+AircraftParameters read_aircraft(const YAML::Node & node)
+{
+  AircraftParameters params;
+  if (!node) {
+    return params;
+  }
+
+  for (const auto & entry : node) {
+    std::string name = entry.first.as<std::string>();
+    bool found = false;
+    for (const auto & field : AIRCRAFT_FIELDS) {
+      if (name == field.first) {
+        params.*field.second = entry.second.as<double>();
+        found = true;
+      }
+    }
+    if (!found) {
+      throw std::runtime_error("Unknown aircraft parameter " + name + ".");
+    }
+  }
+
+  return params;
+}
+
+template<int N>
+Eigen::Matrix<double, N, N> read_weights(const YAML::Node & node, const std::string & name)
+{
+  std::vector<double> values = node[name].as<std::vector<double>>();
+  if (values.size() != N) {
+    throw std::runtime_error(name + " must have " + std::to_string(N) + " values.");
+  }
+  return Eigen::Map<Eigen::Matrix<double, N, 1>>(values.data()).asDiagonal();
+}
+
+template<typename Derived>
+std::vector<float> row_major(const Eigen::MatrixBase<Derived> & matrix)
+{
+  std::vector<float> values;
+  for (Eigen::Index i = 0; i < matrix.rows(); i++) {
+    for (Eigen::Index j = 0; j < matrix.cols(); j++) {
+      values.push_back(matrix(i, j));
+    }
+  }
+  return values;
+}
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+  if (argc != 3) {
+    std::cerr << "Usage: lqr_trim_sweep <sweep.yaml> <schedule.yaml>" << std::endl;
+    return 1;
+  }
+
+  AircraftParameters params;
+  std::vector<double> va;
+  std::vector<double> h;
+  double turn_rate;
+  double Ts;
+  Eigen::Matrix4d q_lon;
+  Eigen::Matrix2d r_lon;
+  Eigen::Matrix4d q_lat;
+  Eigen::Matrix2d r_lat;
+  std::string cache_dir;
+  unsigned int threads;
+
+  try {
+    YAML::Node sweep = YAML::LoadFile(argv[1]);
+    params = read_aircraft(sweep["aircraft"]);
+    va = sweep["va"].as<std::vector<double>>();
+    h = sweep["h"].as<std::vector<double>>();
+    turn_rate = sweep["turn_rate"].as<double>(0.0);
+    Ts = 1.0 / sweep["controller_output_frequency"].as<double>();
+    q_lon = read_weights<4>(sweep, "q_lon");
+    r_lon = read_weights<2>(sweep, "r_lon");
+    q_lat = read_weights<4>(sweep, "q_lat");
+    r_lat = read_weights<2>(sweep, "r_lat");
+    cache_dir = sweep["cache_dir"].as<std::string>("");
+    threads = sweep["threads"].as<unsigned int>(0);
+  } catch (std::exception & e) {
+    std::cerr << "Unable to read sweep " << argv[1] << ": " << e.what() << std::endl;
+    return 1;
+  }
+
+  // Airspeed major, matching the gain schedule layout.
+  std::vector<rosplane::FlightCondition> conditions;
+  for (double va_i : va) {
+    for (double h_j : h) {
+      conditions.push_back({va_i, h_j, turn_rate});
+    }
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<rosplane::TrimLinearization> results =
+    rosplane::sweep_trim_linearization(params, conditions, cache_dir, threads);
+  double sweep_s =
+    std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "Trimmed and linearized " << results.size() << " flight conditions in " << sweep_s
+            << " s." << std::endl;
+
+  // Neighbouring conditions have similar gains, so each DARE is warm started from the last.
+  rosplane::DareSolver<4, 2> lon_solver;
+  rosplane::DareSolver<4, 2> lat_solver;
+
+  YAML::Emitter out;
+  out << YAML::BeginMap;
+  out << YAML::Key << "va" << YAML::Value << YAML::Flow << va;
+  out << YAML::Key << "h" << YAML::Value << YAML::Flow << h;
+  out << YAML::Key << "points" << YAML::Value << YAML::BeginSeq;
+
+  for (const rosplane::TrimLinearization & result : results) {
+    const rosplane::FlightCondition & condition = result.condition;
+    if (!result.trim.converged) {
+      std::cerr << "No trim at va " << condition.va << " m/s, h " << condition.h
+                << " m (residual " << result.trim.residual << ")." << std::endl;
+      return 1;
+    }
+
+    rosplane::LinearModel lon = rosplane::discretize(result.longitudinal, Ts);
+    rosplane::LinearModel lat = rosplane::discretize(result.lateral, Ts);
+    if (!lon_solver.solve(lon.A, lon.B, q_lon, r_lon)
+        || !lat_solver.solve(lat.A, lat.B, q_lat, r_lat)) {
+      std::cerr << "No LQR solution at va " << condition.va << " m/s, h " << condition.h << " m."
+                << std::endl;
+      return 1;
+    }
+
+    out << YAML::BeginMap;
+    out << YAML::Key << "k_lon" << YAML::Value << YAML::Flow << row_major(lon_solver.gain());
+    out << YAML::Key << "k_lat" << YAML::Value << YAML::Flow << row_major(lat_solver.gain());
+    out << YAML::Key << "u_trim" << YAML::Value << YAML::Flow
+        << row_major(result.trim.delta.transpose());
+    out << YAML::EndMap;
+  }
+
+  out << YAML::EndSeq;
+  out << YAML::EndMap;
+
+  std::ofstream file(argv[2]);
+  file << out.c_str() << std::endl;
+  if (!file) {
+    std::cerr << "Unable to write schedule " << argv[2] << "." << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
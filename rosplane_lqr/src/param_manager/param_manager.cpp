@@ -1,4 +1,4 @@
-#include <variant>
+#include <utility>
 
 #include "param_manager.hpp"
 
@@ -6,191 +6,209 @@ namespace rosplane
 {
 
 ParamManager::ParamManager(rclcpp::Node * node)
-    : container_node_{node}
+    : owned_store_{std::make_unique<ParamStore>()}
+    , store_{*owned_store_}
+    , ros_declared_{0}
+    , committing_{false}
+    , container_node_{node}
 {}
 
-void ParamManager::declare_double(std::string param_name, double value)
+ParamManager::ParamManager(rclcpp::Node * node, ParamStore & store)
+    : store_{store}
+    , ros_declared_{0}
+    , committing_{false}
+    , container_node_{node}
+{}
+
+DoubleParam ParamManager::declare_double(const std::string & param_name, double value)
 {
-  // Insert the parameter into the parameter struct
-  params_[param_name] = value;
-  // Declare each of the parameters, making it visible to the ROS2 param system.
-  container_node_->declare_parameter(param_name, value);
+  return store_.declare_double(param_name, value);
 }
 
-void ParamManager::declare_bool(std::string param_name, bool value)
+BoolParam ParamManager::declare_bool(const std::string & param_name, bool value)
 {
-  // Insert the parameter into the parameter struct
-  params_[param_name] = value;
-  // Declare each of the parameters, making it visible to the ROS2 param system.
-  container_node_->declare_parameter(param_name, value);
+  return store_.declare_bool(param_name, value);
 }
 
-void ParamManager::declare_int(std::string param_name, int64_t value)
+IntParam ParamManager::declare_int(const std::string & param_name, int64_t value)
 {
-  // Insert the parameter into the parameter struct
-  params_[param_name] = value;
-  // Declare each of the parameters, making it visible to the ROS2 param system.
-  container_node_->declare_parameter(param_name, value);
+  return store_.declare_int(param_name, value);
 }
 
-void ParamManager::declare_string(std::string param_name, std::string value)
+StringParam ParamManager::declare_string(const std::string & param_name, const std::string & value)
 {
-  // Insert the parameter into the parameter struct
-  params_[param_name] = value;
-  // Declare each of the parameters, making it visible to the ROS2 param system.
-  container_node_->declare_parameter(param_name, value);
+  return store_.declare_string(param_name, value);
 }
 
-void ParamManager::set_double(std::string param_name, double value)
+rclcpp::ParameterValue ParamManager::to_ros(const ParamValue & value)
 {
-  // Check that the parameter is in the parameter struct
-  if (params_.find(param_name) == params_.end()) {
-    RCLCPP_ERROR_STREAM(container_node_->get_logger(),
-                        "Parameter not found in parameter struct: " + param_name);
-    return;
-  }
-
-  // Set the parameter in the parameter struct
-  params_[param_name] = value;
-  // Set the parameter in the ROS2 param system
-  container_node_->set_parameter(rclcpp::Parameter(param_name, value));
+  return std::visit([](const auto & v) { return rclcpp::ParameterValue(v); }, value);
 }
 
-void ParamManager::set_bool(std::string param_name, bool value)
+bool ParamManager::from_ros(const rclcpp::ParameterValue & ros_value, ParamValue & value)
 {
-  // Check that the parameter is in the parameter struct
-  if (params_.find(param_name) == params_.end()) {
-    RCLCPP_ERROR_STREAM(container_node_->get_logger(),
-                        "Parameter not found in parameter struct: " + param_name);
-    return;
+  switch (ros_value.get_type()) {
+    case rclcpp::ParameterType::PARAMETER_DOUBLE:
+      value = ros_value.get<double>();
+      return true;
+    case rclcpp::ParameterType::PARAMETER_BOOL:
+      value = ros_value.get<bool>();
+      return true;
+    case rclcpp::ParameterType::PARAMETER_INTEGER:
+      value = ros_value.get<int64_t>();
+      return true;
+    case rclcpp::ParameterType::PARAMETER_STRING:
+      value = ros_value.get<std::string>();
+      return true;
+    default:
+      return false;
   }
-
-  // Set the parameter in the parameter struct
-  params_[param_name] = value;
-  // Set the parameter in the ROS2 param system
-  container_node_->set_parameter(rclcpp::Parameter(param_name, value));
 }
 
-void ParamManager::set_int(std::string param_name, int64_t value)
+bool ParamManager::set(const std::string & param_name, ParamValue value)
 {
-  // Check that the parameter is in the parameter struct
-  if (params_.find(param_name) == params_.end()) {
-    RCLCPP_ERROR_STREAM(container_node_->get_logger(),
-                        "Parameter not found in parameter struct: " + param_name);
-    return;
+  // Check that the parameter is in the parameter struct, with the type of the value
+  std::string error;
+  if (!store_.set({{param_name, std::move(value)}}, error)) {
+    RCLCPP_ERROR_STREAM(container_node_->get_logger(), error);
+    return false;
   }
-
-  // Set the parameter in the parameter struct
-  params_[param_name] = value;
-  // Set the parameter in the ROS2 param system
-  container_node_->set_parameter(rclcpp::Parameter(param_name, value));
+  return true;
 }
 
-void ParamManager::set_string(std::string param_name, std::string value)
+void ParamManager::set_double(const std::string & param_name, double value)
 {
-  // Check that the parameter is in the parameter struct
-  if (params_.find(param_name) == params_.end()) {
-    RCLCPP_ERROR_STREAM(container_node_->get_logger(),
-                        "Parameter not found in parameter struct: " + param_name);
-    return;
+  // Set the parameter in the parameter struct, then in the ROS2 param system
+  if (set(param_name, value)) {
+    container_node_->set_parameter(rclcpp::Parameter(param_name, value));
   }
-
-  // Set the parameter in the parameter struct
-  params_[param_name] = value;
-  // Set the parameter in the ROS2 param system
-  container_node_->set_parameter(rclcpp::Parameter(param_name, value));
 }
 
-double ParamManager::get_double(std::string param_name)
+void ParamManager::set_bool(const std::string & param_name, bool value)
 {
-  try {
-    return std::get<double>(params_[param_name]);
-  } catch (std::bad_variant_access & e) {
-    RCLCPP_ERROR_STREAM(container_node_->get_logger(), "ERROR GETTING PARAMETER: " + param_name);
-    throw std::runtime_error(e.what());
+  // Set the parameter in the parameter struct, then in the ROS2 param system
+  if (set(param_name, value)) {
+    container_node_->set_parameter(rclcpp::Parameter(param_name, value));
   }
 }
 
-bool ParamManager::get_bool(std::string param_name)
+void ParamManager::set_int(const std::string & param_name, int64_t value)
 {
-  try {
-    return std::get<bool>(params_[param_name]);
-  } catch (std::bad_variant_access & e) {
-    RCLCPP_ERROR_STREAM(container_node_->get_logger(), "ERROR GETTING PARAMETER: " + param_name);
-    throw std::runtime_error(e.what());
+  // Set the parameter in the parameter struct, then in the ROS2 param system
+  if (set(param_name, value)) {
+    container_node_->set_parameter(rclcpp::Parameter(param_name, value));
   }
 }
 
-int64_t ParamManager::get_int(std::string param_name)
+void ParamManager::set_string(const std::string & param_name, const std::string & value)
 {
-  try {
-    return std::get<int64_t>(params_[param_name]);
-  } catch (std::bad_variant_access & e) {
-    RCLCPP_ERROR_STREAM(container_node_->get_logger(), "ERROR GETTING PARAMETER: " + param_name);
-    throw std::runtime_error(e.what());
+  // Set the parameter in the parameter struct, then in the ROS2 param system
+  if (set(param_name, value)) {
+    container_node_->set_parameter(rclcpp::Parameter(param_name, value));
   }
 }
 
-std::string ParamManager::get_string(std::string param_name)
+double ParamManager::get_double(const std::string & param_name)
 {
-  try {
-    return std::get<std::string>(params_[param_name]);
-  } catch (std::bad_variant_access & e) {
-    RCLCPP_ERROR_STREAM(container_node_->get_logger(), "ERROR GETTING PARAMETER: " + param_name);
-    throw std::runtime_error(e.what());
-  }
+  // A parameter read before it is committed is committed now, so it has a value.
+  commit();
+  return get(handle<double>(param_name));
 }
 
-void ParamManager::set_parameters()
+bool ParamManager::get_bool(const std::string & param_name)
+{
+  // A parameter read before it is committed is committed now, so it has a value.
+  commit();
+  return get(handle<bool>(param_name));
+}
+
+int64_t ParamManager::get_int(const std::string & param_name)
+{
+  // A parameter read before it is committed is committed now, so it has a value.
+  commit();
+  return get(handle<int64_t>(param_name));
+}
+
+std::string ParamManager::get_string(const std::string & param_name)
 {
+  // A parameter read before it is committed is committed now, so it has a value.
+  commit();
+  return get(handle<std::string>(param_name));
+}
 
-  // Get the parameters from the launch file, if given.
-  // If not, use the default value defined at declaration
-  for (const auto & [key, value] : params_) {
-    auto type = container_node_->get_parameter(key).get_type();
-    if (type == rclcpp::ParameterType::PARAMETER_DOUBLE)
-      params_[key] = container_node_->get_parameter(key).as_double();
-    else if (type == rclcpp::ParameterType::PARAMETER_BOOL)
-      params_[key] = container_node_->get_parameter(key).as_bool();
-    else if (type == rclcpp::ParameterType::PARAMETER_INTEGER)
-      params_[key] = container_node_->get_parameter(key).as_int();
-    else if (type == rclcpp::ParameterType::PARAMETER_STRING)
-      params_[key] = container_node_->get_parameter(key).as_string();
-    else
+void ParamManager::commit()
+{
+  // The store publishes the defaults first, which become the ROS2 defaults of the parameters.
+  store_.commit();
+  if (ros_declared_ == store_.committed_count()) {
+    return;
+  }
+  std::vector<std::string> names = store_.names();
+
+  // Declare each of the new parameters, making it visible to the ROS2 param system. The declaration resolves the value
+  // from the launch file, if given, or the default defined at declaration, so no separate lookup is needed.
+  std::vector<std::pair<std::string, ParamValue>> values;
+  values.reserve(names.size() - ros_declared_);
+  committing_ = true;
+  for (std::size_t i = ros_declared_; i < names.size(); i++) {
+    ParamValue default_value;
+    store_.value(names[i], default_value);
+    ParamValue value;
+    if (!from_ros(container_node_->declare_parameter(names[i], to_ros(default_value)), value)
+        || value.index() != default_value.index()) {
       RCLCPP_ERROR_STREAM(container_node_->get_logger(),
-                          "Unable to set parameter: " + key
+                          "Unable to set parameter: " + names[i]
                             + ". Error casting parameter as double, int, string, or bool!");
+      value = default_value;
+    }
+    values.emplace_back(names[i], std::move(value));
+  }
+  committing_ = false;
+  ros_declared_ = names.size();
+
+  // Publish all of the new values at once.
+  std::string error;
+  if (!store_.set(values, error)) {
+    RCLCPP_ERROR_STREAM(container_node_->get_logger(), error);
   }
 }
 
-bool ParamManager::set_parameters_callback(const std::vector<rclcpp::Parameter> & parameters)
+void ParamManager::set_parameters()
 {
-  // Check each parameter in the incoming vector of parameters to change, and change the appropriate parameter.
-  for (const auto & param : parameters) {
+  commit();
+}
 
-    // Check if the parameter is in the params object or return an error
-    if (params_.find(param.get_name()) == params_.end()) {
-      RCLCPP_ERROR_STREAM(
-        container_node_->get_logger(),
-        "One of the parameters given is not a parameter of the controller node. Parameter: "
-          + param.get_name());
-      return false;
-    }
+bool ParamManager::set_parameters_callback(const std::vector<rclcpp::Parameter> & parameters)
+{
+  // The initial values from the declarations are stored by commit, once they are all known.
+  if (committing_) {
+    return true;
+  }
 
-    if (param.get_type() == rclcpp::ParameterType::PARAMETER_DOUBLE)
-      params_[param.get_name()] = param.as_double();
-    else if (param.get_type() == rclcpp::ParameterType::PARAMETER_BOOL)
-      params_[param.get_name()] = param.as_bool();
-    else if (param.get_type() == rclcpp::ParameterType::PARAMETER_INTEGER)
-      params_[param.get_name()] = param.as_int();
-    else if (param.get_type() == rclcpp::ParameterType::PARAMETER_STRING)
-      params_[param.get_name()] = param.as_string();
-    else
+  // Check each parameter in the incoming vector of parameters to change, and convert it for the store.
+  std::vector<std::pair<std::string, ParamValue>> values;
+  values.reserve(parameters.size());
+  for (const auto & param : parameters) {
+    ParamValue value;
+    if (!from_ros(param.get_parameter_value(), value)) {
       RCLCPP_ERROR_STREAM(container_node_->get_logger(),
                           "Unable to determine parameter type in controller. Type is "
                             + std::to_string(param.get_type()));
+      return false;
+    }
+    values.emplace_back(param.get_name(), std::move(value));
+  }
+
+  // All of the changes go into one new snapshot, so readers see either none or all of them. The store keeps each
+  // parameter the type it was declared with.
+  std::string error;
+  if (!store_.set(values, error)) {
+    RCLCPP_ERROR_STREAM(
+      container_node_->get_logger(),
+      "One of the parameters given is not a parameter of the controller node. " + error);
+    return false;
   }
   return true;
 }
 
-} // namespace rosplane
\ No newline at end of file
+} // namespace rosplane
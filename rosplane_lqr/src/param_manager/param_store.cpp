@@ -0,0 +1,320 @@
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+
+#include "param_store.hpp"
+
+namespace rosplane
+{
+
+ParamStore::ParamStore()
+    : declared_counts_{}
+    , hashed_counts_{SIZE_MAX, SIZE_MAX, SIZE_MAX, SIZE_MAX}
+    , control_ready_(nullptr)
+    , control_retired_(nullptr)
+    , control_active_(nullptr)
+{
+  std::lock_guard<std::mutex> lock(update_mutex_);
+  publish(std::make_shared<ParamSnapshot>());
+}
+
+ParamStore::~ParamStore()
+{
+  free_retired();
+  delete control_ready_.exchange(nullptr);
+  delete control_active_;
+}
+
+std::shared_ptr<const ParamSnapshot> ParamStore::snapshot() const
+{
+  std::lock_guard<std::mutex> lock(snapshot_mutex_);
+  return snapshot_;
+}
+
+const ParamSnapshot & ParamStore::control_snapshot()
+{
+  ControlBlock * fresh = control_ready_.exchange(nullptr, std::memory_order_acquire);
+
+  if (fresh != nullptr) {
+    // Hand the block being replaced back to the updates to free, so the control loop never deallocates.
+    if (control_active_ != nullptr) {
+      control_active_->next = control_retired_.load(std::memory_order_relaxed);
+      while (!control_retired_.compare_exchange_weak(control_active_->next, control_active_,
+                                                     std::memory_order_release,
+                                                     std::memory_order_relaxed)) {
+      }
+    }
+    control_active_ = fresh;
+  }
+
+  return *control_active_->snapshot;
+}
+
+uint64_t ParamStore::hash(const ParamSnapshot & values) const
+{
+  uint64_t hash = 0xcbf29ce484222325;
+  auto add = [&hash](const void * data, std::size_t size) {
+    const unsigned char * bytes = static_cast<const unsigned char *>(data);
+    for (std::size_t i = 0; i < size; i++) {
+      hash = (hash ^ bytes[i]) * 0x100000001b3;
+    }
+  };
+
+  for (std::size_t i = 0; i < values.doubles_.size() && i < hashed_counts_[0]; i++) {
+    add(&values.doubles_[i], sizeof(double));
+  }
+  for (std::size_t i = 0; i < values.bools_.size() && i < hashed_counts_[1]; i++) {
+    unsigned char value = values.bools_[i];
+    add(&value, 1);
+  }
+  for (std::size_t i = 0; i < values.ints_.size() && i < hashed_counts_[2]; i++) {
+    add(&values.ints_[i], sizeof(int64_t));
+  }
+  for (std::size_t i = 0; i < values.strings_.size() && i < hashed_counts_[3]; i++) {
+    // The terminating null keeps neighbouring strings apart.
+    add(values.strings_[i].c_str(), values.strings_[i].size() + 1);
+  }
+  return hash;
+}
+
+void ParamStore::publish(std::shared_ptr<const ParamSnapshot> next)
+{
+  free_retired();
+
+  // A block the control loop never picked up can be freed right away.
+  delete control_ready_.exchange(new ControlBlock{next, nullptr}, std::memory_order_acq_rel);
+
+  std::lock_guard<std::mutex> lock(snapshot_mutex_);
+  snapshot_ = std::move(next);
+}
+
+void ParamStore::free_retired()
+{
+  ControlBlock * block = control_retired_.exchange(nullptr, std::memory_order_acquire);
+  while (block != nullptr) {
+    ControlBlock * next = block->next;
+    delete block;
+    block = next;
+  }
+}
+
+std::size_t ParamStore::declare(const std::string & param_name, ParamValue default_value)
+{
+  ParamType type = static_cast<ParamType>(default_value.index());
+
+  // Reuse the slot if the parameter was already declared.
+  auto slot = slots_.find(param_name);
+  if (slot != slots_.end() && slot->second.type == type) {
+    return slot->second.index;
+  }
+
+  // Insert the parameter into the parameter struct. Its value is stored when it is committed.
+  ParamSlot new_slot{type, declared_counts_[static_cast<std::size_t>(type)]++};
+  slots_.insert_or_assign(param_name, new_slot);
+  pending_.push_back({param_name, new_slot, std::move(default_value)});
+  return new_slot.index;
+}
+
+DoubleParam ParamStore::declare_double(const std::string & param_name, double value)
+{
+  return DoubleParam{declare(param_name, ParamValue(value))};
+}
+
+BoolParam ParamStore::declare_bool(const std::string & param_name, bool value)
+{
+  return BoolParam{declare(param_name, ParamValue(value))};
+}
+
+IntParam ParamStore::declare_int(const std::string & param_name, int64_t value)
+{
+  return IntParam{declare(param_name, ParamValue(value))};
+}
+
+StringParam ParamStore::declare_string(const std::string & param_name, const std::string & value)
+{
+  return StringParam{declare(param_name, ParamValue(value))};
+}
+
+const ParamStore::ParamSlot * ParamStore::find(const std::string & param_name,
+                                               ParamType type) const
+{
+  auto slot = slots_.find(param_name);
+  if (slot == slots_.end() || slot->second.type != type) {
+    return nullptr;
+  }
+  return &slot->second;
+}
+
+template<typename T>
+ParamHandle<T> ParamStore::handle(const std::string & param_name) const
+{
+  ParamType type;
+  if constexpr (std::is_same_v<T, double>) {
+    type = ParamType::DOUBLE;
+  } else if constexpr (std::is_same_v<T, bool>) {
+    type = ParamType::BOOL;
+  } else if constexpr (std::is_same_v<T, int64_t>) {
+    type = ParamType::INT;
+  } else {
+    type = ParamType::STRING;
+  }
+
+  const ParamSlot * slot = find(param_name, type);
+  if (slot == nullptr) {
+    throw std::runtime_error("Parameter " + param_name
+                             + " is not declared with the requested type.");
+  }
+  return ParamHandle<T>{slot->index};
+}
+
+template DoubleParam ParamStore::handle<double>(const std::string & param_name) const;
+template BoolParam ParamStore::handle<bool>(const std::string & param_name) const;
+template IntParam ParamStore::handle<int64_t>(const std::string & param_name) const;
+template StringParam ParamStore::handle<std::string>(const std::string & param_name) const;
+
+double ParamStore::get_double(const std::string & param_name)
+{
+  // A parameter read before it is committed is committed now, so it has a value.
+  commit();
+  return get(handle<double>(param_name));
+}
+
+bool ParamStore::get_bool(const std::string & param_name)
+{
+  // A parameter read before it is committed is committed now, so it has a value.
+  commit();
+  return get(handle<bool>(param_name));
+}
+
+int64_t ParamStore::get_int(const std::string & param_name)
+{
+  // A parameter read before it is committed is committed now, so it has a value.
+  commit();
+  return get(handle<int64_t>(param_name));
+}
+
+std::string ParamStore::get_string(const std::string & param_name)
+{
+  // A parameter read before it is committed is committed now, so it has a value.
+  commit();
+  return get(handle<std::string>(param_name));
+}
+
+bool ParamStore::value(const std::string & param_name, ParamValue & param_value) const
+{
+  std::shared_ptr<const ParamSnapshot> values = snapshot();
+  auto slot = slots_.find(param_name);
+  if (slot == slots_.end() || !holds(*values, slot->second)) {
+    return false;
+  }
+
+  std::size_t index = slot->second.index;
+  switch (slot->second.type) {
+    case ParamType::DOUBLE:
+      param_value = values->doubles_[index];
+      break;
+    case ParamType::BOOL:
+      param_value = static_cast<bool>(values->bools_[index]);
+      break;
+    case ParamType::INT:
+      param_value = values->ints_[index];
+      break;
+    case ParamType::STRING:
+      param_value = values->strings_[index];
+      break;
+  }
+  return true;
+}
+
+std::vector<std::string> ParamStore::names() const { return committed_; }
+
+void ParamStore::close_hash()
+{
+  std::lock_guard<std::mutex> lock(update_mutex_);
+  hashed_counts_ = declared_counts_;
+}
+
+bool ParamStore::holds(const ParamSnapshot & values, const ParamSlot & slot)
+{
+  switch (slot.type) {
+    case ParamType::DOUBLE:
+      return slot.index < values.doubles_.size();
+    case ParamType::BOOL:
+      return slot.index < values.bools_.size();
+    case ParamType::INT:
+      return slot.index < values.ints_.size();
+    case ParamType::STRING:
+      return slot.index < values.strings_.size();
+  }
+  return false;
+}
+
+void ParamStore::store(ParamSnapshot & values, const ParamSlot & slot, const ParamValue & value)
+{
+  switch (slot.type) {
+    case ParamType::DOUBLE:
+      values.doubles_[slot.index] = std::get<double>(value);
+      break;
+    case ParamType::BOOL:
+      values.bools_[slot.index] = std::get<bool>(value);
+      break;
+    case ParamType::INT:
+      values.ints_[slot.index] = std::get<int64_t>(value);
+      break;
+    case ParamType::STRING:
+      values.strings_[slot.index] = std::get<std::string>(value);
+      break;
+  }
+}
+
+void ParamStore::commit()
+{
+  if (pending_.empty()) {
+    return;
+  }
+
+  // Publish all of the new values at once.
+  update([&](ParamSnapshot & snapshot) {
+    snapshot.doubles_.resize(declared_counts_[static_cast<std::size_t>(ParamType::DOUBLE)]);
+    snapshot.bools_.resize(declared_counts_[static_cast<std::size_t>(ParamType::BOOL)]);
+    snapshot.ints_.resize(declared_counts_[static_cast<std::size_t>(ParamType::INT)]);
+    snapshot.strings_.resize(declared_counts_[static_cast<std::size_t>(ParamType::STRING)]);
+
+    for (const PendingDeclaration & declaration : pending_) {
+      store(snapshot, declaration.slot, declaration.default_value);
+    }
+    return true;
+  });
+
+  for (const PendingDeclaration & declaration : pending_) {
+    committed_.push_back(declaration.name);
+  }
+  pending_.clear();
+}
+
+bool ParamStore::set(const std::vector<std::pair<std::string, ParamValue>> & values,
+                     std::string & error)
+{
+  // All of the changes go into one new snapshot, so readers see either none or all of them.
+  return update([&](ParamSnapshot & snapshot) {
+    for (const auto & [name, value] : values) {
+
+      // Check if the parameter is in the params object or return an error
+      auto slot = slots_.find(name);
+      if (slot == slots_.end() || !holds(snapshot, slot->second)) {
+        error = "Parameter not found in parameter struct: " + name;
+        return false;
+      }
+
+      // The value arrays are typed, so a parameter keeps the type it was declared with.
+      if (static_cast<ParamType>(value.index()) != slot->second.type) {
+        error = "Parameter " + name + " was given a value of the wrong type.";
+        return false;
+      }
+      store(snapshot, slot->second, value);
+    }
+    return true;
+  });
+}
+
+} // namespace rosplane
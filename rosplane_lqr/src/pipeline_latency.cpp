@@ -0,0 +1,69 @@
+#include "pipeline_latency.hpp"
+
+namespace rosplane
+{
+
+namespace
+{
+
+// Delays between 10 us and 1 s, anything slower is in the last bucket.
+constexpr double MIN_DELAY_US = 10.0;
+constexpr double MAX_DELAY_US = 1'000'000.0;
+
+} // namespace
+
+PipelineLatency::PipelineLatency()
+    : histograms_{{
+      LatencyHistogram<24>(MIN_DELAY_US, MAX_DELAY_US),
+      LatencyHistogram<24>(MIN_DELAY_US, MAX_DELAY_US),
+      LatencyHistogram<24>(MIN_DELAY_US, MAX_DELAY_US),
+      LatencyHistogram<24>(MIN_DELAY_US, MAX_DELAY_US),
+      LatencyHistogram<24>(MIN_DELAY_US, MAX_DELAY_US),
+    }}
+    , samples_(0)
+    , invalid_(0)
+{}
+
+void PipelineLatency::record(const PipelineStamps & stamps)
+{
+  record_stage(ESTIMATION, stamps.sensor_ns, stamps.state_ns);
+  record_stage(STATE_TRANSPORT, stamps.state_ns, stamps.state_received_ns);
+  record_stage(STATE_QUEUE, stamps.state_received_ns, stamps.tick_ns);
+  record_stage(CONTROL, stamps.tick_ns, stamps.command_ns);
+  record_stage(END_TO_END, stamps.sensor_ns, stamps.command_ns);
+  samples_++;
+}
+
+void PipelineLatency::record_stage(PipelineStage stage, int64_t from_ns, int64_t to_ns)
+{
+  if (from_ns == 0 || to_ns == 0) {
+    return;
+  }
+
+  // A stamp from a clock that runs ahead of ours gives a negative delay, which says nothing about the stage.
+  if (to_ns < from_ns) {
+    invalid_++;
+    return;
+  }
+
+  histograms_[stage].record((to_ns - from_ns) / 1'000.0);
+}
+
+void PipelineLatency::summarize()
+{
+  PipelineLatencySummary summary;
+  summary.samples = samples_;
+  summary.invalid = invalid_;
+  for (std::size_t i = 0; i < PIPELINE_STAGES; i++) {
+    summary.stages[i].p50_us = histograms_[i].percentile(0.5);
+    summary.stages[i].p99_us = histograms_[i].percentile(0.99);
+    summary.stages[i].max_us = histograms_[i].max();
+    histograms_[i].reset();
+  }
+  summary_.store(summary);
+
+  samples_ = 0;
+  invalid_ = 0;
+}
+
+} // namespace rosplane
@@ -1,103 +1,304 @@
+#include <charconv>
 #include <cmath>
+#include <functional>
+#include <string>
+
+#include <rclcpp_components/register_node_macro.hpp>
 
 #include "python_controller_interface.hpp"
 
 namespace rosplane
 {
 
-double wrap_within_180(double fixed_heading, double wrapped_heading)
+PythonControllerInterface::PythonControllerInterface(const rclcpp::NodeOptions & options)
+    : ControllerBase(std::make_unique<LqrController>(), options)
+    , lqr_(static_cast<LqrController &>(*core_))
+    , service_seq_(0)
+    , service_accepted_seq_(0)
+    , service_command_valid_(false)
+    , service_sent_(0)
+    , service_received_(0)
+    , service_late_(0)
+    , service_stale_(0)
+    , service_dropped_(0)
+    , service_fallback_ticks_(0)
+    , service_rtt_hist_(100.0, 1'000'000.0)
+    , lqr_stats_window_(0)
+    , published_lqr_stats_window_(0)
 {
-  // wrapped_heading - number_of_times_to_wrap * 2pi
-  return wrapped_heading - floor((wrapped_heading - fixed_heading) / (2 * M_PI) + 0.5) * 2 * M_PI;
-}
 
-PythonControllerInterface::PythonControllerInterface()
-{
-
-  lqr_controller_client = this->create_client<lqr_srvs::srv::LqrControl>("lqr_controller_update");
-  // Declare parameters associated with this controller, controller_state_machine
+  // The service responses and path updates touch the state of the control law, so they are in the control callback
+  // group.
+  lqr_controller_client = this->create_client<lqr_srvs::srv::LqrControl>(
+    "lqr_controller_update", rmw_qos_profile_services_default, control_callback_group_);
+  service_request_ = std::make_shared<lqr_srvs::srv::LqrControl::Request>();
+  lqr_call_stats_pub_ = this->create_publisher<lqr_srvs::msg::LqrCallStats>("lqr_call_stats", 10);
+  lqr_service_stats_pub_ =
+    this->create_publisher<lqr_srvs::msg::LqrServiceStats>("lqr_service_stats", 10);
+  mpc_solver_stats_pub_ =
+    LoanedPublisher<lqr_srvs::msg::MpcSolverStats>(*this, "mpc_solver_stats", 10);
+  rclcpp::SubscriptionOptions control_subscription_options;
+  control_subscription_options.callback_group = control_callback_group_;
+  current_path_sub_ = this->create_subscription<rosplane_msgs::msg::CurrentPath>(
+    "current_path", 10, std::bind(&PythonControllerInterface::current_path_callback, this, _1),
+    control_subscription_options);
+  // Declare parameters associated with the service backend
   declare_parameters();
-  // Set parameters according to the parameters in the launch file, otherwise use the default values
-  params_.set_parameters();
-}
+  // Set parameters according to the parameters in the launch file, otherwise use the default values.
+  params_.commit();
 
-void PythonControllerInterface::take_off(const Input & input, Output & output)
-{
-  // Run lateral and longitudinal controls.
+  // Attach the service law, then set up the backend with the values from the launch before the control loop starts.
+  lqr_.set_service(this);
+  core_->apply_parameters();
+
+  // The statistics are summarized by the control loop, the timer only publishes them.
+  lqr_call_stats_timer_ = this->create_wall_timer(
+    250ms, std::bind(&PythonControllerInterface::publish_lqr_call_stats, this));
 }
 
-void PythonControllerInterface::take_off_exit()
+void PythonControllerInterface::current_path_callback(
+  const rosplane_msgs::msg::CurrentPath::ConstSharedPtr msg)
 {
-  // Put any code that should run as the airplane exits take off mode.
+  LqrController::PathSegment path;
+  path.orbit = msg->path_type == rosplane_msgs::msg::CurrentPath::ORBIT_PATH;
+  path.va_d = msg->va_d;
+  path.r = msg->r;
+  path.q = msg->q;
+  path.c = msg->c;
+  path.rho = msg->rho;
+  path.lamda = msg->lamda;
+  lqr_.set_path(path);
 }
 
-void PythonControllerInterface::climb(const Input & input, Output & output)
+void PythonControllerInterface::after_control()
 {
-  // Run lateral and longitudinal controls.
+  summarize_lqr_stats();
+
+  LqrController::MpcSolveSummary summary;
+  if (!lqr_.take_mpc_summary(summary)) {
+    return;
+  }
+
+  rclcpp::Time now = this->get_clock()->now();
+  mpc_solver_stats_pub_.publish([&](lqr_srvs::msg::MpcSolverStats & stats) {
+    stats.header.stamp = now;
+    stats.solve_time_us = summary.solve_time_us;
+    stats.max_solve_time_us = summary.max_solve_time_us;
+    stats.budget_us = summary.budget_us;
+    stats.lon_iterations = summary.lon_iterations;
+    stats.lat_iterations = summary.lat_iterations;
+    stats.iteration_cap_hit = summary.iteration_cap_hit;
+  });
 }
 
-void PythonControllerInterface::climb_exit()
+bool PythonControllerInterface::evaluate(const Input & input, const Reference & reference,
+                                         const LqrGains & gains, Output & output)
 {
-  // Put any code that should run as the airplane exits take off mode.
+  // For readability, declare parameters here that will be used in this function
+  double deadline = param_snapshot_->get(service_params_.lqr_service_deadline);
+  double hold_tau = param_snapshot_->get(service_params_.lqr_service_hold_tau);
+  double drop_timeout = param_snapshot_->get(service_params_.lqr_service_drop_timeout);
+
+  auto now = std::chrono::steady_clock::now();
+
+  // Forget requests that will never be answered, so the pending request list does not grow without bound.
+  service_dropped_ += lqr_controller_client->prune_requests_older_than(
+    std::chrono::system_clock::now()
+    - std::chrono::duration_cast<std::chrono::system_clock::duration>(
+      std::chrono::duration<double>(drop_timeout)));
+
+  // Send this tick's request. The response is handled by the executor whenever it arrives. The request is serialized
+  // when it is sent, so the same one is refilled every tick. The client still allocates to track the pending request.
+  if (lqr_controller_client->service_is_ready()) {
+    auto & request = service_request_;
+    request->request_header.stamp = this->get_clock()->now();
+    // The sequence number is written in place, the frame id keeps its capacity from tick to tick.
+    char seq[24];
+    char * seq_end = std::to_chars(seq, seq + sizeof(seq), service_seq_).ptr;
+    request->request_header.frame_id.assign(seq, seq_end);
+    request->state.position[2] = -input.h;
+    request->state.va = input.va;
+    request->state.phi = input.phi;
+    request->state.theta = input.theta;
+    request->state.chi = input.chi;
+    request->state.p = input.p;
+    request->state.q = input.q;
+    request->state.r = input.r;
+    request->controller_commands.va_c = reference.va;
+    request->controller_commands.h_c = reference.h;
+    request->controller_commands.chi_c = reference.chi;
+    request->controller_commands.phi_ff = reference.phi;
+    request->controller_commands.theta_c = reference.theta;
+
+    lqr_controller_client->async_send_request(
+      request,
+      [this, seq = service_seq_,
+       sent = now](rclcpp::Client<lqr_srvs::srv::LqrControl>::SharedFuture future) {
+        service_response_callback(seq, sent, future);
+      });
+    service_seq_++;
+    service_sent_++;
+  }
+
+  if (!service_command_valid_) {
+    return false;
+  }
+
+  // The age of the command is measured from when the state it was computed from was sent.
+  double age = std::chrono::duration<double>(now - service_command_time_).count();
+  if (age > drop_timeout) {
+    // The service has stopped answering, let the native law fly the aircraft.
+    return false;
+  }
+
+  // Hold the last valid command, decaying towards trim once it has missed the deadline.
+  float decay = 1.0;
+  if (age > deadline) {
+    service_fallback_ticks_++;
+    if (hold_tau > 0.0) {
+      decay = std::exp(-(age - deadline) / hold_tau);
+    }
+  }
+
+  Eigen::Vector4f u = gains.u_trim + decay * (service_u_ - gains.u_trim);
+  output.delta_e = u(0);
+  output.delta_a = u(1);
+  output.delta_r = u(2);
+  output.delta_t = u(3);
+
+  return true;
 }
 
-void PythonControllerInterface::altitude_hold(const Input & input, Output & output)
+void PythonControllerInterface::selected()
 {
-  // Run lateral and longitudinal controls.
+  // Do not reuse a command from before the backend was selected.
+  service_command_valid_ = false;
 }
 
-void PythonControllerInterface::altitude_hold_exit()
+void PythonControllerInterface::service_response_callback(
+  uint64_t seq, std::chrono::steady_clock::time_point sent,
+  rclcpp::Client<lqr_srvs::srv::LqrControl>::SharedFuture future)
 {
+  double rtt_us =
+    std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - sent).count();
 
-}
+  service_received_++;
+  service_rtt_hist_.record(rtt_us);
 
-  
-void PythonControllerInterface::lqr_control(const Input & input, Output & output)
-{
+  // Only accept responses that met the deadline and are newer than the command already in use. The two are counted
+  // apart, so a slow service can be told from one that answers out of order. Responses arrive in the control group, so
+  // the deadline is read from the control loop's snapshot without locking.
+  double deadline = params_.store().control_snapshot().get(service_params_.lqr_service_deadline);
+  if (rtt_us > deadline * 1'000'000) {
+    service_late_++;
+    return;
+  }
+  if (service_command_valid_ && seq <= service_accepted_seq_) {
+    service_stale_++;
+    return;
+  }
 
+  // The command holds the deflections in the same layout the actuators are published in.
+  auto response = future.get();
+  service_u_ << response->command.y, response->command.x, response->command.z,
+    response->command.f;
+
+  service_accepted_seq_ = seq;
+  service_command_time_ = sent;
+  service_command_valid_ = true;
 }
 
-float PythonControllerInterface::sat(float value, float up_limit, float low_limit)
+void PythonControllerInterface::summarize_lqr_stats()
 {
-  // Set to upper limit if larger than that limit.
-  // Set to lower limit if smaller than that limit.
-  // Otherwise, do not change the value.
-
-  if (up_limit < 0.0) {
-    RCLCPP_WARN_ONCE(this->get_logger(),
-                     "WARNING: Upper limit in saturation function is negative.");
+  auto now = std::chrono::steady_clock::now();
+  if (lqr_stats_window_start_ == std::chrono::steady_clock::time_point()) {
+    lqr_stats_window_start_ = now;
+  }
+  if (now - lqr_stats_window_start_ < 1s) {
+    return;
   }
 
-  float rVal;
-  if (value > up_limit)
-    rVal = up_limit;
-  else if (value < low_limit)
-    rVal = low_limit;
-  else
-    rVal = value;
+  // Taking the summary starts a new window of the control law calls.
+  LqrStatsSummary summary;
+  summary.window = ++lqr_stats_window_;
+  summary.call = lqr_.take_call_summary();
+  summary.backend = lqr_.backend();
+  summary.sent = service_sent_;
+  summary.received = service_received_;
+  summary.late = service_late_;
+  summary.stale = service_stale_;
+  summary.dropped = service_dropped_;
+  summary.fallback_ticks = service_fallback_ticks_;
+  summary.rtt_p50_us = service_rtt_hist_.percentile(0.5);
+  summary.rtt_p99_us = service_rtt_hist_.percentile(0.99);
+  summary.rtt_max_us = service_rtt_hist_.max();
+  summary.rtt_counts = service_rtt_hist_.counts();
+  lqr_stats_summary_.store(summary);
 
-  // Return the saturated value.
-  return rVal;
+  // Start a new reporting window.
+  service_sent_ = 0;
+  service_received_ = 0;
+  service_late_ = 0;
+  service_stale_ = 0;
+  service_dropped_ = 0;
+  service_fallback_ticks_ = 0;
+  service_rtt_hist_.reset();
+  lqr_stats_window_start_ = now;
 }
 
-float PythonControllerInterface::adjust_h_c(float h_c, float h, float max_diff)
+void PythonControllerInterface::publish_lqr_call_stats()
 {
-  double adjusted_h_c;
-
-  // If the error in altitude is larger than the max altitude, adjust it to the max with the correct sign.
-  // Otherwise, proceed as normal.
-  if (abs(h_c - h) > max_diff) {
-    adjusted_h_c = h + copysign(max_diff, h_c - h);
-  } else {
-    adjusted_h_c = h_c;
+  LqrStatsSummary summary = lqr_stats_summary_.load();
+  if (summary.window == published_lqr_stats_window_) {
+    return;
+  }
+  published_lqr_stats_window_ = summary.window;
+
+  rclcpp::Time now = this->get_clock()->now();
+
+  if (summary.call.window_calls > 0) {
+    lqr_srvs::msg::LqrCallStats stats;
+    stats.header.stamp = now;
+    stats.backend = lqr_backend_name(summary.backend);
+    stats.calls = summary.call.calls;
+    stats.last_call_us = summary.call.last_call_us;
+    stats.mean_call_us = summary.call.mean_call_us;
+    stats.max_call_us = summary.call.max_call_us;
+    lqr_call_stats_pub_->publish(stats);
   }
 
-  return adjusted_h_c;
+  if (summary.backend == LqrBackend::SERVICE) {
+    // The bucket edges are fixed when the histogram is constructed, so they can be read from this thread.
+    lqr_srvs::msg::LqrServiceStats stats;
+    stats.header.stamp = now;
+    stats.sent = summary.sent;
+    stats.received = summary.received;
+    stats.late = summary.late;
+    stats.stale = summary.stale;
+    stats.dropped = summary.dropped;
+    stats.fallback_ticks = summary.fallback_ticks;
+    stats.rtt_p50_us = summary.rtt_p50_us;
+    stats.rtt_p99_us = summary.rtt_p99_us;
+    stats.rtt_max_us = summary.rtt_max_us;
+    stats.bucket_upper_us.assign(service_rtt_hist_.upper_edges().begin(),
+                                 service_rtt_hist_.upper_edges().end());
+    stats.bucket_counts.assign(summary.rtt_counts.begin(), summary.rtt_counts.end());
+    lqr_service_stats_pub_->publish(stats);
+  }
 }
 
 void PythonControllerInterface::declare_parameters()
 {
   // Declare param with ROS2 and set the default value.
+  // Responses from the lqr_controller_update service older than the deadline (s) are not used. Past the deadline the
+  // last valid command decays towards trim with the hold time constant (s, 0 holds it unchanged), and past the drop
+  // timeout (s) the native law takes over.
+  service_params_.lqr_service_deadline = params_.declare_double("lqr_service_deadline", 0.02);
+  service_params_.lqr_service_hold_tau = params_.declare_double("lqr_service_hold_tau", 0.25);
+  service_params_.lqr_service_drop_timeout =
+    params_.declare_double("lqr_service_drop_timeout", 0.5);
 }
 
 } // namespace rosplane
+
+RCLCPP_COMPONENTS_REGISTER_NODE(rosplane::PythonControllerInterface)
@@ -0,0 +1,81 @@
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "realtime.hpp"
+
+namespace rosplane
+{
+
+namespace
+{
+
+/**
+ * Set by the executable that spins the real-time callback group.
+ */
+std::atomic<bool> realtime_executor(false);
+
+} // namespace
+
+void provide_realtime_executor() { realtime_executor.store(true); }
+
+bool realtime_executor_provided() { return realtime_executor.load(); }
+
+bool lock_process_memory(std::string & error)
+{
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    error = std::string("mlockall failed: ") + std::strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+bool make_thread_realtime(const RealtimeProfile & profile, std::string & error)
+{
+  bool success = true;
+
+  sched_param param{};
+  param.sched_priority = profile.priority;
+  int result = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+  if (result != 0) {
+    error = std::string("Setting SCHED_FIFO priority ") + std::to_string(profile.priority)
+      + " failed: " + std::strerror(result) + ". ";
+    success = false;
+  }
+
+  if (profile.cpu >= 0) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(profile.cpu, &cpus);
+    result = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    if (result != 0) {
+      error += std::string("Pinning to CPU ") + std::to_string(profile.cpu)
+        + " failed: " + std::strerror(result) + ".";
+      success = false;
+    }
+  }
+
+  return success;
+}
+
+void prefault_stack(std::size_t bytes)
+{
+  // Each call touches one chunk of its own frame and recurses for the rest. The buffer is read again after the
+  // recursive call, so the compiler cannot turn the recursion into a loop that reuses one frame.
+  constexpr std::size_t PAGE = 4096;
+  constexpr std::size_t CHUNK = 64 * 1024;
+  volatile unsigned char buffer[CHUNK];
+  for (std::size_t i = 0; i < CHUNK; i += PAGE) {
+    buffer[i] = 0;
+  }
+  if (bytes > CHUNK) {
+    prefault_stack(bytes - CHUNK);
+  }
+  (void) buffer[0];
+}
+
+} // namespace rosplane
@@ -0,0 +1,47 @@
+#include <cstddef>
+
+#include "tick_record.hpp"
+
+namespace rosplane
+{
+
+std::vector<RecordField> tick_record_schema()
+{
+  using Type = RecordFieldType;
+  using Input = ControllerCore::Input;
+  using Output = ControllerCore::Output;
+  auto field = [](const char * name, Type type, std::size_t offset) {
+    return RecordField{name, type, static_cast<uint32_t>(offset)};
+  };
+  std::size_t in = offsetof(TickRecord, input);
+  std::size_t out = offsetof(TickRecord, output);
+
+  return {
+    field("tick_ns", Type::INT64, offsetof(TickRecord, tick_ns)),
+    field("param_hash", Type::INT64, offsetof(TickRecord, param_hash)),
+    field("Ts", Type::FLOAT32, in + offsetof(Input, Ts)),
+    field("h", Type::FLOAT32, in + offsetof(Input, h)),
+    field("va", Type::FLOAT32, in + offsetof(Input, va)),
+    field("phi", Type::FLOAT32, in + offsetof(Input, phi)),
+    field("theta", Type::FLOAT32, in + offsetof(Input, theta)),
+    field("chi", Type::FLOAT32, in + offsetof(Input, chi)),
+    field("p", Type::FLOAT32, in + offsetof(Input, p)),
+    field("q", Type::FLOAT32, in + offsetof(Input, q)),
+    field("r", Type::FLOAT32, in + offsetof(Input, r)),
+    field("va_c", Type::FLOAT32, in + offsetof(Input, va_c)),
+    field("h_c", Type::FLOAT32, in + offsetof(Input, h_c)),
+    field("chi_c", Type::FLOAT32, in + offsetof(Input, chi_c)),
+    field("phi_ff", Type::FLOAT32, in + offsetof(Input, phi_ff)),
+    field("state_stamp_ns", Type::INT64, in + offsetof(Input, state_stamp_ns)),
+    field("sensor_stamp_ns", Type::INT64, in + offsetof(Input, sensor_stamp_ns)),
+    field("theta_c", Type::FLOAT32, out + offsetof(Output, theta_c)),
+    field("phi_c", Type::FLOAT32, out + offsetof(Output, phi_c)),
+    field("delta_e", Type::FLOAT32, out + offsetof(Output, delta_e)),
+    field("delta_a", Type::FLOAT32, out + offsetof(Output, delta_a)),
+    field("delta_r", Type::FLOAT32, out + offsetof(Output, delta_r)),
+    field("delta_t", Type::FLOAT32, out + offsetof(Output, delta_t)),
+    field("current_zone", Type::INT32, out + offsetof(Output, current_zone)),
+  };
+}
+
+} // namespace rosplane
@@ -0,0 +1,406 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+#include <Eigen/Dense>
+
+#include "trim_linearization.hpp"
+
+namespace rosplane
+{
+
+namespace
+{
+
+using Complex = std::complex<double>;
+
+// The complex step can be tiny, since there is no subtraction to lose precision to.
+constexpr double COMPLEX_STEP = 1e-30;
+constexpr int MAX_TRIM_ITERATIONS = 100;
+constexpr double TRIM_TOLERANCE = 1e-10;
+
+/**
+ * Takes the Jacobian of f at z with complex-step differentiation, one column per evaluation.
+ */
+template<int M, int N, typename Function>
+Eigen::Matrix<double, M, N> complex_step_jacobian(const Function & f,
+                                                  const Eigen::Matrix<double, N, 1> & z)
+{
+  Eigen::Matrix<double, M, N> jacobian;
+  Eigen::Matrix<Complex, N, 1> z_complex = z.template cast<Complex>();
+
+  for (int j = 0; j < N; j++) {
+    z_complex(j) += Complex(0.0, COMPLEX_STEP);
+    jacobian.col(j) = f(z_complex).imag() / COMPLEX_STEP;
+    z_complex(j) = z(j);
+  }
+
+  return jacobian;
+}
+
+/**
+ * Trim residual. The unknowns are (alpha, beta, phi, theta, delta_e, delta_a, delta_r, delta_t), and the residual is
+ * the error in the state derivatives that are constant in a level, constant rate turn.
+ */
+template<typename T>
+Eigen::Matrix<T, 10, 1> trim_residual(const AircraftParameters & params, double rho,
+                                      const FlightCondition & condition,
+                                      const Eigen::Matrix<T, 8, 1> & z)
+{
+  using std::cos;
+  using std::sin;
+
+  const T & alpha = z(0);
+  const T & beta = z(1);
+  const T & phi = z(2);
+  const T & theta = z(3);
+
+  AircraftState<T> x;
+  x(0) = T(0.0);
+  x(1) = T(0.0);
+  x(2) = T(-condition.h);
+  x(3) = condition.va * cos(alpha) * cos(beta);
+  x(4) = condition.va * sin(beta);
+  x(5) = condition.va * sin(alpha) * cos(beta);
+  x(6) = phi;
+  x(7) = theta;
+  x(8) = T(0.0);
+
+  // Body rates of a constant rate turn.
+  x(9) = -condition.turn_rate * sin(theta);
+  x(10) = condition.turn_rate * sin(phi) * cos(theta);
+  x(11) = condition.turn_rate * cos(phi) * cos(theta);
+
+  AircraftState<T> x_dot = aircraft_derivatives<T>(params, rho, x, z.template tail<4>());
+
+  Eigen::Matrix<T, 10, 1> residual;
+  residual(0) = x_dot(2);
+  residual.template segment<3>(1) = x_dot.template segment<3>(3);
+  residual(4) = x_dot(6);
+  residual(5) = x_dot(7);
+  residual(6) = x_dot(8) - condition.turn_rate;
+  residual.template segment<3>(7) = x_dot.template segment<3>(9);
+  return residual;
+}
+
+/**
+ * Equations of motion in the controller's coordinates, (va, alpha, theta, q, h, beta, phi, chi, p, r). With no wind,
+ * the course is the heading plus the sideslip.
+ */
+template<typename T>
+Eigen::Matrix<T, 10, 1> reduced_derivatives(const AircraftParameters & params, double rho,
+                                            const Eigen::Matrix<T, 10, 1> & z,
+                                            const AircraftInput<T> & delta)
+{
+  using std::cos;
+  using std::sin;
+
+  const T & va = z(0);
+  const T & alpha = z(1);
+  const T & beta = z(5);
+
+  AircraftState<T> x;
+  x(0) = T(0.0);
+  x(1) = T(0.0);
+  x(2) = -z(4);
+  x(3) = va * cos(alpha) * cos(beta);
+  x(4) = va * sin(beta);
+  x(5) = va * sin(alpha) * cos(beta);
+  x(6) = z(6);
+  x(7) = z(2);
+  x(8) = z(7) - beta;
+  x(9) = z(8);
+  x(10) = z(3);
+  x(11) = z(9);
+
+  AircraftState<T> x_dot = aircraft_derivatives<T>(params, rho, x, delta);
+
+  const T & u = x(3);
+  const T & v = x(4);
+  const T & w = x(5);
+  T va_dot = (u * x_dot(3) + v * x_dot(4) + w * x_dot(5)) / va;
+  T alpha_dot = (u * x_dot(5) - w * x_dot(3)) / (u * u + w * w);
+  T beta_dot = (va * x_dot(4) - v * va_dot) / (va * va * cos(beta));
+
+  Eigen::Matrix<T, 10, 1> z_dot;
+  z_dot(0) = va_dot;
+  z_dot(1) = alpha_dot;
+  z_dot(2) = x_dot(7);
+  z_dot(3) = x_dot(10);
+  z_dot(4) = -x_dot(2);
+  z_dot(5) = beta_dot;
+  z_dot(6) = x_dot(6);
+  z_dot(7) = x_dot(8) + beta_dot;
+  z_dot(8) = x_dot(9);
+  z_dot(9) = x_dot(11);
+  return z_dot;
+}
+
+/**
+ * Picks four slow states and two inputs out of the full model and residualizes one fast state, assuming its
+ * derivative stays zero.
+ */
+LinearModel residualize(const Eigen::Matrix<double, 10, 10> & A,
+                        const Eigen::Matrix<double, 10, 4> & B, const int (&slow)[4], int fast,
+                        const int (&inputs)[2])
+{
+  LinearModel model;
+  double a_ff = A(fast, fast);
+
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 4; j++) {
+      model.A(i, j) = A(slow[i], slow[j]) - A(slow[i], fast) * A(fast, slow[j]) / a_ff;
+    }
+    for (int k = 0; k < 2; k++) {
+      model.B(i, k) = B(slow[i], inputs[k]) - A(slow[i], fast) * B(fast, inputs[k]) / a_ff;
+    }
+  }
+
+  return model;
+}
+
+// Cache files hold the condition, the trim and both models as doubles, in the order below.
+constexpr char CACHE_MAGIC[8] = "RPTRIM1";
+
+template<typename Derived>
+void write_matrix(std::ofstream & file, const Eigen::MatrixBase<Derived> & matrix)
+{
+  for (Eigen::Index i = 0; i < matrix.rows(); i++) {
+    for (Eigen::Index j = 0; j < matrix.cols(); j++) {
+      double value = matrix(i, j);
+      file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+  }
+}
+
+template<typename Derived>
+bool read_matrix(std::ifstream & file, Eigen::MatrixBase<Derived> & matrix)
+{
+  for (Eigen::Index i = 0; i < matrix.rows(); i++) {
+    for (Eigen::Index j = 0; j < matrix.cols(); j++) {
+      if (!file.read(reinterpret_cast<char *>(&matrix(i, j)), sizeof(double))) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/**
+ * Names the cache file after an FNV-1a hash of the aircraft parameters and the flight condition, so changing any
+ * parameter invalidates the cache.
+ */
+std::string cache_filename(const std::string & cache_dir, const AircraftParameters & params,
+                           const FlightCondition & condition)
+{
+  uint64_t hash = 14695981039346656037ull;
+  auto mix = [&hash](const void * data, std::size_t size) {
+    const unsigned char * bytes = static_cast<const unsigned char *>(data);
+    for (std::size_t i = 0; i < size; i++) {
+      hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+  };
+  mix(&params, sizeof(params));
+  mix(&condition, sizeof(condition));
+
+  char name[32];
+  std::snprintf(name, sizeof(name), "trim_%016llx.bin", static_cast<unsigned long long>(hash));
+  return cache_dir + "/" + name;
+}
+
+bool load_cached(const std::string & filename, const FlightCondition & condition,
+                 TrimLinearization & result)
+{
+  std::ifstream file(filename, std::ios::binary);
+  char magic[8];
+  if (!file || !file.read(magic, sizeof(magic)) || std::memcmp(magic, CACHE_MAGIC, 8) != 0) {
+    return false;
+  }
+
+  Eigen::Vector3d cached_condition;
+  Eigen::Matrix<double, 10, 1> trim;
+  if (!read_matrix(file, cached_condition) || !read_matrix(file, trim)
+      || !read_matrix(file, result.longitudinal.A) || !read_matrix(file, result.longitudinal.B)
+      || !read_matrix(file, result.lateral.A) || !read_matrix(file, result.lateral.B)) {
+    return false;
+  }
+
+  // Guard against hash collisions.
+  if (cached_condition != Eigen::Vector3d(condition.va, condition.h, condition.turn_rate)) {
+    return false;
+  }
+
+  result.condition = condition;
+  result.trim.alpha = trim(0);
+  result.trim.beta = trim(1);
+  result.trim.phi = trim(2);
+  result.trim.theta = trim(3);
+  result.trim.delta = trim.segment<4>(4);
+  result.trim.residual = trim(8);
+  result.trim.converged = trim(9) != 0.0;
+  return true;
+}
+
+void store_cached(const std::string & filename, const TrimLinearization & result)
+{
+  Eigen::Matrix<double, 10, 1> trim;
+  trim << result.trim.alpha, result.trim.beta, result.trim.phi, result.trim.theta,
+    result.trim.delta, result.trim.residual, result.trim.converged ? 1.0 : 0.0;
+
+  // Write to a temporary file and rename it, so a reader never sees a partial file.
+  std::string temporary = filename + ".tmp";
+  {
+    std::ofstream file(temporary, std::ios::binary);
+    if (!file) {
+      return;
+    }
+    file.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    write_matrix(file,
+                 Eigen::Vector3d(result.condition.va, result.condition.h, result.condition.turn_rate));
+    write_matrix(file, trim);
+    write_matrix(file, result.longitudinal.A);
+    write_matrix(file, result.longitudinal.B);
+    write_matrix(file, result.lateral.A);
+    write_matrix(file, result.lateral.B);
+    if (!file) {
+      return;
+    }
+  }
+  std::rename(temporary.c_str(), filename.c_str());
+}
+
+} // namespace
+
+TrimPoint find_trim(const AircraftParameters & params, const FlightCondition & condition)
+{
+  double rho = air_density(params.rho, condition.h);
+  auto residual = [&](const auto & z) {
+    return trim_residual(params, rho, condition, z);
+  };
+
+  // Start from wings level cruise, banked for a coordinated turn.
+  Eigen::Matrix<double, 8, 1> z;
+  z << 0.05, 0.0, std::atan(condition.va * condition.turn_rate / params.gravity), 0.05, 0.0, 0.0,
+    0.0, 0.5;
+
+  Eigen::Matrix<double, 10, 1> r = residual(z);
+  double lambda = 1e-3;
+
+  for (int iteration = 0; iteration < MAX_TRIM_ITERATIONS && r.norm() > TRIM_TOLERANCE;
+       iteration++) {
+    Eigen::Matrix<double, 10, 8> J = complex_step_jacobian<10, 8>(residual, z);
+    Eigen::Matrix<double, 8, 8> JtJ = J.transpose() * J;
+    Eigen::Matrix<double, 8, 1> g = J.transpose() * r;
+
+    // Levenberg-Marquardt: shrink the damping after a step that reduces the residual, grow it otherwise.
+    bool improved = false;
+    for (int attempt = 0; attempt < 10 && !improved; attempt++) {
+      Eigen::Matrix<double, 8, 8> damped = JtJ;
+      damped.diagonal() += lambda * (JtJ.diagonal().array() + 1e-12).matrix();
+      Eigen::Matrix<double, 8, 1> z_next = z - damped.ldlt().solve(g);
+      Eigen::Matrix<double, 10, 1> r_next = residual(z_next);
+
+      if (r_next.allFinite() && r_next.norm() < r.norm()) {
+        z = z_next;
+        r = r_next;
+        lambda = std::max(lambda * 0.1, 1e-12);
+        improved = true;
+      } else {
+        lambda *= 10.0;
+      }
+    }
+    if (!improved) {
+      break;
+    }
+  }
+
+  TrimPoint trim;
+  trim.alpha = z(0);
+  trim.beta = z(1);
+  trim.phi = z(2);
+  trim.theta = z(3);
+  trim.delta = z.tail<4>();
+  trim.residual = r.norm();
+  trim.converged = trim.residual <= TRIM_TOLERANCE;
+  return trim;
+}
+
+TrimLinearization linearize(const AircraftParameters & params, const FlightCondition & condition,
+                            const TrimPoint & trim)
+{
+  double rho = air_density(params.rho, condition.h);
+
+  // The trim in the controller's coordinates, heading north.
+  Eigen::Matrix<double, 10, 1> z;
+  z << condition.va, trim.alpha, trim.theta, condition.turn_rate * std::sin(trim.phi)
+    * std::cos(trim.theta), condition.h, trim.beta, trim.phi, trim.beta,
+    -condition.turn_rate * std::sin(trim.theta),
+    condition.turn_rate * std::cos(trim.phi) * std::cos(trim.theta);
+
+  Eigen::Matrix<double, 10, 10> A = complex_step_jacobian<10, 10>(
+    [&](const auto & z_complex) {
+      return reduced_derivatives(params, rho, z_complex, trim.delta.cast<Complex>().eval());
+    },
+    z);
+  Eigen::Matrix<double, 10, 4> B = complex_step_jacobian<10, 4>(
+    [&](const auto & delta_complex) {
+      return reduced_derivatives(params, rho, z.cast<Complex>().eval(), delta_complex);
+    },
+    trim.delta);
+
+  TrimLinearization result;
+  result.condition = condition;
+  result.trim = trim;
+  result.longitudinal = residualize(A, B, {0, 2, 3, 4}, 1, {0, 3});
+  result.lateral = residualize(A, B, {6, 7, 8, 9}, 5, {1, 2});
+  return result;
+}
+
+std::vector<TrimLinearization> sweep_trim_linearization(const AircraftParameters & params,
+                                                        const std::vector<FlightCondition> & conditions,
+                                                        const std::string & cache_dir,
+                                                        unsigned int threads)
+{
+  std::vector<TrimLinearization> results(conditions.size());
+  std::atomic<std::size_t> next(0);
+
+  // Each worker takes the next unsolved condition, so uneven trim times balance out.
+  auto work = [&]() {
+    for (std::size_t i = next++; i < conditions.size(); i = next++) {
+      std::string filename;
+      if (!cache_dir.empty()) {
+        filename = cache_filename(cache_dir, params, conditions[i]);
+        if (load_cached(filename, conditions[i], results[i])) {
+          continue;
+        }
+      }
+
+      results[i] = linearize(params, conditions[i], find_trim(params, conditions[i]));
+
+      if (!filename.empty()) {
+        store_cached(filename, results[i]);
+      }
+    }
+  };
+
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  std::vector<std::thread> workers;
+  for (unsigned int i = 1; i < threads; i++) {
+    workers.emplace_back(work);
+  }
+  work();
+  for (std::thread & worker : workers) {
+    worker.join();
+  }
+
+  return results;
+}
+
+} // namespace rosplane
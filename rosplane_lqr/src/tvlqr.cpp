@@ -0,0 +1,207 @@
+#include <algorithm>
+#include <cmath>
+
+#include "dare_solver.hpp"
+#include "tvlqr.hpp"
+
+namespace rosplane
+{
+
+namespace
+{
+
+/**
+ * The discrete lateral model with the course dynamics linearized about a roll reference.
+ */
+LinearModel lateral_model_at(const LinearModelCoefficients & coefficients, double phi_ref, double Ts)
+{
+  LinearModel model = lateral_model(coefficients);
+  double cos_phi = std::cos(phi_ref);
+  model.A(1, 0) = coefficients.gravity / (coefficients.va_trim * cos_phi * cos_phi);
+  return discretize(model, Ts);
+}
+
+} // namespace
+
+TvlqrGainTrajectory::TvlqrGainTrajectory()
+    : length_(1)
+    , start_tick_(0)
+{}
+
+bool TvlqrGainTrajectory::plan(const TvlqrDesign & design, const TvlqrSegment & segment)
+{
+  Eigen::Matrix4d Q = design.q_lat.asDiagonal();
+  Eigen::Matrix2d R = design.r_lat.asDiagonal();
+
+  // The segment is flown at its own airspeed, and an orbit at the roll that keeps the aircraft on its radius.
+  LinearModelCoefficients coefficients = design.coefficients;
+  if (segment.va > 0.0) {
+    coefficients.va_trim = segment.va;
+  }
+  double phi_start = segment.phi_start;
+  double phi_end = 0.0;
+  if (segment.rho > 0.0) {
+    double va = coefficients.va_trim;
+    phi_end = segment.lamda * std::atan(va * va / (coefficients.gravity * segment.rho));
+  }
+
+  // Terminal cost: the steady state cost once the aircraft holds the segment's roll.
+  LinearModel terminal = lateral_model_at(coefficients, phi_end, design.Ts);
+  DareSolver<4, 2> dare;
+  if (!dare.solve(terminal.A, terminal.B, Q, R)) {
+    return false;
+  }
+  Eigen::Matrix4d P = dare.cost();
+
+  // The horizon is set in seconds, so the plan covers the same roll transition at any controller rate.
+  double ticks = std::round(design.horizon / design.Ts);
+  std::size_t length = static_cast<std::size_t>(std::clamp(ticks, 1.0, double(MAX_STEPS)));
+
+  // Backward recursion. The model only changes while the roll reference is moving, so it is only rediscretized then.
+  double roll_step = std::max(design.roll_rate, 1e-6) * design.Ts;
+  double last_phi = phi_end;
+  LinearModel model = terminal;
+
+  for (std::size_t k = length; k-- > 0;) {
+    double moved = std::min(k * roll_step, std::abs(phi_end - phi_start));
+    double phi_ref = phi_start + std::copysign(moved, phi_end - phi_start);
+
+    if (phi_ref != last_phi) {
+      model = lateral_model_at(coefficients, phi_ref, design.Ts);
+      last_phi = phi_ref;
+    }
+
+    Eigen::Matrix<double, 2, 4> K =
+      (R + model.B.transpose() * P * model.B).ldlt().solve(model.B.transpose() * P * model.A);
+    P = Q + model.A.transpose() * P * (model.A - model.B * K);
+    P = 0.5 * (P + P.transpose());
+
+    steps_[k].gain = K.cast<float>();
+    steps_[k].phi_ref = phi_ref;
+  }
+
+  length_ = length;
+  start_tick_ = segment.start_tick;
+  return true;
+}
+
+const TvlqrGainTrajectory::Step * TvlqrGainTrajectory::step(uint64_t tick) const
+{
+  if (tick < start_tick_ || tick - start_tick_ >= length_) {
+    return nullptr;
+  }
+  return &steps_[tick - start_tick_];
+}
+
+TvlqrPlanner::TvlqrPlanner()
+    : have_design_(false)
+    , stop_(false)
+    , request_id_(0)
+    , ready_(nullptr)
+    , retired_(nullptr)
+    , active_(nullptr)
+{
+  sem_init(&wakeup_, 0, 0);
+  worker_ = std::thread(&TvlqrPlanner::run, this);
+}
+
+TvlqrPlanner::~TvlqrPlanner()
+{
+  stop_.store(true);
+  sem_post(&wakeup_);
+  worker_.join();
+  sem_destroy(&wakeup_);
+
+  free_retired();
+  delete ready_.exchange(nullptr);
+  delete active_;
+}
+
+void TvlqrPlanner::configure(const TvlqrDesign & design)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  design_ = design;
+  have_design_ = true;
+}
+
+void TvlqrPlanner::request(const TvlqrSegment & segment)
+{
+  Request request;
+  request.id = ++request_id_;
+  request.segment = segment;
+  request_.store(request);
+  sem_post(&wakeup_);
+}
+
+const TvlqrGainTrajectory * TvlqrPlanner::latest()
+{
+  Block * fresh = ready_.exchange(nullptr, std::memory_order_acquire);
+
+  if (fresh != nullptr) {
+    // Hand the plan being replaced back to the worker to free, so the control loop never deallocates.
+    if (active_ != nullptr) {
+      active_->next = retired_.load(std::memory_order_relaxed);
+      while (!retired_.compare_exchange_weak(active_->next, active_, std::memory_order_release,
+                                             std::memory_order_relaxed)) {
+      }
+    }
+    active_ = fresh;
+  }
+
+  return active_ != nullptr ? &active_->trajectory : nullptr;
+}
+
+void TvlqrPlanner::run()
+{
+  // The worker keeps the default priority, below the real-time control loop but not starved like the gain solver
+  // may be, since a plan is only useful while the aircraft is still rolling onto its segment.
+  uint64_t planned_id = 0;
+
+  while (true) {
+    while (sem_wait(&wakeup_) != 0) {
+    }
+    if (stop_.load()) {
+      return;
+    }
+
+    // Several requests may have been queued since the last wake up, only the newest one is planned.
+    Request request = request_.load();
+    if (request.id == planned_id) {
+      continue;
+    }
+
+    TvlqrDesign design;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!have_design_) {
+        continue;
+      }
+      design = design_;
+    }
+    planned_id = request.id;
+
+    free_retired();
+
+    // The previous plan is kept if the new one fails.
+    Block * block = new Block;
+    if (!block->trajectory.plan(design, request.segment)) {
+      delete block;
+      continue;
+    }
+
+    // Publish the plan. A plan the control loop never picked up can be freed right away.
+    delete ready_.exchange(block, std::memory_order_acq_rel);
+  }
+}
+
+void TvlqrPlanner::free_retired()
+{
+  Block * block = retired_.exchange(nullptr, std::memory_order_acquire);
+  while (block != nullptr) {
+    Block * next = block->next;
+    delete block;
+    block = next;
+  }
+}
+
+} // namespace rosplane
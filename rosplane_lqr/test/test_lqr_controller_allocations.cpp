@@ -0,0 +1,141 @@
+/**
+ * Checks that the control law of the lqr_controller does not allocate once it has warmed up, including on the ticks that
+ * pick up a parameter change or a new path segment. Built with the allocation hook, see include/allocation_tracker.hpp.
+ */
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "allocation_tracker.hpp"
+#include "lqr_controller.hpp"
+
+namespace
+{
+
+using Input = rosplane::ControllerCore::Input;
+using Output = rosplane::ControllerCore::Output;
+
+/**
+ * An aircraft in altitude hold, close to its commands.
+ */
+Input altitude_hold_input()
+{
+  Input input{};
+  input.Ts = 0.01;
+  input.h = 50.0;
+  input.va = 25.0;
+  input.phi = 0.05;
+  input.theta = 0.02;
+  input.chi = 0.4;
+  input.p = 0.01;
+  input.q = -0.01;
+  input.r = 0.02;
+  input.va_c = 25.0;
+  input.h_c = 52.0;
+  input.chi_c = 0.5;
+  input.phi_ff = 0.0;
+  return input;
+}
+
+/**
+ * Flies the controller from take-off into altitude hold, so every zone has run once.
+ * @param controller The controller.
+ */
+void warm_up(rosplane::LqrController & controller)
+{
+  Input input = altitude_hold_input();
+  Output output{};
+  for (float h : {0.0f, 20.0f, 50.0f}) {
+    input.h = h;
+    for (int i = 0; i < 10; i++) {
+      controller.update(input, output);
+    }
+  }
+}
+
+/**
+ * Sets parameters from another thread, so the allocations of preparing them are not counted on this one.
+ * @param controller The controller.
+ * @param values The names and new values of the parameters.
+ */
+void set_parameters_elsewhere(
+  rosplane::LqrController & controller,
+  const std::vector<std::pair<std::string, rosplane::ParamValue>> & values)
+{
+  bool set = false;
+  std::thread writer([&]() {
+    std::string error;
+    set = controller.set_parameters(values, error);
+  });
+  writer.join();
+  ASSERT_TRUE(set);
+}
+
+} // namespace
+
+TEST(LqrControllerAllocations, UpdateDoesNotAllocate)
+{
+  ASSERT_TRUE(rosplane::allocation_tracking_active());
+
+  rosplane::LqrController controller;
+  warm_up(controller);
+
+  Input input = altitude_hold_input();
+  Output output{};
+  uint64_t before = rosplane::thread_allocation_count();
+  for (int i = 0; i < 1000; i++) {
+    controller.update(input, output);
+  }
+  EXPECT_EQ(rosplane::thread_allocation_count(), before);
+}
+
+TEST(LqrControllerAllocations, ParameterChangeDoesNotAllocateOnTick)
+{
+  ASSERT_TRUE(rosplane::allocation_tracking_active());
+
+  rosplane::LqrController controller;
+  warm_up(controller);
+
+  // Switching to the linear MPC sets up its problems, which must happen off the control loop.
+  set_parameters_elsewhere(controller,
+                           {{"lqr_backend", std::string("linear_mpc")}, {"trim_t", 0.55}});
+
+  Input input = altitude_hold_input();
+  Output output{};
+  uint64_t before = rosplane::thread_allocation_count();
+  for (int i = 0; i < 100; i++) {
+    controller.update(input, output);
+  }
+  EXPECT_EQ(rosplane::thread_allocation_count(), before);
+  EXPECT_EQ(controller.backend(), rosplane::LqrBackend::LINEAR_MPC);
+}
+
+TEST(LqrControllerAllocations, PathSwitchDoesNotAllocateOnTick)
+{
+  ASSERT_TRUE(rosplane::allocation_tracking_active());
+
+  rosplane::LqrController controller;
+  set_parameters_elsewhere(controller, {{"lqr_tracking", true}});
+  warm_up(controller);
+
+  rosplane::LqrController::PathSegment path{};
+  path.orbit = true;
+  path.rho = 150.0;
+  path.lamda = 1;
+
+  // The gains are planned on the planner's thread, and picked up by the ticks once they are ready.
+  Input input = altitude_hold_input();
+  Output output{};
+  uint64_t before = rosplane::thread_allocation_count();
+  controller.set_path(path);
+  for (int i = 0; i < 100; i++) {
+    controller.update(input, output);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_EQ(rosplane::thread_allocation_count(), before);
+}